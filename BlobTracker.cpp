@@ -0,0 +1,316 @@
+#include "BlobTracker.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+const float BlobTracker::ACCELERATION_NOISE = 20.0f;
+const float BlobTracker::MEASUREMENT_NOISE = 0.03f;
+
+BlobTracker::BlobTracker()
+: m_nextId(1), m_time(0.0)
+{
+}
+
+BlobTracker::~BlobTracker()
+{
+}
+
+void
+BlobTracker::reset()
+{
+	m_tracks.clear();
+	std::fill(m_slotsUsed.begin(), m_slotsUsed.end(), false);
+	m_time = 0.0;
+	trackCount = 0;
+}
+
+// Kuhn-Munkres with potentials, O(rows^2 columns), for rows <= columns.
+// Wider than tall is handled by solving the transpose.
+void
+BlobTracker::assign(const std::vector<float> &cost, int rows, int columns, std::vector<int> &result)
+{
+	result.assign(rows, -1);
+	if (rows == 0 || columns == 0) return;
+
+	bool transposed = rows > columns;
+	int n = transposed ? columns : rows, m = transposed ? rows : columns;
+	auto at = [&](int i, int j) { return (double)(transposed ? cost[j * columns + i] : cost[i * columns + j]); };
+
+	// 1-based, column 0 holds the row being added
+	const double INF = std::numeric_limits<double>::infinity();
+	std::vector<double> u(n + 1, 0.0), v(m + 1, 0.0), minv(m + 1);
+	std::vector<int> p(m + 1, 0), way(m + 1, 0);
+	std::vector<bool> used(m + 1);
+	for (int i = 1; i <= n; i++) {
+		p[0] = i;
+		int j0 = 0;
+		std::fill(minv.begin(), minv.end(), INF);
+		std::fill(used.begin(), used.end(), false);
+		do {
+			used[j0] = true;
+			int i0 = p[j0], j1 = 0;
+			double delta = INF;
+			for (int j = 1; j <= m; j++) {
+				if (used[j]) continue;
+				double c = at(i0 - 1, j - 1) - u[i0] - v[j];
+				if (c < minv[j]) {
+					minv[j] = c;
+					way[j] = j0;
+				}
+				if (minv[j] < delta) {
+					delta = minv[j];
+					j1 = j;
+				}
+			}
+			for (int j = 0; j <= m; j++) {
+				if (used[j]) {
+					u[p[j]] += delta;
+					v[j] -= delta;
+				}
+				else {
+					minv[j] -= delta;
+				}
+			}
+			j0 = j1;
+		} while (p[j0] != 0);
+		do {
+			int j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		} while (j0 != 0);
+	}
+
+	for (int j = 1; j <= m; j++) {
+		if (p[j] == 0) continue;
+		if (transposed) result[j - 1] = p[j] - 1;
+		else result[p[j] - 1] = j - 1;
+	}
+}
+
+int32_t
+BlobTracker::root(int32_t cell)
+{
+	while (m_parents[cell] != cell) {
+		m_parents[cell] = m_parents[m_parents[cell]];
+		cell = m_parents[cell];
+	}
+	return cell;
+}
+
+// Connected components of the cells that are at least half foreground,
+// 8-connected, each with the sum and count of its foreground points
+void
+BlobTracker::findBlobs(const float *cameraPoints, const float *worldPoints, int width, int height, ThreadPool &pool)
+{
+	const int cellsX = (width + CELL - 1) / CELL, cellsY = (height + CELL - 1) / CELL;
+	m_cells.resize(cellsX * cellsY);
+
+	// Camera space looks down -z, in metres
+	const float nearZ = -m_settings.nearDepth * 0.001f, farZ = -m_settings.farDepth * 0.001f;
+	pool.parallelFor(cellsY, [&](int begin, int end) {
+		for (int cy = begin; cy < end; cy++) {
+			Blob *cells = m_cells.data() + cy * cellsX;
+			for (int cx = 0; cx < cellsX; cx++)
+				cells[cx] = Blob{ { 0.0, 0.0, 0.0 }, 0 };
+			for (int y = cy * CELL; y < std::min(height, (cy + 1) * CELL); y++) {
+				const float *camera = cameraPoints + (size_t)y * width * 4;
+				const float *world = worldPoints + (size_t)y * width * 4;
+				for (int x = 0; x < width; x++) {
+					const float *c = camera + x * 4;
+					if (!(c[3] > 0.0f && c[2] <= nearZ && c[2] >= farZ)) continue;
+					Blob &cell = cells[x / CELL];
+					for (int a = 0; a < 3; a++) cell.sum[a] += world[x * 4 + a];
+					cell.pixels++;
+				}
+			}
+		}
+	}, 4);
+
+	const int32_t half = CELL * CELL / 2;
+	m_parents.resize(m_cells.size());
+	for (int cy = 0; cy < cellsY; cy++) {
+		for (int cx = 0; cx < cellsX; cx++) {
+			int32_t i = cy * cellsX + cx;
+			if (m_cells[i].pixels < half) {
+				m_parents[i] = -1;
+				continue;
+			}
+			m_parents[i] = i;
+			const int dx[4] = { -1, -1, 0, 1 }, dy[4] = { 0, -1, -1, -1 };
+			for (int k = 0; k < 4; k++) {
+				int nx = cx + dx[k], ny = cy + dy[k];
+				if (nx < 0 || nx >= cellsX || ny < 0 || m_parents[ny * cellsX + nx] < 0) continue;
+				int32_t a = root(i), b = root(ny * cellsX + nx);
+				if (a != b) m_parents[std::max(a, b)] = std::min(a, b);
+			}
+		}
+	}
+
+	m_blobs.clear();
+	m_blobOfRoot.assign(m_cells.size(), -1);
+	for (int32_t i = 0; i < (int32_t)m_cells.size(); i++) {
+		if (m_parents[i] < 0) continue;
+		int32_t r = root(i);
+		if (m_blobOfRoot[r] < 0) {
+			m_blobOfRoot[r] = (int32_t)m_blobs.size();
+			m_blobs.push_back(Blob{ { 0.0, 0.0, 0.0 }, 0 });
+		}
+		Blob &blob = m_blobs[m_blobOfRoot[r]];
+		for (int a = 0; a < 3; a++) blob.sum[a] += m_cells[i].sum[a];
+		blob.pixels += m_cells[i].pixels;
+	}
+
+	const int32_t minPixels = m_settings.minPixels;
+	m_blobs.erase(std::remove_if(m_blobs.begin(), m_blobs.end(),
+		[minPixels](const Blob &b) { return b.pixels < minPixels; }), m_blobs.end());
+	for (Blob &blob : m_blobs)
+		for (int a = 0; a < 3; a++) blob.sum[a] /= blob.pixels;
+}
+
+void
+BlobTracker::update(const float *cameraPoints, const float *worldPoints, int width, int height, double time,
+	const TrackerSettings &settings, ThreadPool &pool)
+{
+	auto start = std::chrono::steady_clock::now();
+	m_settings = settings;
+	findBlobs(cameraPoints, worldPoints, width, height, pool);
+	blobCount = (int32_t)m_blobs.size();
+	auto found = std::chrono::steady_clock::now();
+
+	// Predict every track to this frame. A long gap, such as a stalled
+	// camera, is capped so the uncertainty stays sensible.
+	float dt = m_time > 0.0 ? (float)std::min(std::max(time - m_time, 0.0), 1.0) : 0.0f;
+	m_time = time;
+	const float q = ACCELERATION_NOISE, r = MEASUREMENT_NOISE * MEASUREMENT_NOISE;
+	for (Track &track : m_tracks) {
+		for (int a = 0; a < 3; a++) track.x[a] += track.v[a] * dt;
+		float (&p)[2][2] = track.p;
+		float p00 = p[0][0] + dt * (p[0][1] + p[1][0]) + dt * dt * p[1][1] + q * dt * dt * dt / 3.0f;
+		float p01 = p[0][1] + dt * p[1][1] + q * dt * dt / 2.0f;
+		float p10 = p[1][0] + dt * p[1][1] + q * dt * dt / 2.0f;
+		float p11 = p[1][1] + q * dt;
+		p[0][0] = p00;
+		p[0][1] = p01;
+		p[1][0] = p10;
+		p[1][1] = p11;
+	}
+
+	// Match on distance; pairs beyond the gate cost more than any match
+	// inside it, and are turned down afterwards
+	const int rows = (int)m_tracks.size(), columns = (int)m_blobs.size();
+	const float gate = std::max(settings.gate, 0.0f);
+	m_cost.resize(rows * columns);
+	for (int t = 0; t < rows; t++) {
+		for (int b = 0; b < columns; b++) {
+			float d2 = 0.0f;
+			for (int a = 0; a < 3; a++) {
+				float d = (float)m_blobs[b].sum[a] - m_tracks[t].x[a];
+				d2 += d * d;
+			}
+			float d = std::sqrt(d2);
+			m_cost[t * columns + b] = d <= gate ? d : gate * 2.0f + 1.0f;
+		}
+	}
+	assign(m_cost, rows, columns, m_assignment);
+
+	// Correct the matched tracks
+	std::vector<bool> claimed(columns, false);
+	for (int t = 0; t < rows; t++) {
+		Track &track = m_tracks[t];
+		int b = m_assignment[t];
+		if (b < 0 || m_cost[t * columns + b] > gate) {
+			track.misses++;
+			continue;
+		}
+		claimed[b] = true;
+		float (&p)[2][2] = track.p;
+		float s = p[0][0] + r;
+		float k0 = p[0][0] / s, k1 = p[1][0] / s;
+		for (int a = 0; a < 3; a++) {
+			float innovation = (float)m_blobs[b].sum[a] - track.x[a];
+			track.x[a] += k0 * innovation;
+			track.v[a] += k1 * innovation;
+		}
+		float p00 = (1.0f - k0) * p[0][0], p01 = (1.0f - k0) * p[0][1];
+		float p10 = p[1][0] - k1 * p[0][0], p11 = p[1][1] - k1 * p[0][1];
+		p[0][0] = p00;
+		p[0][1] = p01;
+		p[1][0] = p10;
+		p[1][1] = p11;
+		track.hits++;
+		track.misses = 0;
+		track.pixels = m_blobs[b].pixels;
+	}
+
+	// Unconfirmed tracks go at their first miss, confirmed ones after
+	// MAX_MISSES in a row
+	m_tracks.erase(std::remove_if(m_tracks.begin(), m_tracks.end(), [this](const Track &track) {
+		bool gone = track.misses > (track.hits >= CONFIRM_HITS ? MAX_MISSES : 0);
+		if (gone && track.slot >= 0) m_slotsUsed[track.slot] = false;
+		return gone;
+	}), m_tracks.end());
+
+	// Blobs nobody claimed start new tracks, standing still until they are
+	// seen again
+	for (int b = 0; b < columns; b++) {
+		if (claimed[b]) continue;
+		Track track;
+		track.id = m_nextId++;
+		track.slot = -1;
+		for (int a = 0; a < 3; a++) {
+			track.x[a] = (float)m_blobs[b].sum[a];
+			track.v[a] = 0.0f;
+		}
+		track.p[0][0] = r;
+		track.p[0][1] = track.p[1][0] = 0.0f;
+		track.p[1][1] = 1.0f;
+		track.hits = 1;
+		track.misses = 0;
+		track.pixels = m_blobs[b].pixels;
+		m_tracks.push_back(track);
+	}
+
+	// Confirmed tracks take the lowest free slot, once one is free. Fewer
+	// slots than before sends the tracks in the lost ones back to waiting.
+	const size_t slots = (size_t)std::max(settings.maxTargets, 0);
+	if (m_slotsUsed.size() != slots) {
+		m_slotsUsed.assign(slots, false);
+		for (Track &track : m_tracks) {
+			if (track.slot >= (int32_t)slots) track.slot = -1;
+			if (track.slot >= 0) m_slotsUsed[track.slot] = true;
+		}
+	}
+	int32_t confirmed = 0;
+	for (Track &track : m_tracks) {
+		if (track.hits < CONFIRM_HITS) continue;
+		confirmed++;
+		if (track.slot >= 0) continue;
+		auto free = std::find(m_slotsUsed.begin(), m_slotsUsed.end(), false);
+		if (free == m_slotsUsed.end()) continue;
+		*free = true;
+		track.slot = (int32_t)(free - m_slotsUsed.begin());
+	}
+	trackCount = confirmed;
+
+	auto end = std::chrono::steady_clock::now();
+	blobMs = std::chrono::duration<double, std::milli>(found - start).count();
+	trackMs = std::chrono::duration<double, std::milli>(end - found).count();
+}
+
+void
+BlobTracker::predict(double ahead, std::vector<Target> &slots) const
+{
+	slots.assign(m_slotsUsed.size(), Target());
+	for (const Track &track : m_tracks) {
+		if (track.slot < 0) continue;
+		Target &target = slots[track.slot];
+		target.present = true;
+		target.id = track.id;
+		for (int a = 0; a < 3; a++) {
+			target.position[a] = track.x[a] + track.v[a] * (float)ahead;
+			target.velocity[a] = track.v[a];
+		}
+		target.pixels = track.pixels;
+	}
+}
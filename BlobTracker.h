@@ -0,0 +1,127 @@
+#ifndef BlobTracker_h
+#define BlobTracker_h
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+struct TrackerSettings
+{
+	float nearDepth = 200.0f;		// foreground depth range, mm
+	float farDepth = 1500.0f;
+	int32_t minPixels = 400;		// smaller blobs are ignored
+	float gate = 0.5f;				// farthest a target can be matched to a blob, m
+	int32_t maxTargets = 8;			// output slots
+
+	bool operator==(const TrackerSettings &o) const
+	{
+		return nearDepth == o.nearDepth && farDepth == o.farDepth && minPixels == o.minPixels &&
+			gate == o.gate && maxTargets == o.maxTargets;
+	}
+	bool operator!=(const TrackerSettings &o) const { return !(*this == o); }
+};
+
+// One output slot. A target keeps its slot for as long as it is tracked.
+struct Target
+{
+	bool present = false;
+	int32_t id = 0;
+	float position[3] = { 0.0f, 0.0f, 0.0f };	// world, m, predicted ahead
+	float velocity[3] = { 0.0f, 0.0f, 0.0f };	// m/s
+	int32_t pixels = 0;							// size of its last blob
+};
+
+// Tracks people, or anything else in the foreground, as world-space targets.
+// Blobs are the connected components of the foreground, found on a grid of
+// CELL x CELL pixel cells whose point sums are gathered in parallel. Each
+// target runs a constant-velocity Kalman filter per axis; every frame the
+// filters are predicted to the frame's capture time, matched to the blob
+// centroids by the Hungarian algorithm on distance, and corrected. Blobs
+// left over start new targets, which are shown once they have been seen
+// CONFIRM_HITS times, and targets go after MAX_MISSES frames without a blob.
+// predict() then moves every target ahead by the pipeline's latency, so the
+// output is where the target is now rather than where the camera saw it.
+// Cook thread only.
+class BlobTracker
+{
+
+public:
+	static const int CELL = 4;
+	static const int CONFIRM_HITS = 3;
+	static const int MAX_MISSES = 10;
+
+	// Filter noise: acceleration spectral density, (m/s^2)^2 s, and the
+	// blob centroid's standard deviation, m
+	static const float ACCELERATION_NOISE;
+	static const float MEASUREMENT_NOISE;
+
+	BlobTracker();
+	virtual ~BlobTracker();
+
+	// Finds the blobs in a frame captured at time, in seconds, and updates
+	// the targets. Points are xyzw per pixel, as from deprojectDepth(); camera
+	// points pick the foreground and world points place it.
+	void update(const float *cameraPoints, const float *worldPoints, int width, int height, double time,
+		const TrackerSettings &settings, ThreadPool &pool);
+
+	// The targets by slot, maxTargets of them, moved ahead seconds on from
+	// the last frame's capture time
+	void predict(double ahead, std::vector<Target> &slots) const;
+
+	// Drops every target
+	void reset();
+
+	// Time of the last frame, s
+	double time() const { return m_time; }
+
+	// Telemetry
+	std::atomic<int32_t> blobCount{ 0 };
+	std::atomic<int32_t> trackCount{ 0 };
+	std::atomic<double> blobMs{ 0.0 };
+	std::atomic<double> trackMs{ 0.0 };
+
+private:
+	struct Blob
+	{
+		double sum[3];
+		int32_t pixels;
+	};
+
+	struct Track
+	{
+		int32_t id;
+		int32_t slot;				// -1 until confirmed and given one
+		float x[3];
+		float v[3];
+		float p[2][2];				// covariance, the same for every axis
+		int32_t hits;
+		int32_t misses;
+		int32_t pixels;
+	};
+
+	// Returns, for each of rows, the column it is given, or -1; cost is
+	// rows x columns.
+	static void assign(const std::vector<float> &cost, int rows, int columns, std::vector<int> &result);
+
+	void findBlobs(const float *cameraPoints, const float *worldPoints, int width, int height, ThreadPool &pool);
+	int32_t root(int32_t cell);
+
+	TrackerSettings m_settings;
+	std::vector<Track> m_tracks;
+	std::vector<Blob> m_blobs;
+	std::vector<bool> m_slotsUsed;
+	int32_t m_nextId;
+	double m_time;
+
+	// Per cell point sums, and the union-find parents of the foreground cells
+	std::vector<Blob> m_cells;
+	std::vector<int32_t> m_parents;
+	std::vector<int32_t> m_blobOfRoot;
+
+	std::vector<float> m_cost;
+	std::vector<int> m_assignment;
+
+};
+
+#endif
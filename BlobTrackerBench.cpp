@@ -0,0 +1,143 @@
+// Speed, identity stability and prediction error of BlobTracker on a
+// synthetic scene: 50 discs, each bouncing around its own cell of a
+// 640 x 480 frame at 60 pixels a second, captured at 60 Hz. Not part of the
+// plugin; build it on its own:
+//
+//	g++ -O2 -std=c++14 BlobTrackerBench.cpp BlobTracker.cpp ThreadPool.cpp
+//		Deprojection.cpp -lpthread -o BlobTrackerBench
+//
+// Every frame the targets are predicted 50 ms ahead and compared, in pixels,
+// with where the discs really are 50 ms later, and the same with no
+// prediction. Returns 0 if no target changed identity and prediction helped.
+
+#include "BlobTracker.h"
+#include "Deprojection.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+
+static const int WIDTH = 640;
+static const int HEIGHT = 480;
+static const double FPS = 60.0;
+static const int FRAMES = 600;
+
+// Discs: 10 x 5 cells, radius in pixels, speed in pixels a second
+static const int COLUMNS = 10;
+static const int ROWS = 5;
+static const float RADIUS = 9.0f;
+static const float SPEED = 60.0f;
+
+// How far ahead targets are predicted, s
+static const double AHEAD = 0.05;
+
+// Frames left out at the start while targets are confirmed and settle
+static const int SETTLE = 60;
+
+struct Disc
+{
+	float x, y;			// pixels
+	float vx, vy;		// pixels a second
+	float left, top;	// of its cell
+};
+
+int
+main()
+{
+	const float cellWidth = (float)WIDTH / COLUMNS, cellHeight = (float)HEIGHT / ROWS;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<Disc> discs(COLUMNS * ROWS);
+	for (size_t i = 0; i < discs.size(); i++) {
+		Disc &d = discs[i];
+		d.left = (i % COLUMNS) * cellWidth;
+		d.top = (i / COLUMNS) * cellHeight;
+		d.x = d.left + cellWidth * 0.5f;
+		d.y = d.top + cellHeight * 0.5f;
+		float angle = uniform(random) * 6.2831853f;
+		d.vx = std::cos(angle) * SPEED;
+		d.vy = std::sin(angle) * SPEED;
+	}
+
+	DepthIntrinsics k = DepthIntrinsics::fromFieldOfView(WIDTH, HEIGHT, 70.0f);
+	std::vector<float> depth(WIDTH * HEIGHT), points(WIDTH * HEIGHT * 4);
+	ThreadPool pool;
+	BlobTracker tracker;
+	TrackerSettings settings;
+	settings.nearDepth = 500.0f;
+	settings.farDepth = 1500.0f;
+	settings.minPixels = 100;
+	settings.gate = 0.3f;
+	settings.maxTargets = 64;
+
+	// Pixel of a world point, the discs all being 1 m away
+	auto project = [&k](const float *p, float &x, float &y) {
+		float z = -p[2];
+		x = k.cx + p[0] / z * k.fx;
+		y = k.cy - p[1] / z * k.fy;
+	};
+
+	std::vector<Target> predicted, current;
+	std::map<size_t, std::map<int32_t, int> > idsOfDisc;
+	double blobMs = 0.0, trackMs = 0.0, predictedError = 0.0, currentError = 0.0;
+	int64_t compared = 0;
+	for (int f = 0; f < FRAMES; f++) {
+		std::fill(depth.begin(), depth.end(), 0.0f);
+		for (Disc &d : discs) {
+			d.x += d.vx / (float)FPS;
+			d.y += d.vy / (float)FPS;
+			if (d.x < d.left + RADIUS + 3.0f || d.x > d.left + cellWidth - RADIUS - 3.0f) d.vx = -d.vx;
+			if (d.y < d.top + RADIUS + 3.0f || d.y > d.top + cellHeight - RADIUS - 3.0f) d.vy = -d.vy;
+			for (int y = (int)(d.y - RADIUS); y <= (int)(d.y + RADIUS); y++)
+				for (int x = (int)(d.x - RADIUS); x <= (int)(d.x + RADIUS); x++)
+					if ((x - d.x) * (x - d.x) + (y - d.y) * (y - d.y) < RADIUS * RADIUS)
+						depth[y * WIDTH + x] = 1000.0f;
+		}
+		deprojectDepth(depth.data(), WIDTH, HEIGHT, k, points.data());
+		tracker.update(points.data(), points.data(), WIDTH, HEIGHT, f / FPS, settings, pool);
+		blobMs += tracker.blobMs;
+		trackMs += tracker.trackMs;
+		if (f < SETTLE) continue;
+
+		// Against each disc's position AHEAD from now; discs bounce rarely
+		// enough for a straight line to do
+		tracker.predict(AHEAD, predicted);
+		tracker.predict(0.0, current);
+		for (size_t slot = 0; slot < predicted.size(); slot++) {
+			if (!predicted[slot].present) continue;
+			float px, py, cx, cy;
+			project(predicted[slot].position, px, py);
+			project(current[slot].position, cx, cy);
+			size_t nearest = 0;
+			float nearestDistance = 1e9f;
+			for (size_t i = 0; i < discs.size(); i++) {
+				float tx = discs[i].x + discs[i].vx * (float)AHEAD, ty = discs[i].y + discs[i].vy * (float)AHEAD;
+				float distance = std::hypot(tx - px, ty - py);
+				if (distance < nearestDistance) {
+					nearestDistance = distance;
+					nearest = i;
+				}
+			}
+			const Disc &d = discs[nearest];
+			predictedError += nearestDistance;
+			currentError += std::hypot(d.x + d.vx * (float)AHEAD - cx, d.y + d.vy * (float)AHEAD - cy);
+			idsOfDisc[nearest][predicted[slot].id]++;
+			compared++;
+		}
+	}
+
+	int switches = 0;
+	for (const auto &ids : idsOfDisc)
+		switches += (int)ids.second.size() - 1;
+	double withPrediction = compared ? predictedError / compared : 0.0;
+	double withoutPrediction = compared ? currentError / compared : 0.0;
+	printf("%d discs, %d frames: %d blobs, %d targets, %.3f ms finding blobs and %.3f ms tracking a frame\n",
+		(int)discs.size(), FRAMES, (int)tracker.blobCount, (int)tracker.trackCount, blobMs / FRAMES, trackMs / FRAMES);
+	printf("%d identity switches; error %.0f ms ahead: %.2f px predicted, %.2f px without prediction\n", switches,
+		AHEAD * 1e3, withPrediction, withoutPrediction);
+
+	bool ok = switches == 0 && (int)idsOfDisc.size() == (int)discs.size() && withPrediction < withoutPrediction;
+	printf("%s\n", ok ? "Passed" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#include "CameraCalibration.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+CameraCalibration::CameraCalibration()
+{
+}
+
+bool
+CameraCalibration::load(const char *path)
+{
+	*this = CameraCalibration();
+
+	std::ifstream file(path ? path : "");
+	if (!file) return false;
+
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string key;
+		if (!(fields >> key) || key[0] == '#') continue;
+
+		if (key == "cameratoworld") {
+			double rows[4][4];
+			bool ok = true;
+			for (int i = 0; i < 16 && ok; i++)
+				ok = (bool)(fields >> rows[i / 4][i % 4]);
+			if (ok)
+				cameraToWorld = Matrix::fromRows(rows);
+			else
+				printf("Skipping malformed cameratoworld in %s\n", path);
+		}
+		else if (key == "intrinsics") {
+			DepthIntrinsics k;
+			if (fields >> k.fx >> k.fy >> k.cx >> k.cy && k.isValid())
+				intrinsics = k;
+			else
+				printf("Skipping malformed intrinsics in %s\n", path);
+		}
+		else {
+			printf("Skipping unknown calibration entry '%s'\n", key.c_str());
+		}
+	}
+
+	printf("Loaded calibration from %s\n", path);
+	return true;
+}
+
+bool
+CameraCalibration::save(const char *path) const
+{
+	std::ofstream file(path ? path : "");
+	if (!file) return false;
+
+	file.precision(9);
+	file << "# SenseTOP camera calibration\n";
+	file << "cameratoworld";
+	for (int r = 0; r < 4; r++)
+		for (int c = 0; c < 4; c++)
+			file << " " << cameraToWorld[c * 4 + r];
+	file << "\n";
+	if (intrinsics.isValid())
+		file << "intrinsics " << intrinsics.fx << " " << intrinsics.fy << " " << intrinsics.cx << " " << intrinsics.cy << "\n";
+	return (bool)file;
+}
@@ -0,0 +1,27 @@
+#ifndef CameraCalibration_h
+#define CameraCalibration_h
+
+#include "Matrix.h"
+#include "Deprojection.h"
+#include <string>
+
+// Where the camera sits in the world, loaded from a text file with one
+// entry per line and '#' comments:
+//   cameratoworld  16 numbers, row by row, translation in the last column
+//   intrinsics     fx fy cx cy, overriding what the source reports
+// Missing entries keep their defaults, identity and no override.
+class CameraCalibration
+{
+
+public:
+	CameraCalibration();
+
+	bool load(const char *path);
+	bool save(const char *path) const;
+
+	Matrix cameraToWorld;
+	DepthIntrinsics intrinsics;
+
+};
+
+#endif
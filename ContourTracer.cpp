@@ -0,0 +1,300 @@
+#include "ContourTracer.h"
+#include "Simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Segments of each marching squares case, as pairs of cell edges: from, to.
+// Corners are weighted top left 8, top right 4, bottom right 2, bottom left
+// 1, with y going down the mask. Segments keep the foreground on the same
+// side, so every crossed edge ends exactly one segment and starts another.
+// The two saddles keep diagonal pixels apart.
+enum { T, R, B, L, NONE };
+static const uint8_t SEGMENTS[16][4] = {
+	{ NONE, NONE, NONE, NONE },		// 0
+	{ L, B, NONE, NONE },			// 1
+	{ B, R, NONE, NONE },			// 2
+	{ L, R, NONE, NONE },			// 3
+	{ R, T, NONE, NONE },			// 4
+	{ R, T, L, B },					// 5
+	{ B, T, NONE, NONE },			// 6
+	{ L, T, NONE, NONE },			// 7
+	{ T, L, NONE, NONE },			// 8
+	{ T, B, NONE, NONE },			// 9
+	{ T, L, B, R },					// 10
+	{ T, R, NONE, NONE },			// 11
+	{ R, L, NONE, NONE },			// 12
+	{ R, B, NONE, NONE },			// 13
+	{ B, L, NONE, NONE },			// 14
+	{ NONE, NONE, NONE, NONE },		// 15
+};
+
+// Keeps the points of the chain first..last (indices into the n points,
+// wrapping) that are farther than tolerance from the line through their neighbours
+static void
+simplify(const float *points, int n, int first, int last, float tolerance, std::vector<uint8_t> &keep)
+{
+	std::vector<std::pair<int, int> > stack;
+	stack.push_back(std::make_pair(first, last));
+	while (!stack.empty()) {
+		int a = stack.back().first, b = stack.back().second;
+		stack.pop_back();
+		int span = (b - a + n) % n;
+		if (span < 2) continue;
+
+		float ax = points[2 * a], ay = points[2 * a + 1];
+		float dx = points[2 * b] - ax, dy = points[2 * b + 1] - ay;
+		float length = std::sqrt(dx * dx + dy * dy);
+		float farthest = -1.0f;
+		int split = -1;
+		for (int s = 1; s < span; s++) {
+			int i = (a + s) % n;
+			float px = points[2 * i] - ax, py = points[2 * i + 1] - ay;
+			float distance = length > 0.0f ? std::abs(px * dy - py * dx) / length : std::sqrt(px * px + py * py);
+			if (distance > farthest) {
+				farthest = distance;
+				split = i;
+			}
+		}
+		if (farthest <= tolerance) continue;
+		keep[split] = 1;
+		stack.push_back(std::make_pair(a, split));
+		stack.push_back(std::make_pair(split, b));
+	}
+}
+
+ContourTracer::ContourTracer(int width, int height)
+: m_width(width), m_height(height), m_maskWidth(width + 2), m_maskHeight(height + 2), m_sequence(0), m_busy(false),
+	m_worker(new ThreadPool(1))
+{
+	m_depth.resize(width * height);
+	m_mask.assign(m_maskWidth * m_maskHeight, 0);
+	m_next.resize(2 * m_maskWidth * m_maskHeight);
+}
+
+ContourTracer::~ContourTracer()
+{
+	// Let a frame in progress finish
+	m_worker.reset();
+}
+
+bool
+ContourTracer::submit(const float *depth, int64_t sequence, const ContourSettings &settings, ThreadPool &pool)
+{
+	if (m_busy) {
+		framesSkipped++;
+		return false;
+	}
+
+	memcpy(m_depth.data(), depth, m_depth.size() * sizeof(float));
+	m_sequence = sequence;
+	m_settings = settings;
+
+	m_busy = true;
+	m_worker->enqueue([this, &pool] { run(pool); });
+	return true;
+}
+
+const ContourSet&
+ContourTracer::latest()
+{
+	m_sets.update();
+	return m_sets.front();
+}
+
+// Frame rows begin..end into the mask, 1 where the depth is in range. The
+// border rows and columns are never written.
+void
+ContourTracer::buildMask(int begin, int end)
+{
+	const float nearDepth = m_settings.nearDepth, farDepth = m_settings.farDepth;
+	for (int y = begin; y < end; y++) {
+		const float *depth = m_depth.data() + (size_t)y * m_width;
+		uint8_t *mask = m_mask.data() + (size_t)(y + 1) * m_maskWidth + 1;
+		int x = 0;
+#ifdef SENSETOP_SSE2
+		const __m128 lo = _mm_set1_ps(nearDepth), hi = _mm_set1_ps(farDepth);
+		const __m128i one = _mm_set1_epi8(1);
+		for (; x + 16 <= m_width; x += 16) {
+			__m128i in[4];
+			for (int i = 0; i < 4; i++) {
+				__m128 d = _mm_loadu_ps(depth + x + 4 * i);
+				in[i] = _mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(d, lo), _mm_cmple_ps(d, hi)));
+			}
+			__m128i packed = _mm_packs_epi16(_mm_packs_epi32(in[0], in[1]), _mm_packs_epi32(in[2], in[3]));
+			_mm_storeu_si128((__m128i*)(mask + x), _mm_and_si128(packed, one));
+		}
+#endif
+		for (; x < m_width; x++)
+			mask[x] = depth[x] >= nearDepth && depth[x] <= farDepth;
+	}
+}
+
+// Marching squares over mask cell rows begin..end. Each cell's segments are
+// written to m_next by their first edge, which no other cell shares, so the
+// rows can run in parallel; the first edges are also collected in starts.
+void
+ContourTracer::findSegments(int begin, int end, std::vector<int32_t> &starts)
+{
+	const int w = m_maskWidth;
+	const int32_t vertical = m_maskWidth * m_maskHeight;
+	for (int y = begin; y < end; y++) {
+		const uint8_t *top = m_mask.data() + (size_t)y * w;
+		const uint8_t *bottom = top + w;
+		int x = 0;
+		while (x < w - 1) {
+#ifdef SENSETOP_SSE2
+			// Skip runs of 16 cells whose corners all match
+			if (x + 17 <= w) {
+				__m128i a = _mm_loadu_si128((const __m128i*)(top + x));
+				__m128i same = _mm_and_si128(
+					_mm_and_si128(_mm_cmpeq_epi8(a, _mm_loadu_si128((const __m128i*)(top + x + 1))),
+						_mm_cmpeq_epi8(a, _mm_loadu_si128((const __m128i*)(bottom + x)))),
+					_mm_cmpeq_epi8(a, _mm_loadu_si128((const __m128i*)(bottom + x + 1))));
+				if (_mm_movemask_epi8(same) == 0xFFFF) {
+					x += 16;
+					continue;
+				}
+			}
+#endif
+			int code = top[x] << 3 | top[x + 1] << 2 | bottom[x + 1] << 1 | bottom[x];
+			const uint8_t *segments = SEGMENTS[code];
+			for (int s = 0; s < 4 && segments[s] != NONE; s += 2) {
+				int32_t edges[2];
+				for (int e = 0; e < 2; e++) {
+					switch (segments[s + e]) {
+					case T: edges[e] = y * w + x; break;
+					case B: edges[e] = (y + 1) * w + x; break;
+					case L: edges[e] = vertical + y * w + x; break;
+					default: edges[e] = vertical + y * w + x + 1; break;
+					}
+				}
+				m_next[edges[0]] = edges[1];
+				starts.push_back(edges[0]);
+			}
+			x++;
+		}
+	}
+}
+
+// Where an edge's crossing is, in frame pixels: the middle of the edge
+void
+ContourTracer::point(int32_t edge, float &x, float &y) const
+{
+	const int32_t vertical = m_maskWidth * m_maskHeight;
+	bool v = edge >= vertical;
+	if (v) edge -= vertical;
+	x = (float)(edge % m_maskWidth) - (v ? 1.0f : 0.5f);
+	y = (float)(edge / m_maskWidth) - (v ? 0.5f : 1.0f);
+}
+
+void
+ContourTracer::run(ThreadPool &pool)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	pool.parallelFor(m_height, [this](int begin, int end) { buildMask(begin, end); }, 16);
+
+	m_starts.resize(pool.slices());
+	pool.parallelSlices(m_maskHeight - 1, [this](int slice, size_t begin, size_t end) {
+		m_starts[slice].clear();
+		findSegments((int)begin, (int)end, m_starts[slice]);
+	});
+
+	// Follow each loop once from whichever of its edges comes first,
+	// unlinking edges as they are used. Area by the shoelace formula, which
+	// comes out positive for outer edges with y up. Points of every loop go
+	// into one buffer, so loops that are dropped cost no allocations.
+	m_points.clear();
+	m_loops.clear();
+	for (const std::vector<int32_t> &starts : m_starts) {
+		for (int32_t first : starts) {
+			if (m_next[first] < 0) continue;
+			Loop loop = { m_points.size(), 0, 0.0f };
+			double area = 0.0;
+			int32_t edge = first;
+			float x, y;
+			point(first, x, y);
+			do {
+				m_points.push_back(x);
+				m_points.push_back(y);
+				int32_t next = m_next[edge];
+				m_next[edge] = -1;
+				edge = next;
+				float nx, ny;
+				point(edge, nx, ny);
+				area += (double)x * ny - (double)nx * y;
+				x = nx;
+				y = ny;
+			} while (edge != first);
+			loop.count = (int)((m_points.size() - loop.offset) / 2);
+			loop.area = (float)(0.5 * area);
+			m_loops.push_back(loop);
+		}
+	}
+	contoursFound = (int32_t)m_loops.size();
+
+	const float minArea = std::max(m_settings.minArea, 0.0f);
+	m_loops.erase(std::remove_if(m_loops.begin(), m_loops.end(),
+		[minArea](const Loop &l) { return std::abs(l.area) < minArea; }), m_loops.end());
+	std::sort(m_loops.begin(), m_loops.end(),
+		[](const Loop &a, const Loop &b) { return std::abs(a.area) > std::abs(b.area); });
+	if ((int)m_loops.size() > m_settings.maxContours)
+		m_loops.resize(std::max(m_settings.maxContours, 0));
+
+	// Douglas-Peucker on each loop, split at its first point and the point
+	// farthest from it
+	ContourSet &set = m_sets.back();
+	std::vector<Contour> &contours = set.contours;
+	contours.resize(m_loops.size());
+	const float tolerance = m_settings.tolerance;
+	pool.parallelFor((int)contours.size(), [&](int begin, int end) {
+		for (int c = begin; c < end; c++) {
+			const Loop &loop = m_loops[c];
+			const float *points = m_points.data() + loop.offset;
+			const int n = loop.count;
+			std::vector<uint8_t> keep(n, 0);
+			int farthest = 0;
+			float best = -1.0f;
+			for (int i = 1; i < n; i++) {
+				float dx = points[2 * i] - points[0], dy = points[2 * i + 1] - points[1];
+				if (dx * dx + dy * dy > best) {
+					best = dx * dx + dy * dy;
+					farthest = i;
+				}
+			}
+			keep[0] = keep[farthest] = 1;
+			simplify(points, n, 0, farthest, tolerance, keep);
+			simplify(points, n, farthest, 0, tolerance, keep);
+
+			Contour &contour = contours[c];
+			contour.area = loop.area;
+			contour.points.clear();
+			for (int i = 0; i < n; i++) {
+				if (!keep[i]) continue;
+				contour.points.push_back(points[2 * i]);
+				contour.points.push_back(points[2 * i + 1]);
+			}
+
+			char number[32];
+			contour.text.clear();
+			for (size_t i = 0; i < contour.points.size(); i++) {
+				snprintf(number, sizeof(number), i == 0 ? "%g" : " %g", contour.points[i]);
+				contour.text += number;
+			}
+		}
+	});
+
+	// Loops too small to keep a third point are no longer outlines
+	contours.erase(std::remove_if(contours.begin(), contours.end(),
+		[](const Contour &c) { return c.points.size() < 6; }), contours.end());
+
+	set.sequence = m_sequence;
+	m_sets.publish();
+
+	lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	framesTraced++;
+	m_busy = false;
+}
@@ -0,0 +1,113 @@
+#ifndef ContourTracer_h
+#define ContourTracer_h
+
+#include "ThreadPool.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ContourSettings
+{
+	float nearDepth = 200.0f;		// foreground depth range, mm
+	float farDepth = 1500.0f;
+	float tolerance = 1.5f;			// Douglas-Peucker tolerance, pixels
+	float minArea = 200.0f;			// smaller contours are dropped, pixels
+	int32_t maxContours = 16;		// largest ones kept
+
+	bool operator==(const ContourSettings &o) const
+	{
+		return nearDepth == o.nearDepth && farDepth == o.farDepth && tolerance == o.tolerance &&
+			minArea == o.minArea && maxContours == o.maxContours;
+	}
+	bool operator!=(const ContourSettings &o) const { return !(*this == o); }
+};
+
+// One closed outline, in depth pixels with the origin at the first pixel of
+// the frame (bottom left in TouchDesigner). Outer edges run
+// counterclockwise and the edges of holes clockwise.
+struct Contour
+{
+	std::vector<float> points;		// x, y pairs, the last joined to the first
+	float area;						// pixels, negative for holes
+	std::string text;				// points as "x y x y ...", for the Info DAT
+};
+
+struct ContourSet
+{
+	std::vector<Contour> contours;	// largest first
+	int64_t sequence = 0;
+};
+
+// Outlines of the pixels whose depth lies in a range, for outline effects.
+// submit() copies a depth frame and returns; a worker builds the mask,
+// runs marching squares over it on the given pool, links the crossings
+// into closed loops and simplifies them with Douglas-Peucker. Frames that
+// arrive while the worker is busy are skipped, and finished sets come back
+// through a triple buffer, so the cook only swaps an index to pick one up.
+class ContourTracer
+{
+
+public:
+	ContourTracer(int width, int height);
+	virtual ~ContourTracer();
+
+	// Cook thread. depth in mm. Returns false if the frame was skipped. The
+	// pool must outlive the tracer.
+	bool submit(const float *depth, int64_t sequence, const ContourSettings &settings, ThreadPool &pool);
+
+	// Cook thread. Moves to the newest set if there is one; the set stays
+	// valid until the next call.
+	const ContourSet& latest();
+	bool hasUpdate() const { return m_sets.hasUpdate(); }
+
+	// Telemetry
+	std::atomic<int64_t> framesTraced{ 0 };
+	std::atomic<int64_t> framesSkipped{ 0 };
+	std::atomic<int32_t> contoursFound{ 0 };	// before the area filter and limit
+	std::atomic<double> lastMs{ 0.0 };
+
+private:
+	void run(ThreadPool &pool);
+	void buildMask(int begin, int end);
+	void findSegments(int begin, int end, std::vector<int32_t> &starts);
+	void point(int32_t edge, float &x, float &y) const;
+
+	int m_width;
+	int m_height;
+
+	// Mask with a one pixel empty border, so every loop closes
+	int m_maskWidth;
+	int m_maskHeight;
+	std::vector<uint8_t> m_mask;
+
+	// Owned by the worker while m_busy is set
+	std::vector<float> m_depth;
+	int64_t m_sequence;
+	ContourSettings m_settings;
+
+	// For each crossed cell edge, the edge its segment leads to. Only edges
+	// crossed in the current frame are ever read, so it is never cleared.
+	std::vector<int32_t> m_next;
+	std::vector<std::vector<int32_t> > m_starts;
+
+	// Every loop of the frame, before the area filter
+	struct Loop
+	{
+		size_t offset;
+		int count;
+		float area;
+	};
+	std::vector<float> m_points;
+	std::vector<Loop> m_loops;
+
+	std::atomic<bool> m_busy;
+	TripleBuffer<ContourSet> m_sets;
+
+	std::unique_ptr<ThreadPool> m_worker;
+
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "Deprojection.h"
+#include "Simd.h"
+#include <cmath>
+
+DepthIntrinsics
+DepthIntrinsics::fromFieldOfView(int width, int height, float horizontalDegrees)
+{
+	DepthIntrinsics k;
+	k.fx = width / (2.0f * std::tan(horizontalDegrees * 0.5f * 3.14159265f / 180.0f));
+	k.fy = k.fx;
+	k.cx = width * 0.5f;
+	k.cy = height * 0.5f;
+	return k;
+}
+
+DepthIntrinsics
+DepthIntrinsics::halved() const
+{
+	DepthIntrinsics k;
+	k.fx = fx * 0.5f;
+	k.fy = fy * 0.5f;
+	k.cx = (cx + 0.5f) * 0.5f - 0.5f;
+	k.cy = (cy + 0.5f) * 0.5f - 0.5f;
+	return k;
+}
+
+void
+deprojectDepth(const float *depth, int width, int height, const DepthIntrinsics &intrinsics, float *points)
+{
+	const float invFx = 1.0f / intrinsics.fx;
+	const float invFy = 1.0f / intrinsics.fy;
+
+	for (int y = 0; y < height; y++) {
+		const float *row = depth + y * width;
+		float *out = points + (size_t)y * width * 4;
+		const float rayY = -(y - intrinsics.cy) * invFy;
+		int x = 0;
+
+#ifdef SENSETOP_SSE2
+		// Four pixels at a time, transposed from xxxx yyyy zzzz ww into
+		// four xyzw points
+		const __m128 scale = _mm_set1_ps(0.001f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 step = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		const __m128 vRayY = _mm_set1_ps(rayY);
+		for (; x + 4 <= width; x += 4, out += 16) {
+			__m128 d = _mm_mul_ps(_mm_loadu_ps(row + x), scale);
+			__m128 valid = _mm_cmpgt_ps(d, zero);
+			__m128 u = _mm_add_ps(_mm_set1_ps((float)x - intrinsics.cx), step);
+			__m128 px = _mm_mul_ps(_mm_mul_ps(u, _mm_set1_ps(invFx)), d);
+			__m128 py = _mm_mul_ps(vRayY, d);
+			__m128 pz = _mm_sub_ps(zero, d);
+			__m128 pw = _mm_and_ps(valid, one);
+			px = _mm_and_ps(valid, px);
+			py = _mm_and_ps(valid, py);
+			pz = _mm_and_ps(valid, pz);
+			_MM_TRANSPOSE4_PS(px, py, pz, pw);
+			_mm_storeu_ps(out, px);
+			_mm_storeu_ps(out + 4, py);
+			_mm_storeu_ps(out + 8, pz);
+			_mm_storeu_ps(out + 12, pw);
+		}
+#endif
+
+		for (; x < width; x++, out += 4) {
+			float d = row[x] * 0.001f;
+			if (d > 0.0f) {
+				out[0] = (x - intrinsics.cx) * invFx * d;
+				out[1] = rayY * d;
+				out[2] = -d;
+				out[3] = 1.0f;
+			}
+			else {
+				out[0] = out[1] = out[2] = out[3] = 0.0f;
+			}
+		}
+	}
+}
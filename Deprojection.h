@@ -0,0 +1,31 @@
+#ifndef Deprojection_h
+#define Deprojection_h
+
+#include <cstdint>
+
+// Pinhole model of the depth camera, in pixels
+struct DepthIntrinsics
+{
+	float fx = 0.0f;
+	float fy = 0.0f;
+	float cx = 0.0f;
+	float cy = 0.0f;
+
+	bool isValid() const { return fx > 0.0f && fy > 0.0f; }
+
+	// For the same view at half the resolution, each pixel the centre of a
+	// 2x2 block of these
+	DepthIntrinsics halved() const;
+
+	// Square pixels and a centred principal point, for sources that don't
+	// report their own
+	static DepthIntrinsics fromFieldOfView(int width, int height, float horizontalDegrees);
+};
+
+// Converts depth in millimetres to camera-space points in metres, 4 floats
+// per pixel. Camera space follows TouchDesigner's camera convention: x right,
+// y up, looking down -z. Pixels without depth get w = 0 and xyz = 0, the
+// rest w = 1, so a Matrix::transformPoints() leaves them at zero too.
+void deprojectDepth(const float *depth, int width, int height, const DepthIntrinsics &intrinsics, float *points);
+
+#endif
@@ -0,0 +1,190 @@
+#include "DepthCodec.h"
+#include "Simd.h"
+#include <cstring>
+
+namespace
+{
+
+// Number of leading zero pixels in p[0, n)
+inline size_t
+zeroRun(const uint16_t *p, size_t n)
+{
+	size_t i = 0;
+#ifdef SENSETOP_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+		uint32_t isZero = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero));
+		if (isZero != 0xFFFF)
+			return i + (lowestBit(~isZero & 0xFFFF) >> 1);
+	}
+#endif
+	while (i < n && p[i] == 0) i++;
+	return i;
+}
+
+// Number of leading non-zero pixels in p[0, n)
+inline size_t
+valueRun(const uint16_t *p, size_t n)
+{
+	size_t i = 0;
+#ifdef SENSETOP_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+		uint32_t isZero = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero));
+		if (isZero != 0)
+			return i + (lowestBit(isZero) >> 1);
+	}
+#endif
+	while (i < n && p[i] != 0) i++;
+	return i;
+}
+
+class NibbleWriter
+{
+public:
+	explicit NibbleWriter(uint8_t *out) : m_out(out), m_start(out), m_word(0), m_nibbles(0) {}
+
+	void put(uint32_t value)
+	{
+		do {
+			uint32_t nibble = value & 7;
+			value >>= 3;
+			if (value) nibble |= 8;
+			m_word = (m_word << 4) | nibble;
+			if (++m_nibbles == 8) flush();
+		} while (value);
+	}
+
+	size_t finish()
+	{
+		if (m_nibbles) {
+			m_word <<= 4 * (8 - m_nibbles);
+			flush();
+		}
+		return m_out - m_start;
+	}
+
+private:
+	void flush()
+	{
+		memcpy(m_out, &m_word, sizeof(m_word));
+		m_out += sizeof(m_word);
+		m_word = 0;
+		m_nibbles = 0;
+	}
+
+	uint8_t *m_out;
+	uint8_t *m_start;
+	uint32_t m_word;
+	int m_nibbles;
+};
+
+class NibbleReader
+{
+public:
+	NibbleReader(const uint8_t *in, size_t size) : m_in(in), m_end(in + size), m_word(0), m_nibbles(0), m_ok(true) {}
+
+	uint32_t get()
+	{
+		uint32_t value = 0;
+		int shift = 0;
+		uint32_t nibble;
+		do {
+			if (shift > 30) {
+				m_ok = false;
+				return 0;
+			}
+			if (!m_nibbles) {
+				if (m_end - m_in < (ptrdiff_t)sizeof(m_word)) {
+					m_ok = false;
+					return 0;
+				}
+				memcpy(&m_word, m_in, sizeof(m_word));
+				m_in += sizeof(m_word);
+				m_nibbles = 8;
+			}
+			nibble = m_word >> 28;
+			m_word <<= 4;
+			m_nibbles--;
+			value |= (nibble & 7) << shift;
+			shift += 3;
+		} while (nibble & 8);
+		return value;
+	}
+
+	bool ok() const { return m_ok; }
+
+private:
+	const uint8_t *m_in;
+	const uint8_t *m_end;
+	uint32_t m_word;
+	int m_nibbles;
+	bool m_ok;
+};
+
+}
+
+size_t
+DepthCodec::maxEncodedSize(size_t numPixels)
+{
+	// Worst case is alternating zero and non-zero pixels: two one-nibble
+	// run lengths and a six-nibble delta for every pair, i.e. four bytes per
+	// pixel, plus the trailing partial word
+	return numPixels * 4 + 8;
+}
+
+size_t
+DepthCodec::encode(const uint16_t *input, size_t numPixels, uint8_t *output)
+{
+	NibbleWriter writer(output);
+	int32_t previous = 0;
+	size_t i = 0;
+
+	while (i < numPixels) {
+		size_t zeros = zeroRun(input + i, numPixels - i);
+		writer.put((uint32_t)zeros);
+		i += zeros;
+
+		size_t values = valueRun(input + i, numPixels - i);
+		writer.put((uint32_t)values);
+
+		for (size_t end = i + values; i < end; i++) {
+			int32_t current = input[i];
+			int32_t delta = current - previous;
+			writer.put(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+			previous = current;
+		}
+	}
+
+	return writer.finish();
+}
+
+bool
+DepthCodec::decode(const uint8_t *input, size_t inputSize, uint16_t *output, size_t numPixels)
+{
+	NibbleReader reader(input, inputSize);
+	int32_t previous = 0;
+	size_t i = 0;
+
+	while (i < numPixels) {
+		uint32_t zeros = reader.get();
+		if (!reader.ok() || zeros > numPixels - i) return false;
+		memset(output + i, 0, zeros * sizeof(uint16_t));
+		i += zeros;
+
+		uint32_t values = reader.get();
+		if (!reader.ok() || values > numPixels - i) return false;
+
+		for (size_t end = i + values; i < end; i++) {
+			uint32_t positive = reader.get();
+			int32_t delta = (int32_t)(positive >> 1) ^ -(int32_t)(positive & 1);
+			previous += delta;
+			output[i] = (uint16_t)previous;
+		}
+		if (!reader.ok()) return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,30 @@
+#ifndef DepthCodec_h
+#define DepthCodec_h
+
+#include <cstdint>
+#include <cstddef>
+
+// Lossless codec for 16-bit depth images, after Wilson's RVL
+// ("Fast Lossless Depth Image Compression", ISS 2017).
+// Pixels are coded as alternating runs of zeros (invalid depth) and
+// non-zero values; non-zero values are stored as zigzag deltas from the
+// previous valid pixel. Run lengths and deltas use a variable-length code of
+// 4-bit nibbles (3 data bits and a continuation bit), packed into 32-bit words.
+class DepthCodec
+{
+
+public:
+	// Largest possible encoded size for numPixels pixels, in bytes
+	static size_t maxEncodedSize(size_t numPixels);
+
+	// Encodes numPixels values into output, which must hold
+	// maxEncodedSize(numPixels) bytes. Returns the encoded size in bytes.
+	static size_t encode(const uint16_t *input, size_t numPixels, uint8_t *output);
+
+	// Decodes exactly numPixels values. Returns false if the input is
+	// truncated or corrupt.
+	static bool decode(const uint8_t *input, size_t inputSize, uint16_t *output, size_t numPixels);
+
+};
+
+#endif
@@ -0,0 +1,320 @@
+// Compression ratio and speed of DepthCodec against general-purpose
+// baselines, and a round trip through DepthRecorder and DepthRecordingReader.
+// Not part of the plugin; build it on its own:
+//
+//	g++ -O2 -std=c++14 DepthCodecBench.cpp DepthCodec.cpp DepthRecorder.cpp
+//		ThreadPool.cpp SyntheticDepthSource.cpp Deprojection.cpp
+//		DepthPyramid.cpp -lpthread -o DepthCodecBench
+//
+//	DepthCodecBench [recording.sdr]
+//
+// Frames come from a recording when one is given, or else from the
+// synthetic scene, both as rendered and with sensor noise added. Each is
+// encoded and decoded on one thread and checked to be lossless, by
+// DepthCodec and by each baseline: a plain copy, delta coding with run
+// lengths, and zstd and LZ4 when the bench is built with them (add
+// -DWITH_ZSTD -lzstd and -DWITH_LZ4 -llz4; they are skipped if their
+// headers aren't installed). The frames are then recorded to a temporary
+// file with four encoder threads, read back and compared. Returns 0 if every
+// check passes.
+
+#include "DepthCodec.h"
+#include "DepthRecorder.h"
+#include "SyntheticDepthSource.h"
+#include "SteadyClock.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <thread>
+
+#if defined(WITH_ZSTD) && __has_include(<zstd.h>)
+	#include <zstd.h>
+	#define HAVE_ZSTD
+#endif
+#if defined(WITH_LZ4) && __has_include(<lz4.h>)
+	#include <lz4.h>
+	#define HAVE_LZ4
+#endif
+
+static const int SYNTHETIC_WIDTH = 640;
+static const int SYNTHETIC_HEIGHT = 480;
+static const int SYNTHETIC_FRAMES = 120;
+
+// Each frame is coded this many times, for steadier timings
+static const int REPEATS = 10;
+
+// Sensor noise added to the synthetic scene: standard deviation at 1 m, mm,
+// and the share of pixels that lose their depth
+static const float NOISE_AT_1M = 1.5f;
+static const float DROPOUT = 0.02f;
+
+// An encoder and decoder to compare. encode returns the encoded size, 0 on
+// failure, into output of at most capacity bytes.
+struct Codec
+{
+	const char *name;
+	std::function<size_t(const uint16_t *input, size_t pixels, uint8_t *output, size_t capacity)> encode;
+	std::function<bool(const uint8_t *input, size_t size, uint16_t *output, size_t pixels)> decode;
+};
+
+static uint8_t*
+putVarint(uint8_t *out, uint32_t value)
+{
+	while (value >= 0x80) {
+		*out++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (uint8_t)value;
+	return out;
+}
+
+static bool
+getVarint(const uint8_t *&in, const uint8_t *end, uint32_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 35 && in < end; shift += 7) {
+		uint8_t byte = *in++;
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+// A generic baseline: the difference from the previous pixel, with runs of
+// equal differences stored once as a varint count and a zigzag varint value
+static size_t
+deltaRleEncode(const uint16_t *input, size_t pixels, uint8_t *output, size_t capacity)
+{
+	if (capacity < pixels * 10) return 0;
+	uint8_t *out = output;
+	uint16_t previous = 0;
+	for (size_t i = 0; i < pixels; ) {
+		int16_t delta = (int16_t)(input[i] - previous);
+		size_t run = 1;
+		previous = input[i];
+		while (i + run < pixels && (int16_t)(input[i + run] - previous) == delta) {
+			previous = input[i + run];
+			run++;
+		}
+		out = putVarint(out, (uint32_t)run);
+		out = putVarint(out, (uint32_t)(((int32_t)delta << 1) ^ ((int32_t)delta >> 31)));
+		i += run;
+	}
+	return out - output;
+}
+
+static bool
+deltaRleDecode(const uint8_t *input, size_t size, uint16_t *output, size_t pixels)
+{
+	const uint8_t *in = input, *end = input + size;
+	uint16_t previous = 0;
+	for (size_t i = 0; i < pixels; ) {
+		uint32_t run, zigzag;
+		if (!getVarint(in, end, run) || !getVarint(in, end, zigzag)) return false;
+		if (run == 0 || run > pixels - i) return false;
+		int16_t delta = (int16_t)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+		for (uint32_t j = 0; j < run; j++)
+			output[i++] = previous = (uint16_t)(previous + delta);
+	}
+	return in == end;
+}
+
+// DepthCodec and the baselines built in
+static std::vector<Codec>
+allCodecs()
+{
+	std::vector<Codec> codecs;
+	codecs.push_back({ "DepthCodec",
+		[](const uint16_t *input, size_t count, uint8_t *output, size_t) { return DepthCodec::encode(input, count, output); },
+		DepthCodec::decode });
+	codecs.push_back({ "copy",
+		[](const uint16_t *input, size_t count, uint8_t *output, size_t) {
+			memcpy(output, input, count * sizeof(uint16_t));
+			return count * sizeof(uint16_t);
+		},
+		[](const uint8_t *input, size_t size, uint16_t *output, size_t count) {
+			if (size != count * sizeof(uint16_t)) return false;
+			memcpy(output, input, size);
+			return true;
+		} });
+	codecs.push_back({ "delta+RLE", deltaRleEncode, deltaRleDecode });
+#ifdef HAVE_ZSTD
+	codecs.push_back({ "zstd -1",
+		[](const uint16_t *input, size_t count, uint8_t *output, size_t capacity) {
+			size_t size = ZSTD_compress(output, capacity, input, count * sizeof(uint16_t), 1);
+			return ZSTD_isError(size) ? 0 : size;
+		},
+		[](const uint8_t *input, size_t size, uint16_t *output, size_t count) {
+			size_t decoded = ZSTD_decompress(output, count * sizeof(uint16_t), input, size);
+			return !ZSTD_isError(decoded) && decoded == count * sizeof(uint16_t);
+		} });
+#endif
+#ifdef HAVE_LZ4
+	codecs.push_back({ "LZ4",
+		[](const uint16_t *input, size_t count, uint8_t *output, size_t capacity) {
+			int size = LZ4_compress_default((const char*)input, (char*)output, (int)(count * sizeof(uint16_t)), (int)capacity);
+			return (size_t)(size > 0 ? size : 0);
+		},
+		[](const uint8_t *input, size_t size, uint16_t *output, size_t count) {
+			int bytes = (int)(count * sizeof(uint16_t));
+			return LZ4_decompress_safe((const char*)input, (char*)output, (int)size, bytes) == bytes;
+		} });
+#endif
+	return codecs;
+}
+
+// Codes every frame with each codec in turn; returns how many frames were
+// not lossless
+static int
+compareCodecs(const char *label, const std::vector<std::vector<uint16_t> > &frames, int width, int height)
+{
+	// Every baseline fits in ten bytes a pixel
+	size_t pixels = (size_t)width * height;
+	std::vector<uint8_t> encoded(std::max(DepthCodec::maxEncodedSize(pixels), pixels * 10));
+	std::vector<uint16_t> decoded(pixels);
+	printf("%s, %zu frames of %d x %d, on one thread:\n", label, frames.size(), width, height);
+	int mismatched = 0;
+	for (const Codec &codec : allCodecs()) {
+		double encodeSeconds = 0.0, decodeSeconds = 0.0;
+		size_t rawBytes = 0, encodedBytes = 0;
+		int codecMismatched = 0;
+		for (const std::vector<uint16_t> &frame : frames) {
+			std::fill(decoded.begin(), decoded.end(), 0);
+			size_t size = 0;
+			double start = steadySeconds();
+			for (int r = 0; r < REPEATS; r++)
+				size = codec.encode(frame.data(), pixels, encoded.data(), encoded.size());
+			double encodedAt = steadySeconds();
+			bool ok = size > 0;
+			for (int r = 0; r < REPEATS && ok; r++)
+				ok = codec.decode(encoded.data(), size, decoded.data(), pixels);
+			decodeSeconds += steadySeconds() - encodedAt;
+			encodeSeconds += encodedAt - start;
+			if (!ok || decoded != frame) codecMismatched++;
+			rawBytes += pixels * sizeof(uint16_t);
+			encodedBytes += size;
+		}
+		double megabytes = rawBytes * (double)REPEATS / 1e6;
+		printf("  %-10s %6.2f:1, encode %6.0f MB/s, decode %6.0f MB/s, %d not lossless\n", codec.name,
+			encodedBytes ? (double)rawBytes / encodedBytes : 0.0, megabytes / encodeSeconds, megabytes / decodeSeconds,
+			codecMismatched);
+		mismatched += codecMismatched;
+	}
+	return mismatched;
+}
+
+// Adds the kind of noise a structured-light sensor has: jitter growing with
+// the square of the distance, and scattered pixels with no depth
+static void
+addSensorNoise(std::vector<uint16_t> &frame, std::mt19937 &random)
+{
+	std::normal_distribution<float> jitter(0.0f, 1.0f);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	for (uint16_t &depth : frame) {
+		if (depth == 0) continue;
+		if (uniform(random) < DROPOUT) {
+			depth = 0;
+			continue;
+		}
+		float metres = depth * 0.001f;
+		float noisy = depth + jitter(random) * (NOISE_AT_1M * metres * metres);
+		depth = (uint16_t)std::max(1.0f, std::min(65535.0f, std::round(noisy)));
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	// Frames to code, as the sensor's 16-bit depth
+	std::vector<std::vector<uint16_t> > frames;
+	int width = SYNTHETIC_WIDTH, height = SYNTHETIC_HEIGHT;
+	int mismatched = 0;
+	if (argc > 1) {
+		DepthRecordingReader reader;
+		if (!reader.open(argv[1])) {
+			fprintf(stderr, "Could not read %s\n", argv[1]);
+			return 1;
+		}
+		width = reader.width();
+		height = reader.height();
+		DepthFrame frame;
+		while (reader.read(frame))
+			frames.emplace_back(frame.depth.begin(), frame.depth.end());
+		if (frames.empty()) {
+			fprintf(stderr, "No frames\n");
+			return 1;
+		}
+		mismatched += compareCodecs(argv[1], frames, width, height);
+	}
+	else {
+		// The synthetic scene is made of smooth surfaces, which flatters
+		// generic coders, so it is also coded with sensor noise added. The
+		// noisy frames go on to the recorder.
+		SyntheticDepthSource scene(width, height, 30.0);
+		frames.resize(SYNTHETIC_FRAMES);
+		for (int i = 0; i < SYNTHETIC_FRAMES; i++)
+			scene.render(i, frames[i]);
+		mismatched += compareCodecs("Synthetic scene", frames, width, height);
+		std::mt19937 random(1);
+		for (std::vector<uint16_t> &frame : frames)
+			addSensorNoise(frame, random);
+		mismatched += compareCodecs("With sensor noise", frames, width, height);
+	}
+#ifndef HAVE_ZSTD
+	printf("zstd not built in\n");
+#endif
+#ifndef HAVE_LZ4
+	printf("LZ4 not built in\n");
+#endif
+	size_t pixels = (size_t)width * height;
+	std::vector<uint8_t> encoded(DepthCodec::maxEncodedSize(pixels));
+	std::vector<uint16_t> decoded(pixels);
+
+	// A truncated frame has to be rejected, not read past
+	size_t size = DepthCodec::encode(frames[0].data(), pixels, encoded.data());
+	bool truncatedRejected = !DepthCodec::decode(encoded.data(), size / 2, decoded.data(), pixels);
+	printf("Truncated frame %s\n", truncatedRejected ? "rejected" : "ACCEPTED");
+
+	// Through the recorder and back. Frames are pushed at 60 fps, as the
+	// capture thread would.
+	const char *path = "DepthCodecBench.sdr";
+	DepthRecorder recorder;
+	if (!recorder.start(path, width, height, 4)) {
+		fprintf(stderr, "Could not write %s\n", path);
+		return 1;
+	}
+	int pushed = 0;
+	for (size_t i = 0; i < frames.size(); i++) {
+		if (recorder.push(frames[i].data(), width * sizeof(uint16_t), (int64_t)i, (int64_t)(i * 1e7 / 60.0), i / 60.0))
+			pushed++;
+		std::this_thread::sleep_for(std::chrono::microseconds(16667));
+	}
+	recorder.stop();
+
+	DepthRecordingReader reader;
+	int read = 0, recordMismatched = 0;
+	if (reader.open(path)) {
+		DepthFrame frame;
+		while (reader.read(frame)) {
+			const std::vector<uint16_t> &expected = frames[frame.sequence % frames.size()];
+			for (size_t i = 0; i < pixels; i++) {
+				if (frame.depth[i] != (float)expected[i]) {
+					recordMismatched++;
+					break;
+				}
+			}
+			read++;
+		}
+		reader.close();
+	}
+	remove(path);
+	printf("Recorded %d of %zu frames (%lld dropped), read back %d, %d not lossless\n", pushed, frames.size(),
+		(long long)recorder.framesDropped, read, recordMismatched);
+
+	bool ok = mismatched == 0 && truncatedRejected && read == pushed && recordMismatched == 0;
+	printf("%s\n", ok ? "Passed" : "FAILED");
+	return ok ? 0 : 1;
+}
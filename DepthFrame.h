@@ -0,0 +1,34 @@
+#ifndef DepthFrame_h
+#define DepthFrame_h
+
+#include "DepthPyramid.h"
+#include <cstdint>
+#include <vector>
+
+// One depth frame as handed from the capture thread to the cook
+struct DepthFrame
+{
+	// Monotonically increasing, assigned by the capture thread
+	int64_t sequence = -1;
+
+	// Device timestamp in 100ns units, as reported by PXCImage::QueryTimeStamp()
+	int64_t deviceTime = 0;
+
+	// Capture time on the host's steady clock, in seconds. Derived from the
+	// device timestamp so it is free of USB and scheduling jitter.
+	double time = 0.0;
+
+	int32_t width = 0;
+	int32_t height = 0;
+	std::vector<float> depth;
+
+	// Min/max pyramid of depth, built by the capture thread only when
+	// something in the cook queries it
+	DepthPyramid pyramid;
+
+	// Depth mapped to 0-1 by the automatic range, while it is on
+	std::vector<float> normalized;
+	bool hasNormalized = false;
+};
+
+#endif
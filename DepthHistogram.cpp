@@ -0,0 +1,154 @@
+#include "DepthHistogram.h"
+#include "Simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+const float DepthHistogram::BIN_MM = 8.0f;
+
+// Bins per lane, the last one for pixels without depth
+static const int SET = DepthHistogram::BINS + 1;
+
+DepthHistogram::DepthHistogram()
+: m_near(0.0f), m_far(0.0f), m_hasRange(false)
+{
+	m_bins.resize(BINS);
+}
+
+DepthHistogram::~DepthHistogram()
+{
+}
+
+void
+DepthHistogram::convertRows(const float *depth, int32_t pitch, int width, int begin, int end, float *out, float *normalized,
+	uint32_t *bins) const
+{
+	memset(bins, 0, 4 * SET * sizeof(uint32_t));
+	const float offset = m_near;
+	const float scale = m_far - m_near >= 1.0f ? 1.0f / (m_far - m_near) : 1.0f;
+	for (int y = begin; y < end; y++) {
+		const float *row = (const float*)((const uint8_t*)depth + (size_t)y * pitch);
+		float *outRow = out + (size_t)y * width;
+		float *normalizedRow = normalized ? normalized + (size_t)y * width : nullptr;
+		int x = 0;
+#ifdef SENSETOP_SSE2
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		const __m128 toBin = _mm_set1_ps(1.0f / BIN_MM), lastBin = _mm_set1_ps((float)(BINS - 1));
+		const __m128 start = _mm_set1_ps(offset), range = _mm_set1_ps(scale);
+		const __m128i empty = _mm_set1_epi32(BINS);
+		alignas(16) int32_t index[4];
+		for (; x + 4 <= width; x += 4) {
+			__m128 d = _mm_loadu_ps(row + x);
+			_mm_storeu_ps(outRow + x, d);
+
+			__m128 has = _mm_cmpgt_ps(d, zero);
+			if (normalizedRow) {
+				__m128 n = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(d, start), range), zero), one);
+				_mm_storeu_ps(normalizedRow + x, _mm_and_ps(has, n));
+			}
+
+			__m128i bin = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(d, toBin), lastBin));
+			__m128i valid = _mm_castps_si128(has);
+			bin = _mm_or_si128(_mm_and_si128(valid, bin), _mm_andnot_si128(valid, empty));
+			_mm_store_si128((__m128i*)index, bin);
+			bins[index[0]]++;
+			bins[SET + index[1]]++;
+			bins[2 * SET + index[2]]++;
+			bins[3 * SET + index[3]]++;
+		}
+#endif
+		for (; x < width; x++) {
+			float d = row[x];
+			outRow[x] = d;
+			bool has = d > 0.0f;
+			if (normalizedRow)
+				normalizedRow[x] = has ? std::min(std::max((d - offset) * scale, 0.0f), 1.0f) : 0.0f;
+			bins[has ? (int)std::min(d * (1.0f / BIN_MM), (float)(BINS - 1)) : BINS]++;
+		}
+	}
+}
+
+// Depth below which fraction of the counted pixels lie, interpolated
+// within its bin
+double
+DepthHistogram::percentile(double fraction, uint32_t total) const
+{
+	double target = fraction * total;
+	double below = 0.0;
+	for (int b = 0; b < BINS; b++) {
+		if (m_bins[b] > 0 && below + m_bins[b] >= target)
+			return (b + (target - below) / m_bins[b]) * BIN_MM;
+		below += m_bins[b];
+	}
+	return BINS * BIN_MM;
+}
+
+void
+DepthHistogram::convert(const float *depth, int32_t pitch, int width, int height, float *out, float *normalized, ThreadPool &pool)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	if (m_partials.size() != (size_t)pool.slices()) {
+		m_partials.resize(pool.slices());
+		for (std::vector<uint32_t> &partial : m_partials)
+			partial.resize(4 * SET);
+	}
+
+	pool.parallelSlices(height, [&](int slice, size_t begin, size_t end) {
+		convertRows(depth, pitch, width, (int)begin, (int)end, out, normalized, m_partials[slice].data());
+	});
+
+	uint32_t total = 0;
+	for (int b = 0; b < BINS; b++) {
+		uint32_t count = 0;
+		for (const std::vector<uint32_t> &partial : m_partials)
+			count += partial[b] + partial[SET + b] + partial[2 * SET + b] + partial[3 * SET + b];
+		m_bins[b] = count;
+		total += count;
+	}
+
+	// A frame without depth leaves the range where it was
+	if (total > 0) {
+		float lowFraction = std::min(std::max(lowPercentile.load(), 0.0f), 100.0f) * 0.01f;
+		float highFraction = std::min(std::max(highPercentile.load(), 0.0f), 100.0f) * 0.01f;
+		float lowDepth = (float)percentile(std::min(lowFraction, highFraction), total);
+		float highDepth = std::max((float)percentile(std::max(lowFraction, highFraction), total), lowDepth + BIN_MM);
+		low = lowDepth;
+		high = highDepth;
+		median = percentile(0.5, total);
+
+		float keep = std::min(std::max(smoothing.load(), 0.0f), 0.999f);
+		if (m_hasRange) {
+			m_near = keep * m_near + (1.0f - keep) * lowDepth;
+			m_far = keep * m_far + (1.0f - keep) * highDepth;
+		}
+		else {
+			m_near = lowDepth;
+			m_far = highDepth;
+			m_hasRange = true;
+		}
+		nearDepth = m_near;
+		farDepth = m_far;
+	}
+
+	lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void
+DepthHistogram::normalize(const float *depth, float *out, size_t count) const
+{
+	const float offset = m_near;
+	const float scale = m_far - m_near >= 1.0f ? 1.0f / (m_far - m_near) : 1.0f;
+	size_t i = 0;
+#ifdef SENSETOP_SSE2
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 start = _mm_set1_ps(offset), range = _mm_set1_ps(scale);
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(depth + i);
+		__m128 n = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(d, start), range), zero), one);
+		_mm_storeu_ps(out + i, _mm_and_ps(_mm_cmpgt_ps(d, zero), n));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = depth[i] > 0.0f ? std::min(std::max((depth[i] - offset) * scale, 0.0f), 1.0f) : 0.0f;
+}
@@ -0,0 +1,74 @@
+#ifndef DepthHistogram_h
+#define DepthHistogram_h
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Histogram of depth, counted while frames are copied out of the source,
+// and the automatic near/far range it drives.
+// convert() copies a frame in row slices across a pool. Each slice works
+// out bin indices four at a time with SSE2 and counts them into its own
+// bins, one set per SIMD lane so neighbouring pixels in the same bin don't
+// wait on each other, and the sets are summed at the end. The same pass
+// can write the frame mapped to 0-1 through the current range. Percentiles
+// of the merged histogram then move the range, smoothed over time, for the
+// next frame. Capture thread only, apart from the settings and telemetry.
+class DepthHistogram
+{
+
+public:
+	static const int BINS = 1024;
+	static const float BIN_MM;
+
+	DepthHistogram();
+	virtual ~DepthHistogram();
+
+	// Copies width * height depth from rows pitch bytes apart into out, and
+	// into normalized if it isn't null, then updates the range
+	void convert(const float *depth, int32_t pitch, int width, int height, float *out, float *normalized, ThreadPool &pool);
+
+	// Maps count depths through the range used by the last convert()
+	void normalize(const float *depth, float *out, size_t count) const;
+
+	// Forgets the range, so the next frame sets it outright
+	void reset() { m_hasRange = false; }
+
+	// Bins of the last frame, BIN_MM wide from 0; the last one also holds
+	// everything beyond it
+	const std::vector<uint32_t>& bins() const { return m_bins; }
+
+	// Set by the cook. Percentiles, 0-100, of the pixels with depth that
+	// map to 0 and 1, and how much of the old range is kept each frame.
+	std::atomic<float> lowPercentile{ 2.0f };
+	std::atomic<float> highPercentile{ 98.0f };
+	std::atomic<float> smoothing{ 0.9f };
+
+	// Telemetry, in mm: the last frame's percentiles and median, and the
+	// smoothed range
+	std::atomic<double> low{ 0.0 };
+	std::atomic<double> high{ 0.0 };
+	std::atomic<double> median{ 0.0 };
+	std::atomic<double> nearDepth{ 0.0 };
+	std::atomic<double> farDepth{ 0.0 };
+	std::atomic<double> lastMs{ 0.0 };
+
+private:
+	void convertRows(const float *depth, int32_t pitch, int width, int begin, int end, float *out, float *normalized,
+		uint32_t *bins) const;
+	double percentile(double fraction, uint32_t total) const;
+
+	// Per slice, one set of BINS + 1 per lane; the extra bin takes pixels
+	// without depth
+	std::vector<std::vector<uint32_t> > m_partials;
+	std::vector<uint32_t> m_bins;
+
+	// Range used by the last convert()
+	float m_near;
+	float m_far;
+	bool m_hasRange;
+
+};
+
+#endif
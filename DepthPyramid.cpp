@@ -0,0 +1,299 @@
+#include "DepthPyramid.h"
+#include "Simd.h"
+#include <algorithm>
+#include <limits>
+
+// Nearest depths are reduced with missing depth as infinity, so min()
+// skips it, and turned back into 0 when stored
+static const float NO_DEPTH = std::numeric_limits<float>::infinity();
+
+static inline float
+nearestOf(float d)
+{
+	return d > 0.0f ? d : NO_DEPTH;
+}
+
+#ifdef SENSETOP_SSE2
+// Zeros, and the negative marks of unfilled holes, to infinity in every lane
+static inline __m128
+noDepthToInf(__m128 v)
+{
+	__m128 none = _mm_cmple_ps(v, _mm_setzero_ps());
+	return _mm_or_ps(_mm_and_ps(none, _mm_set1_ps(NO_DEPTH)), _mm_andnot_ps(none, v));
+}
+
+// Zeros to infinity in the nearest lanes of interleaved pairs only
+static inline __m128
+noNearestToInf(__m128 v)
+{
+	return _mm_or_ps(v, _mm_and_ps(_mm_cmpeq_ps(v, _mm_setzero_ps()), _mm_setr_ps(NO_DEPTH, 0.0f, NO_DEPTH, 0.0f)));
+}
+
+static inline __m128
+infToNoDepth(__m128 v)
+{
+	return _mm_andnot_ps(_mm_cmpeq_ps(v, _mm_set1_ps(NO_DEPTH)), v);
+}
+
+// Interleaved pairs: min of the nearest lanes, max of the farthest
+static inline __m128
+combinePairs(__m128 a, __m128 b)
+{
+	__m128 nearLanes = _mm_castsi128_ps(_mm_setr_epi32(-1, 0, -1, 0));
+	return _mm_or_ps(_mm_and_ps(nearLanes, _mm_min_ps(a, b)), _mm_andnot_ps(nearLanes, _mm_max_ps(a, b)));
+}
+#endif
+
+DepthPyramid::DepthPyramid()
+: m_depth(nullptr)
+{
+}
+
+DepthPyramid::~DepthPyramid()
+{
+}
+
+void
+DepthPyramid::copy(const DepthPyramid &source, const float *depth)
+{
+	m_sizes = source.m_sizes;
+	m_levels = source.m_levels;
+	m_depth = depth;
+}
+
+void
+DepthPyramid::build(const float *depth, int width, int height)
+{
+	if (m_sizes.empty() || m_sizes[0].width != width || m_sizes[0].height != height) {
+		m_sizes.clear();
+		m_sizes.push_back({ width, height, 0 });
+		size_t offset = 0;
+		int w = width, h = height;
+		while (w > 1 || h > 1) {
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+			m_sizes.push_back({ w, h, offset });
+			offset += (size_t)w * h * 2;
+		}
+		m_levels.resize(offset);
+	}
+	m_depth = depth;
+	if (levels() < 2) return;
+
+	// Level 1 from the frame. An odd last column or row is paired with
+	// itself.
+	{
+		const int sw = width, sh = height;
+		const int w = m_sizes[1].width, h = m_sizes[1].height;
+		const int pairs = sw / 2;
+		float *out = m_levels.data();
+		for (int y = 0; y < h; y++) {
+			const float *a = depth + (size_t)(2 * y) * sw;
+			const float *b = 2 * y + 1 < sh ? a + sw : a;
+			float *row = out + (size_t)y * w * 2;
+			int x = 0;
+#ifdef SENSETOP_SSE2
+			// Four output texels from 2x8 pixels: vertical min/max, then
+			// the even and odd columns against each other
+			for (; x + 4 <= pairs; x += 4) {
+				__m128 a0 = _mm_loadu_ps(a + 2 * x), a1 = _mm_loadu_ps(a + 2 * x + 4);
+				__m128 b0 = _mm_loadu_ps(b + 2 * x), b1 = _mm_loadu_ps(b + 2 * x + 4);
+				__m128 n0 = _mm_min_ps(noDepthToInf(a0), noDepthToInf(b0));
+				__m128 n1 = _mm_min_ps(noDepthToInf(a1), noDepthToInf(b1));
+				__m128 f0 = _mm_max_ps(a0, b0), f1 = _mm_max_ps(a1, b1);
+				__m128 n = _mm_min_ps(_mm_shuffle_ps(n0, n1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(n0, n1, _MM_SHUFFLE(3, 1, 3, 1)));
+				__m128 f = _mm_max_ps(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1)));
+				n = infToNoDepth(n);
+				f = _mm_max_ps(f, _mm_setzero_ps());
+				_mm_storeu_ps(row + 2 * x, _mm_unpacklo_ps(n, f));
+				_mm_storeu_ps(row + 2 * x + 4, _mm_unpackhi_ps(n, f));
+			}
+#endif
+			for (; x < w; x++) {
+				int x0 = 2 * x, x1 = std::min(x0 + 1, sw - 1);
+				float n = std::min(std::min(nearestOf(a[x0]), nearestOf(a[x1])), std::min(nearestOf(b[x0]), nearestOf(b[x1])));
+				float f = std::max(std::max(a[x0], a[x1]), std::max(b[x0], b[x1]));
+				row[2 * x] = n == NO_DEPTH ? 0.0f : n;
+				row[2 * x + 1] = std::max(f, 0.0f);
+			}
+		}
+	}
+
+	// Every further level from the pairs of the one below
+	for (int level = 2; level < levels(); level++) {
+		const int sw = m_sizes[level - 1].width, sh = m_sizes[level - 1].height;
+		const int w = m_sizes[level].width, h = m_sizes[level].height;
+		const int pairs = sw / 2;
+		const float *in = this->level(level - 1);
+		float *out = m_levels.data() + m_sizes[level].offset;
+		for (int y = 0; y < h; y++) {
+			const float *a = in + (size_t)(2 * y) * sw * 2;
+			const float *b = 2 * y + 1 < sh ? a + sw * 2 : a;
+			float *row = out + (size_t)y * w * 2;
+			int x = 0;
+#ifdef SENSETOP_SSE2
+			// Two output texels from 2x4 texels
+			for (; x + 2 <= pairs; x += 2) {
+				__m128 v0 = combinePairs(noNearestToInf(_mm_loadu_ps(a + 4 * x)), noNearestToInf(_mm_loadu_ps(b + 4 * x)));
+				__m128 v1 = combinePairs(noNearestToInf(_mm_loadu_ps(a + 4 * x + 4)), noNearestToInf(_mm_loadu_ps(b + 4 * x + 4)));
+				__m128 r = combinePairs(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 0, 1, 0)), _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 2, 3, 2)));
+				_mm_storeu_ps(row + 2 * x, infToNoDepth(r));
+			}
+#endif
+			for (; x < w; x++) {
+				int x0 = 2 * x, x1 = std::min(x0 + 1, sw - 1);
+				float n = std::min(std::min(nearestOf(a[2 * x0]), nearestOf(a[2 * x1])), std::min(nearestOf(b[2 * x0]), nearestOf(b[2 * x1])));
+				float f = std::max(std::max(a[2 * x0 + 1], a[2 * x1 + 1]), std::max(b[2 * x0 + 1], b[2 * x1 + 1]));
+				row[2 * x] = n == NO_DEPTH ? 0.0f : n;
+				row[2 * x + 1] = f;
+			}
+		}
+	}
+}
+
+// Folds texels [x0, x1) of one row of level into nearest/farthest, with
+// missing depth as infinity in nearest
+static void
+reduceRow(const float *row, bool pairs, int x0, int x1, float &nearest, float &farthest)
+{
+	int x = x0;
+#ifdef SENSETOP_SSE2
+	__m128 n = _mm_set1_ps(NO_DEPTH), f = _mm_setzero_ps();
+	if (pairs) {
+		for (; x + 2 <= x1; x += 2) {
+			__m128 v = noNearestToInf(_mm_loadu_ps(row + 2 * x));
+			n = _mm_min_ps(n, v);
+			f = _mm_max_ps(f, v);
+		}
+		// Nearest in lanes 0 and 2, farthest in 1 and 3
+		n = _mm_min_ps(n, _mm_movehl_ps(n, n));
+		f = _mm_max_ps(f, _mm_movehl_ps(f, f));
+		f = _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 1, 1));
+	}
+	else {
+		for (; x + 4 <= x1; x += 4) {
+			__m128 v = _mm_loadu_ps(row + x);
+			n = _mm_min_ps(n, noDepthToInf(v));
+			f = _mm_max_ps(f, v);
+		}
+		n = _mm_min_ps(n, _mm_movehl_ps(n, n));
+		n = _mm_min_ps(n, _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1)));
+		f = _mm_max_ps(f, _mm_movehl_ps(f, f));
+		f = _mm_max_ps(f, _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 1, 1)));
+	}
+	nearest = std::min(nearest, _mm_cvtss_f32(n));
+	farthest = std::max(farthest, _mm_cvtss_f32(f));
+#endif
+	for (; x < x1; x++) {
+		float n = pairs ? row[2 * x] : row[x];
+		float f = pairs ? row[2 * x + 1] : row[x];
+		nearest = std::min(nearest, nearestOf(n));
+		farthest = std::max(farthest, f);
+	}
+}
+
+// Same for texels [y0, y1) of one column
+static void
+reduceColumn(const float *level, int width, bool pairs, int x, int y0, int y1, float &nearest, float &farthest)
+{
+	for (int y = y0; y < y1; y++) {
+		const float *texel = pairs ? level + ((size_t)y * width + x) * 2 : level + (size_t)y * width + x;
+		nearest = std::min(nearest, nearestOf(texel[0]));
+		farthest = std::max(farthest, texel[pairs ? 1 : 0]);
+	}
+}
+
+static DepthRange
+toRange(float nearest, float farthest)
+{
+	DepthRange range;
+	if (nearest != NO_DEPTH) {
+		range.nearest = nearest;
+		range.farthest = farthest;
+	}
+	return range;
+}
+
+DepthRange
+DepthPyramid::range(int x0, int y0, int x1, int y1) const
+{
+	if (!m_depth) return DepthRange();
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, width(0));
+	y1 = std::min(y1, height(0));
+
+	// At each level the odd columns and rows at the edges are read, which
+	// leaves an even-aligned region that the next level covers exactly
+	float nearest = NO_DEPTH, farthest = 0.0f;
+	for (int l = 0; x0 < x1 && y0 < y1; l++) {
+		bool pairs = l > 0;
+		const float *data = pairs ? level(l) : m_depth;
+		int w = width(l);
+		if (x0 & 1) reduceColumn(data, w, pairs, x0++, y0, y1, nearest, farthest);
+		if (x1 & 1) reduceColumn(data, w, pairs, --x1, y0, y1, nearest, farthest);
+		if (x0 < x1) {
+			size_t stride = pairs ? (size_t)w * 2 : (size_t)w;
+			if (y0 & 1) reduceRow(data + y0++ * stride, pairs, x0, x1, nearest, farthest);
+			if (y1 & 1) reduceRow(data + --y1 * stride, pairs, x0, x1, nearest, farthest);
+		}
+		x0 >>= 1;
+		y0 >>= 1;
+		x1 >>= 1;
+		y1 >>= 1;
+	}
+	return toRange(nearest, farthest);
+}
+
+DepthRange
+DepthPyramid::bound(int x0, int y0, int x1, int y1) const
+{
+	if (!m_depth) return DepthRange();
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, width(0));
+	y1 = std::min(y1, height(0));
+	if (x0 >= x1 || y0 >= y1) return DepthRange();
+
+	// First level where the region's corners are at most one texel apart
+	int l = 0;
+	x1--;
+	y1--;
+	while ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1) l++;
+
+	bool pairs = l > 0;
+	const float *data = pairs ? level(l) : m_depth;
+	float nearest = NO_DEPTH, farthest = 0.0f;
+	for (int x = x0 >> l; x <= x1 >> l; x++)
+		reduceColumn(data, width(l), pairs, x, y0 >> l, (y1 >> l) + 1, nearest, farthest);
+	return toRange(nearest, farthest);
+}
+
+DepthRange
+DepthPyramid::frameRange() const
+{
+	if (!m_depth) return DepthRange();
+	if (levels() < 2) return toRange(nearestOf(m_depth[0]), m_depth[0]);
+	const float *top = level(levels() - 1);
+	return toRange(nearestOf(top[0]), top[1]);
+}
+
+void
+DepthPyramid::atlasOrigin(int level, int &x, int &y) const
+{
+	x = level > 0 ? width(0) : 0;
+	y = 0;
+	for (int l = 1; l < level; l++) y += height(l);
+}
+
+void
+DepthPyramid::atlasSize(int width, int height, int &atlasWidth, int &atlasHeight)
+{
+	atlasWidth = width > 1 || height > 1 ? width + (width + 1) / 2 : width;
+	int column = 0;
+	for (int w = width, h = height; w > 1 || h > 1; column += h) {
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+	atlasHeight = std::max(height, column);
+}
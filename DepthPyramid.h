@@ -0,0 +1,88 @@
+#ifndef DepthPyramid_h
+#define DepthPyramid_h
+
+#include <cstddef>
+#include <vector>
+
+// Nearest and farthest valid depth in a region, in mm. Both are 0 if the
+// region has no depth.
+struct DepthRange
+{
+	float nearest = 0.0f;
+	float farthest = 0.0f;
+
+	bool isValid() const { return farthest > 0.0f; }
+};
+
+// Min/max mip pyramid of a depth frame, for quick "nearest thing in this
+// region" queries. Level 0 is the frame itself; each level above halves it,
+// rounding up, until a single texel is left. Levels from 1 up store a
+// (nearest, farthest) pair per texel, interleaved so a level can be uploaded
+// as an RG texture. Pixels without depth (0, or negative) are left out of
+// both, and a texel with no depth under it at all is (0, 0).
+//
+// The frame is not copied: it must stay in place, unchanged, for as long as
+// the pyramid is queried.
+class DepthPyramid
+{
+
+public:
+	DepthPyramid();
+	virtual ~DepthPyramid();
+
+	// Reduces depth (width * height, mm) level by level with SSE2.
+	// Allocates only when the frame size changes.
+	void build(const float *depth, int width, int height);
+	bool isBuilt() const { return m_depth != nullptr; }
+
+	// Takes the levels of a built pyramid instead of building them again,
+	// with depth, a copy of its frame, as level 0. Allocates only when the
+	// frame size changes.
+	void copy(const DepthPyramid &source, const float *depth);
+
+	// Marks the pyramid as not built, keeping its memory for the next build
+	void clear() { m_depth = nullptr; }
+
+	int levels() const { return (int)m_sizes.size(); }
+	int width(int level) const { return m_sizes[level].width; }
+	int height(int level) const { return m_sizes[level].height; }
+
+	// The frame, which is level 0, and levels from 1 up as width * height
+	// (nearest, farthest) pairs
+	const float* depth() const { return m_depth; }
+	const float* level(int level) const { return m_levels.data() + m_sizes[level].offset; }
+
+	// Exact range over the level 0 pixels [x0, x1) x [y0, y1), clipped to
+	// the frame. Each level only reads the odd rows and columns left at the
+	// region's edges, so the cost grows with the region's perimeter spread
+	// over log n levels rather than with its area.
+	DepthRange range(int x0, int y0, int x1, int y1) const;
+
+	// Range over the few texels of the coarsest level that still cover the
+	// region with no more than 2x2 of them, so O(log n) to find and O(1) to
+	// read. It can include depth from up to one texel around the region.
+	DepthRange bound(int x0, int y0, int x1, int y1) const;
+
+	// The whole frame, from the top level
+	DepthRange frameRange() const;
+
+	// Where level sits in an atlas of the pyramid: level 0 on the left, the
+	// others stacked top to bottom in a column to its right
+	void atlasOrigin(int level, int &x, int &y) const;
+	static void atlasSize(int width, int height, int &atlasWidth, int &atlasHeight);
+
+private:
+	struct Size
+	{
+		int width;
+		int height;
+		size_t offset;
+	};
+
+	const float *m_depth;
+	std::vector<Size> m_sizes;
+	std::vector<float> m_levels;
+
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "DepthRecorder.h"
+#include "DepthCodec.h"
+#include <chrono>
+#include <cstring>
+
+static const char RECORDING_MAGIC[4] = { 'S', 'D', 'R', '1' };
+
+FILE*
+DepthRecorder::openFile(const char *path, const char *mode)
+{
+#ifdef WIN32
+	FILE *file = nullptr;
+	if (fopen_s(&file, path, mode) != 0) return nullptr;
+	return file;
+#else
+	return fopen(path, mode);
+#endif
+}
+
+DepthRecorder::DepthRecorder()
+: m_file(nullptr), m_width(0), m_height(0), m_recording(false), m_stopping(false)
+{
+}
+
+DepthRecorder::~DepthRecorder()
+{
+	stop();
+}
+
+bool
+DepthRecorder::start(const char *path, int width, int height, int encoderThreads)
+{
+	stop();
+	if (!path || !*path) return false;
+
+	m_file = openFile(path, "wb");
+	if (!m_file) return false;
+
+	writeHeader(m_file, width, height);
+
+	m_width = width;
+	m_height = height;
+
+	// Jobs are allocated once per recording so push() never allocates
+	m_jobs.clear();
+	m_free.clear();
+	m_queued.clear();
+	for (int i = 0; i < MAX_PENDING; i++) {
+		std::unique_ptr<Job> job(new Job);
+		job->depth.resize(width * height);
+		job->encoded.resize(DepthCodec::maxEncodedSize(width * height));
+		m_free.push_back(job.get());
+		m_jobs.push_back(std::move(job));
+	}
+
+	m_encoders.reset(new ThreadPool(encoderThreads));
+	m_stopping = false;
+	m_writer = std::thread(&DepthRecorder::writerThread, this);
+	m_recording = true;
+
+	printf("Recording to %s\n", path);
+	return true;
+}
+
+// Stops accepting frames, then waits for the queued ones to be written
+void
+DepthRecorder::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_recording) return;
+		m_recording = false;
+		m_stopping = true;
+	}
+	m_cv.notify_all();
+	m_writer.join();
+	m_encoders.reset();
+
+	fclose(m_file);
+	m_file = nullptr;
+	printf("Stopped recording\n");
+}
+
+bool
+DepthRecorder::push(const uint16_t *depth, int32_t pitch, int64_t sequence, int64_t deviceTime, double time)
+{
+	Job *job;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_recording) return false;
+		if (m_free.empty()) {
+			framesDropped++;
+			return false;
+		}
+		job = m_free.front();
+		m_free.pop_front();
+		job->done = false;
+		m_queued.push_back(job);
+	}
+
+	for (int y = 0; y < m_height; y++)
+		memcpy(&job->depth[y * m_width], (const uint8_t*)depth + y * pitch, m_width * sizeof(uint16_t));
+
+	job->header.sequence = sequence;
+	job->header.deviceTime = deviceTime;
+	job->header.time = time;
+
+	m_encoders->enqueue([this, job] { encode(job); });
+	return true;
+}
+
+void
+DepthRecorder::encode(Job *job)
+{
+	auto start = std::chrono::steady_clock::now();
+	job->header.encodedSize = (uint32_t)DepthCodec::encode(job->depth.data(), job->depth.size(), job->encoded.data());
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	encodeMicros += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+	bytesIn += job->depth.size() * sizeof(uint16_t);
+	bytesOut += job->header.encodedSize;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		job->done = true;
+	}
+	m_cv.notify_all();
+}
+
+// Writes encoded frames in the order they were pushed, whichever worker
+// finished them first
+void
+DepthRecorder::writerThread()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		m_cv.wait(lock, [this] {
+			return (!m_queued.empty() && m_queued.front()->done) || (m_stopping && m_queued.empty());
+		});
+		if (m_queued.empty()) break;
+
+		Job *job = m_queued.front();
+		m_queued.pop_front();
+		lock.unlock();
+
+		writeFrame(m_file, job->header, job->encoded.data());
+		framesWritten++;
+
+		lock.lock();
+		m_free.push_back(job);
+	}
+}
+
+void
+DepthRecorder::writeHeader(FILE *file, int width, int height)
+{
+	int32_t size[2] = { width, height };
+	fwrite(RECORDING_MAGIC, 1, sizeof(RECORDING_MAGIC), file);
+	fwrite(size, sizeof(int32_t), 2, file);
+}
+
+void
+DepthRecorder::writeFrame(FILE *file, const RecordingFrameHeader &header, const uint8_t *encoded)
+{
+	fwrite(&header.encodedSize, sizeof(header.encodedSize), 1, file);
+	fwrite(&header.sequence, sizeof(header.sequence), 1, file);
+	fwrite(&header.deviceTime, sizeof(header.deviceTime), 1, file);
+	fwrite(&header.time, sizeof(header.time), 1, file);
+	fwrite(encoded, 1, header.encodedSize, file);
+}
+
+
+DepthRecordingReader::DepthRecordingReader()
+: m_file(nullptr), m_dataStart(0), m_width(0), m_height(0)
+{
+}
+
+DepthRecordingReader::~DepthRecordingReader()
+{
+	close();
+}
+
+bool
+DepthRecordingReader::open(const char *path)
+{
+	close();
+	if (!path || !*path) return false;
+
+	m_file = DepthRecorder::openFile(path, "rb");
+	if (!m_file) return false;
+
+	char magic[4];
+	int32_t size[2];
+	if (fread(magic, 1, sizeof(magic), m_file) != sizeof(magic) ||
+		memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0 ||
+		fread(size, sizeof(int32_t), 2, m_file) != 2 ||
+		size[0] <= 0 || size[1] <= 0) {
+		close();
+		return false;
+	}
+
+	m_width = size[0];
+	m_height = size[1];
+	m_dataStart = ftell(m_file);
+	m_encoded.resize(DepthCodec::maxEncodedSize(m_width * m_height));
+	m_decoded.resize(m_width * m_height);
+	return true;
+}
+
+void
+DepthRecordingReader::close()
+{
+	if (m_file) fclose(m_file);
+	m_file = nullptr;
+}
+
+void
+DepthRecordingReader::rewind()
+{
+	if (m_file) fseek(m_file, m_dataStart, SEEK_SET);
+}
+
+bool
+DepthRecordingReader::read(DepthFrame &frame)
+{
+	if (!m_file) return false;
+
+	RecordingFrameHeader h;
+	if (fread(&h.encodedSize, sizeof(h.encodedSize), 1, m_file) != 1 ||
+		fread(&h.sequence, sizeof(h.sequence), 1, m_file) != 1 ||
+		fread(&h.deviceTime, sizeof(h.deviceTime), 1, m_file) != 1 ||
+		fread(&h.time, sizeof(h.time), 1, m_file) != 1 ||
+		h.encodedSize > m_encoded.size() ||
+		fread(m_encoded.data(), 1, h.encodedSize, m_file) != h.encodedSize)
+		return false;
+
+	if (!DepthCodec::decode(m_encoded.data(), h.encodedSize, m_decoded.data(), m_decoded.size()))
+		return false;
+
+	frame.sequence = h.sequence;
+	frame.deviceTime = h.deviceTime;
+	frame.time = h.time;
+	frame.width = m_width;
+	frame.height = m_height;
+	frame.depth.resize(m_decoded.size());
+	for (size_t i = 0; i < m_decoded.size(); i++)
+		frame.depth[i] = (float)m_decoded[i];
+	return true;
+}
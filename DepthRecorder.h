@@ -0,0 +1,119 @@
+#ifndef DepthRecorder_h
+#define DepthRecorder_h
+
+#include "DepthFrame.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+
+// Recording file layout, all values little-endian:
+//   header: "SDR1", int32 width, int32 height
+//   frame:  uint32 encoded size, int64 sequence, int64 device time,
+//           double time, DepthCodec payload
+struct RecordingFrameHeader
+{
+	uint32_t encodedSize;
+	int64_t sequence;
+	int64_t deviceTime;
+	double time;
+};
+
+// Writes 16-bit depth frames to disk, compressed with DepthCodec.
+// push() is called from the capture thread and only copies the frame into a
+// free job; encoding happens on a pool of worker threads, and a writer
+// thread appends the results to the file in capture order. If all jobs are
+// in use the frame is dropped rather than stalling capture.
+class DepthRecorder
+{
+
+public:
+	DepthRecorder();
+	virtual ~DepthRecorder();
+
+	bool start(const char *path, int width, int height, int encoderThreads);
+	void stop();
+	bool isRecording() const { return m_recording; }
+
+	// pitch is the row stride of depth in bytes
+	bool push(const uint16_t *depth, int32_t pitch, int64_t sequence, int64_t deviceTime, double time);
+
+	// Recording file helpers, shared with ReplayBuffer
+	static FILE* openFile(const char *path, const char *mode);
+	static void writeHeader(FILE *file, int width, int height);
+	static void writeFrame(FILE *file, const RecordingFrameHeader &header, const uint8_t *encoded);
+
+	// Telemetry
+	std::atomic<int32_t> framesWritten{ 0 };
+	std::atomic<int32_t> framesDropped{ 0 };
+	std::atomic<int64_t> bytesIn{ 0 };
+	std::atomic<int64_t> bytesOut{ 0 };
+	std::atomic<int64_t> encodeMicros{ 0 };
+
+	// Frames that may be encoding or waiting to be written at once
+	static const int MAX_PENDING = 8;
+
+private:
+	struct Job
+	{
+		std::vector<uint16_t> depth;
+		std::vector<uint8_t> encoded;
+		RecordingFrameHeader header;
+		bool done;
+	};
+
+	void encode(Job *job);
+	void writerThread();
+
+	std::unique_ptr<ThreadPool> m_encoders;
+	std::thread m_writer;
+	FILE *m_file;
+	int m_width;
+	int m_height;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::atomic<bool> m_recording;
+	bool m_stopping;
+
+	std::vector<std::unique_ptr<Job> > m_jobs;
+	std::deque<Job*> m_free;
+	std::deque<Job*> m_queued;		// in capture order
+
+};
+
+// Reads recordings written by DepthRecorder, fast enough for realtime replay
+class DepthRecordingReader
+{
+
+public:
+	DepthRecordingReader();
+	virtual ~DepthRecordingReader();
+
+	bool open(const char *path);
+	void close();
+	bool isOpen() const { return m_file != nullptr; }
+
+	// Seeks back to the first frame
+	void rewind();
+
+	// Decodes the next frame into frame, converting to float depth.
+	// Returns false at the end of the file or on a corrupt frame.
+	bool read(DepthFrame &frame);
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+
+private:
+	FILE *m_file;
+	long m_dataStart;
+	int m_width;
+	int m_height;
+	std::vector<uint8_t> m_encoded;
+	std::vector<uint16_t> m_decoded;
+
+};
+
+#endif
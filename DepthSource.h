@@ -0,0 +1,37 @@
+#ifndef DepthSource_h
+#define DepthSource_h
+
+#include "DepthFrame.h"
+#include "Deprojection.h"
+
+enum class DepthSourceResult : int32_t
+{
+	Frame = 0,		// frame was filled in
+	Timeout,		// no frame yet, try again
+	Lost,			// the source failed and has to be reopened
+};
+
+// Where the capture thread gets depth from when it isn't reading a camera.
+// open() and read() are only called from one thread; read() may block for
+// up to timeoutMs.
+class DepthSource
+{
+
+public:
+	virtual ~DepthSource() {}
+
+	virtual bool open() = 0;
+	virtual void close() = 0;
+	virtual DepthSourceResult read(DepthFrame &frame, int timeoutMs) = 0;
+
+	// Pinhole model of the source, invalid if it doesn't know. Valid once
+	// open() has succeeded.
+	virtual DepthIntrinsics intrinsics() const { return DepthIntrinsics(); }
+
+	// Link telemetry, for sources that have one
+	virtual double megabytesPerSecond() const { return 0.0; }
+	virtual double latency() const { return 0.0; }
+
+};
+
+#endif
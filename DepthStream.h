@@ -0,0 +1,81 @@
+#ifndef DepthStream_h
+#define DepthStream_h
+
+#include "Deprojection.h"
+#include <cstdint>
+#include <cstring>
+
+// Depth stream protocol between DepthStreamServer and NetworkDepthSource,
+// all values little-endian:
+//   on connect, server to client: "SDS2", int32 width, int32 height,
+//   float fx, fy, cx, cy intrinsics (0 if unknown)
+//   each frame, server to client: StreamFrameHeader, DepthCodec payload
+//   each frame, client to server: the frame's sendTime, echoed back so the
+//   server can measure the round trip on its own clock
+
+static const char DEPTH_STREAM_MAGIC[4] = { 'S', 'D', 'S', '2' };
+static const int DEPTH_STREAM_PORT = 7450;
+
+static const size_t STREAM_HELLO_SIZE = 4 + 2 * 4 + 4 * 4;
+
+inline void
+packStreamHello(int32_t width, int32_t height, const DepthIntrinsics &k, uint8_t *out)
+{
+	memcpy(out, DEPTH_STREAM_MAGIC, 4);
+	memcpy(out + 4, &width, 4);
+	memcpy(out + 8, &height, 4);
+	memcpy(out + 12, &k.fx, 4);
+	memcpy(out + 16, &k.fy, 4);
+	memcpy(out + 20, &k.cx, 4);
+	memcpy(out + 24, &k.cy, 4);
+}
+
+// Returns false if in isn't a hello of this protocol version
+inline bool
+unpackStreamHello(const uint8_t *in, int32_t &width, int32_t &height, DepthIntrinsics &k)
+{
+	if (memcmp(in, DEPTH_STREAM_MAGIC, 4) != 0) return false;
+	memcpy(&width, in + 4, 4);
+	memcpy(&height, in + 8, 4);
+	memcpy(&k.fx, in + 12, 4);
+	memcpy(&k.fy, in + 16, 4);
+	memcpy(&k.cx, in + 20, 4);
+	memcpy(&k.cy, in + 24, 4);
+	return width > 0 && height > 0;
+}
+
+struct StreamFrameHeader
+{
+	uint32_t encodedSize;
+	int64_t sequence;
+	int64_t deviceTime;
+	double time;			// capture time on the server's steady clock
+	double sendTime;		// when the server sent the frame, same clock
+	double latency;			// the link's last measured one-way latency, seconds
+};
+
+static const size_t STREAM_FRAME_HEADER_SIZE = 4 + 5 * 8;
+
+inline void
+packStreamFrameHeader(const StreamFrameHeader &header, uint8_t *out)
+{
+	memcpy(out, &header.encodedSize, 4);
+	memcpy(out + 4, &header.sequence, 8);
+	memcpy(out + 12, &header.deviceTime, 8);
+	memcpy(out + 20, &header.time, 8);
+	memcpy(out + 28, &header.sendTime, 8);
+	memcpy(out + 36, &header.latency, 8);
+}
+
+inline void
+unpackStreamFrameHeader(const uint8_t *in, StreamFrameHeader &header)
+{
+	memcpy(&header.encodedSize, in, 4);
+	memcpy(&header.sequence, in + 4, 8);
+	memcpy(&header.deviceTime, in + 12, 8);
+	memcpy(&header.time, in + 20, 8);
+	memcpy(&header.sendTime, in + 28, 8);
+	memcpy(&header.latency, in + 36, 8);
+}
+
+#endif
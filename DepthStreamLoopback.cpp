@@ -0,0 +1,120 @@
+// End-to-end check of depth streaming over localhost: SyntheticDepthSource
+// feeds a DepthStreamServer, a NetworkDepthSource receives it, and every
+// frame is compared bit for bit with the same synthetic frame rendered
+// locally. The client then stops reading for a while, to check the server
+// drops the oldest queued frames rather than holding up capture. Not part of
+// the plugin; build it on its own:
+//
+//	g++ -O2 -std=c++14 DepthStreamLoopback.cpp DepthStreamServer.cpp
+//		NetworkDepthSource.cpp TcpSocket.cpp DepthCodec.cpp ThreadPool.cpp
+//		SyntheticDepthSource.cpp Deprojection.cpp DepthPyramid.cpp
+//		-lpthread -o DepthStreamLoopback
+//
+// (ws2_32.lib on Windows). Returns 0 if every check passes.
+//
+//	DepthStreamLoopback [port] [frames]
+
+#include "DepthStreamServer.h"
+#include "NetworkDepthSource.h"
+#include "SyntheticDepthSource.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+static const int WIDTH = 640;
+static const int HEIGHT = 480;
+static const double FPS = 60.0;
+
+// Frames read, and those that differed from the synthetic frame
+static void
+receive(NetworkDepthSource &client, const SyntheticDepthSource &scene, int count, int &received, int &mismatched)
+{
+	std::vector<uint16_t> expected;
+	DepthFrame frame;
+	received = mismatched = 0;
+	for (int timeouts = 0; received < count && timeouts < 10; ) {
+		DepthSourceResult result = client.read(frame, 500);
+		if (result == DepthSourceResult::Lost) return;
+		if (result != DepthSourceResult::Frame) {
+			timeouts++;
+			continue;
+		}
+		scene.render(frame.sequence, expected);
+		for (size_t i = 0; i < expected.size(); i++) {
+			if (frame.depth[i] != (float)expected[i]) {
+				mismatched++;
+				break;
+			}
+		}
+		received++;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int port = argc > 1 ? atoi(argv[1]) : 7461;
+	int count = argc > 2 ? atoi(argv[2]) : 120;
+
+	DepthStreamServer server;
+	if (!server.start(port, WIDTH, HEIGHT)) {
+		fprintf(stderr, "Could not listen on port %d\n", port);
+		return 1;
+	}
+	SyntheticDepthSource source(WIDTH, HEIGHT, FPS);
+	source.open();
+	server.setIntrinsics(source.intrinsics());
+
+	// Capture: synthetic frames at the camera's rate, as 16-bit depth
+	std::atomic<bool> running{ true };
+	std::atomic<int64_t> pushed{ 0 };
+	std::thread capture([&] {
+		DepthFrame frame;
+		std::vector<uint16_t> raw(WIDTH * HEIGHT);
+		while (running) {
+			if (source.read(frame, 100) != DepthSourceResult::Frame) continue;
+			for (size_t i = 0; i < raw.size(); i++)
+				raw[i] = (uint16_t)frame.depth[i];
+			server.push(raw.data(), WIDTH * sizeof(uint16_t), frame.sequence, frame.deviceTime, frame.time);
+			pushed++;
+		}
+	});
+
+	NetworkDepthSource client("127.0.0.1", port);
+	bool connected = client.open();
+	int received = 0, mismatched = 0;
+	if (connected)
+		receive(client, source, count, received, mismatched);
+	std::vector<DepthStreamServer::LinkStats> links = server.linkStats();
+	printf("Received %d of %d frames, %d not bit-exact, %.1f MB/s, %.2f ms latency\n", received, count, mismatched,
+		client.megabytesPerSecond(), client.latency() * 1e3);
+	for (const DepthStreamServer::LinkStats &link : links)
+		printf("Link %s: %lld sent, %lld dropped, %.1f MB/s, %.2f ms latency\n", link.peer.c_str(),
+			(long long)link.framesSent, (long long)link.framesDropped, link.megabytesPerSecond, link.latency * 1e3);
+
+	// A stalled client: capture has to keep going and the link drop frames
+	int64_t pushedBefore = pushed;
+	std::this_thread::sleep_for(std::chrono::seconds(3));
+	int64_t pushedDuringStall = pushed - pushedBefore;
+	links = server.linkStats();
+	int64_t dropped = links.empty() ? 0 : links[0].framesDropped;
+	printf("While the client stalled for 3 s: %lld frames captured, %lld dropped on the link\n",
+		(long long)pushedDuringStall, (long long)dropped);
+
+	// And it picks up again afterwards
+	int resumed = 0, resumedMismatched = 0;
+	if (connected)
+		receive(client, source, 30, resumed, resumedMismatched);
+	printf("After the stall: %d frames received, %d not bit-exact\n", resumed, resumedMismatched);
+
+	client.close();
+	running = false;
+	capture.join();
+	server.stop();
+
+	bool ok = connected && received == count && mismatched == 0 && pushedDuringStall >= (int64_t)(FPS * 2.5) &&
+		dropped > 0 && resumed == 30 && resumedMismatched == 0;
+	printf("%s\n", ok ? "Passed" : "FAILED");
+	return ok ? 0 : 1;
+}
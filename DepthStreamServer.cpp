@@ -0,0 +1,270 @@
+#include "DepthStreamServer.h"
+#include "DepthCodec.h"
+#include "SteadyClock.h"
+#include <cstdio>
+#include <cstring>
+
+// Frames that may be waiting for the encoder at once
+static const int STREAM_SCRATCH = 2;
+
+// A client that takes longer than this to accept a frame is dropped
+static const int SEND_TIMEOUT_MS = 2000;
+
+DepthStreamServer::DepthStreamServer()
+: m_running(false), m_port(0), m_width(0), m_height(0), m_stopping(false),
+	m_encoder(new ThreadPool(1))
+{
+}
+
+DepthStreamServer::~DepthStreamServer()
+{
+	stop();
+	m_encoder.reset();
+}
+
+bool
+DepthStreamServer::start(int port, int width, int height)
+{
+	stop();
+	if (!m_listener.listen(port)) {
+		printf("Could not listen for depth stream clients on port %d\n", port);
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_scratch.empty()) {
+			for (int i = 0; i < STREAM_SCRATCH; i++) {
+				m_scratch.emplace_back(new std::vector<uint16_t>(width * height));
+				m_freeScratch.push_back(m_scratch.back().get());
+			}
+			m_encodeBuffer.resize(DepthCodec::maxEncodedSize(width * height));
+		}
+		m_width = width;
+		m_height = height;
+		m_stopping = false;
+	}
+
+	m_port = port;
+	m_running = true;
+	m_acceptor = std::thread(&DepthStreamServer::acceptThread, this);
+	printf("Streaming depth on port %d\n", port);
+	return true;
+}
+
+void
+DepthStreamServer::stop()
+{
+	if (!m_running) return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+		m_stopping = true;
+	}
+	m_cv.notify_all();
+	m_acceptor.join();
+	m_listener.close();
+	reapLinks(true);
+	printf("Stopped streaming\n");
+}
+
+void
+DepthStreamServer::setIntrinsics(const DepthIntrinsics &intrinsics)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_intrinsics = intrinsics;
+}
+
+void
+DepthStreamServer::acceptThread()
+{
+	while (m_running) {
+		TcpSocket socket = m_listener.accept(100);
+		reapLinks(false);
+		if (!socket.isOpen()) continue;
+
+		socket.setNoDelay();
+		socket.setSendTimeout(SEND_TIMEOUT_MS);
+		printf("Depth stream client %s connected\n", socket.peer().c_str());
+
+		std::unique_ptr<Link> link(new Link);
+		link->socket = std::move(socket);
+		link->windowStart = steadySeconds();
+		Link *l = link.get();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_links.push_back(std::move(link));
+		}
+		l->sender = std::thread(&DepthStreamServer::senderThread, this, l);
+		l->acks = std::thread(&DepthStreamServer::ackThread, this, l);
+		clients++;
+	}
+}
+
+// Joins and removes closed links, or all of them when stopping
+void
+DepthStreamServer::reapLinks(bool all)
+{
+	std::vector<std::unique_ptr<Link> > closed;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < m_links.size();) {
+			if (all || m_links[i]->closed) {
+				m_links[i]->closed = true;
+				closed.push_back(std::move(m_links[i]));
+				m_links.erase(m_links.begin() + i);
+			}
+			else {
+				i++;
+			}
+		}
+	}
+	if (closed.empty()) return;
+	m_cv.notify_all();
+
+	for (std::unique_ptr<Link> &link : closed) {
+		// Unblocks a send or the ack reader
+		link->socket.shutdown();
+		link->sender.join();
+		link->acks.join();
+		printf("Depth stream client %s disconnected\n", link->socket.peer().c_str());
+		clients--;
+	}
+}
+
+bool
+DepthStreamServer::push(const uint16_t *depth, int32_t pitch, int64_t sequence, int64_t deviceTime, double time)
+{
+	if (!m_running || clients == 0) return false;
+
+	std::vector<uint16_t> *scratch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_freeScratch.empty()) {
+			framesDropped++;
+			return false;
+		}
+		scratch = m_freeScratch.back();
+		m_freeScratch.pop_back();
+	}
+
+	for (int y = 0; y < m_height; y++)
+		memcpy(&(*scratch)[y * m_width], (const uint8_t*)depth + y * pitch, m_width * sizeof(uint16_t));
+
+	StreamFrameHeader header;
+	header.encodedSize = 0;
+	header.sequence = sequence;
+	header.deviceTime = deviceTime;
+	header.time = time;
+	header.sendTime = 0.0;
+	header.latency = 0.0;
+
+	m_encoder->enqueue([this, scratch, header] { encode(scratch, header); });
+	return true;
+}
+
+// Runs on the single encoder thread, which owns m_encodeBuffer
+void
+DepthStreamServer::encode(std::vector<uint16_t> *depth, StreamFrameHeader header)
+{
+	header.encodedSize = (uint32_t)DepthCodec::encode(depth->data(), depth->size(), m_encodeBuffer.data());
+
+	std::shared_ptr<Packet> packet(new Packet);
+	packet->header = header;
+	packet->encoded.assign(m_encodeBuffer.begin(), m_encodeBuffer.begin() + header.encodedSize);
+	framesEncoded++;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_freeScratch.push_back(depth);
+		for (std::unique_ptr<Link> &link : m_links) {
+			if (link->closed) continue;
+			// Drop the oldest frame rather than let a slow link fall behind
+			if (link->queue.size() >= LINK_QUEUE) {
+				link->queue.pop_front();
+				link->framesDropped++;
+			}
+			link->queue.push_back(packet);
+		}
+	}
+	m_cv.notify_all();
+}
+
+void
+DepthStreamServer::senderThread(Link *link)
+{
+	uint8_t hello[STREAM_HELLO_SIZE];
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		packStreamHello(m_width, m_height, m_intrinsics, hello);
+	}
+	bool ok = link->socket.sendAll(hello, sizeof(hello));
+
+	uint8_t header[STREAM_FRAME_HEADER_SIZE];
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (ok) {
+		m_cv.wait(lock, [this, link] { return m_stopping || link->closed || !link->queue.empty(); });
+		if (m_stopping || link->closed) break;
+
+		std::shared_ptr<const Packet> packet = link->queue.front();
+		link->queue.pop_front();
+		StreamFrameHeader h = packet->header;
+		h.latency = link->latency;
+		lock.unlock();
+
+		h.sendTime = steadySeconds();
+		packStreamFrameHeader(h, header);
+		ok = link->socket.sendAll(header, sizeof(header)) &&
+			link->socket.sendAll(packet->encoded.data(), packet->encoded.size());
+
+		double now = steadySeconds();
+		lock.lock();
+		if (!ok) break;
+
+		link->framesSent++;
+		link->windowBytes += sizeof(header) + packet->encoded.size();
+		if (now - link->windowStart >= 1.0) {
+			link->megabytesPerSecond = link->windowBytes / (now - link->windowStart) * 1e-6;
+			link->windowBytes = 0;
+			link->windowStart = now;
+		}
+	}
+	link->closed = true;
+}
+
+// Reads the sendTime each client echoes back per frame
+void
+DepthStreamServer::ackThread(Link *link)
+{
+	double sendTime;
+	while (link->socket.recvAll(&sendTime, sizeof(sendTime))) {
+		double latency = (steadySeconds() - sendTime) * 0.5;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		link->latency = latency;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		link->closed = true;
+	}
+	m_cv.notify_all();
+}
+
+std::vector<DepthStreamServer::LinkStats>
+DepthStreamServer::linkStats()
+{
+	std::vector<LinkStats> stats;
+	double now = steadySeconds();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (std::unique_ptr<Link> &link : m_links) {
+		LinkStats s;
+		s.peer = link->socket.peer();
+		// A link that hasn't sent for a while isn't using any bandwidth
+		s.megabytesPerSecond = now - link->windowStart < 2.0 ? link->megabytesPerSecond : 0.0;
+		s.latency = link->latency;
+		s.framesSent = link->framesSent;
+		s.framesDropped = link->framesDropped;
+		stats.push_back(s);
+	}
+	return stats;
+}
@@ -0,0 +1,107 @@
+#ifndef DepthStreamServer_h
+#define DepthStreamServer_h
+
+#include "DepthStream.h"
+#include "TcpSocket.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Streams depth to any number of NetworkDepthSource clients over TCP.
+// push() is called from the capture thread and only copies the frame; a
+// single worker compresses it with DepthCodec once and hands the result to
+// every link. Each link has its own sender thread and a short queue: when a
+// client can't keep up its oldest queued frame is dropped, so a slow link
+// never holds up capture or the other links.
+class DepthStreamServer
+{
+
+public:
+	DepthStreamServer();
+	virtual ~DepthStreamServer();
+
+	// Cook thread
+	bool start(int port, int width, int height);
+	void stop();
+	bool isRunning() const { return m_running; }
+	int port() const { return m_port; }
+
+	// Sent to clients as they connect, so they can deproject the stream
+	void setIntrinsics(const DepthIntrinsics &intrinsics);
+
+	// Capture thread. pitch is the row stride of depth in bytes.
+	bool push(const uint16_t *depth, int32_t pitch, int64_t sequence, int64_t deviceTime, double time);
+
+	struct LinkStats
+	{
+		std::string peer;
+		double megabytesPerSecond;
+		double latency;				// one way, half the measured round trip
+		int64_t framesSent;
+		int64_t framesDropped;
+	};
+	std::vector<LinkStats> linkStats();
+
+	// Telemetry
+	std::atomic<int32_t> clients{ 0 };
+	std::atomic<int64_t> framesEncoded{ 0 };
+	std::atomic<int32_t> framesDropped{ 0 };		// encoder still busy
+
+	// Frames queued per link before the oldest is dropped
+	static const int LINK_QUEUE = 4;
+
+private:
+	struct Packet
+	{
+		StreamFrameHeader header;
+		std::vector<uint8_t> encoded;
+	};
+
+	struct Link
+	{
+		TcpSocket socket;
+		std::thread sender;
+		std::thread acks;
+		std::deque<std::shared_ptr<const Packet> > queue;
+		bool closed = false;
+
+		// Guarded by m_mutex
+		int64_t framesSent = 0;
+		int64_t framesDropped = 0;
+		double latency = 0.0;
+		double megabytesPerSecond = 0.0;
+		int64_t windowBytes = 0;
+		double windowStart = 0.0;
+	};
+
+	void acceptThread();
+	void senderThread(Link *link);
+	void ackThread(Link *link);
+	void encode(std::vector<uint16_t> *depth, StreamFrameHeader header);
+	void reapLinks(bool all);
+
+	TcpSocket m_listener;
+	std::thread m_acceptor;
+	std::atomic<bool> m_running;
+	int m_port;
+	int m_width;
+	int m_height;
+
+	// Guards the links, their queues and stats, and the scratch buffers
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_stopping;
+	DepthIntrinsics m_intrinsics;
+	std::vector<std::unique_ptr<Link> > m_links;
+	std::vector<std::unique_ptr<std::vector<uint16_t> > > m_scratch;
+	std::vector<std::vector<uint16_t>*> m_freeScratch;
+	std::vector<uint8_t> m_encodeBuffer;
+
+	std::unique_ptr<ThreadPool> m_encoder;
+
+};
+
+#endif
@@ -0,0 +1,252 @@
+#include "DeviceControl.h"
+#include <cstdio>
+#include <chrono>
+
+static const uint32_t ALL_PROPERTIES = 0x3f;
+
+static const char *const PROPERTY_NAMES[] = {
+	"accuracy", "laserPower", "filterOption", "motionTradeoff", "autoExposure", "autoWhiteBalance",
+};
+
+DeviceControl::DeviceControl()
+: m_running(false), m_hasDesired(false), m_hasPending(false), m_retryPending(false), m_retryAtBoundary(false),
+	m_boundaryPending(false), m_boundaryReady(false), m_lastFrame(-1),
+	m_device(nullptr), m_staleProperties(ALL_PROPERTIES)
+{
+	for (int p = 0; p < PROPERTY_COUNT; p++) {
+		m_rejectedValue[p] = 0;
+		m_rejections[p] = 0;
+	}
+}
+
+DeviceControl::~DeviceControl()
+{
+	stop();
+}
+
+void
+DeviceControl::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_running) return;
+
+	m_running = true;
+	m_thread = std::thread(&DeviceControl::controlThread, this);
+}
+
+void
+DeviceControl::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	if (m_thread.joinable()) m_thread.join();
+}
+
+void
+DeviceControl::setDevice(PXCCapture::Device *in_device)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_deviceMutex);
+		m_device = in_device;
+		m_staleProperties = ALL_PROPERTIES;
+
+		// A new device may take what the last one would not
+		for (int p = 0; p < PROPERTY_COUNT; p++)
+			m_rejections[p] = 0;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_droppedMutex);
+		m_dropped.clear();
+	}
+
+	// A new device starts with its own defaults, so reapply everything
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (in_device && m_hasDesired) {
+		m_hasPending = true;
+		m_cv.notify_all();
+	}
+}
+
+void
+DeviceControl::request(const DeviceSettings &settings, bool atFrameBoundary)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_hasPending) requestsCoalesced++;
+
+	m_desired = settings;
+	m_hasDesired = true;
+	m_hasPending = true;
+
+	// Once a batch is waiting for a frame boundary, later changes join it
+	// rather than being written ahead of it
+	if (atFrameBoundary) {
+		m_boundaryPending = true;
+		boundaryFrame = -1;
+	}
+	m_cv.notify_all();
+}
+
+void
+DeviceControl::frameBoundary(int64_t frame)
+{
+	// Wait time is bounded so a slow device never stalls capture for long
+	const auto maxWait = std::chrono::milliseconds(250);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_lastFrame = frame;
+	if (!m_boundaryPending) return;
+
+	m_boundaryReady = true;
+	m_cv.notify_all();
+	m_cv.wait_for(lock, maxWait, [this] { return !m_running || !m_boundaryPending; });
+}
+
+std::string
+DeviceControl::droppedValues()
+{
+	std::lock_guard<std::mutex> lock(m_droppedMutex);
+	return m_dropped;
+}
+
+void
+DeviceControl::controlThread()
+{
+	auto ready = [this] {
+		return !m_running || m_boundaryReady || (m_hasPending && !m_boundaryPending);
+	};
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		// A batch that failed is tried again after a while, or sooner with
+		// whatever is requested next
+		if (m_retryPending) {
+			m_cv.wait_for(lock, std::chrono::milliseconds(RETRY_MS), ready);
+			m_hasPending = true;
+			if (m_retryAtBoundary) m_boundaryPending = true;
+			m_retryPending = false;
+			m_retryAtBoundary = false;
+		}
+		m_cv.wait(lock, ready);
+		if (!m_running) break;
+
+		bool atBoundary = m_boundaryReady;
+		DeviceSettings wanted = m_desired;
+		m_hasPending = false;
+
+		lock.unlock();
+		BatchResult result = applyBatch(wanted);
+		lock.lock();
+
+		if (result == BatchResult::Failed) {
+			m_retryPending = true;
+			m_retryAtBoundary = atBoundary;
+		}
+
+		if (atBoundary) {
+			m_boundaryPending = false;
+			m_boundaryReady = false;
+			if (result == BatchResult::Applied) boundaryFrame = m_lastFrame;
+			m_cv.notify_all();
+		}
+	}
+}
+
+// Writes every property that differs from the shadow state in one pass.
+// Without a device nothing is written; setDevice() reapplies the settings
+// once there is one.
+DeviceControl::BatchResult
+DeviceControl::applyBatch(const DeviceSettings &wanted)
+{
+	std::lock_guard<std::mutex> lock(m_deviceMutex);
+	if (!m_device) return BatchResult::NoDevice;
+
+	// Query the device after it has been (re)created, and any property whose
+	// write it rejected, since that may still have changed something
+	auto stale = [this](Property p) { return (m_staleProperties & (1u << p)) != 0; };
+	if (stale(Accuracy)) m_shadow.accuracy = m_device->QueryIVCAMAccuracy();
+	if (stale(LaserPower)) m_shadow.laserPower = m_device->QueryIVCAMLaserPower();
+	if (stale(FilterOption)) m_shadow.filterOption = m_device->QueryIVCAMFilterOption();
+	if (stale(MotionTradeoff)) m_shadow.motionTradeoff = m_device->QueryIVCAMMotionRangeTradeOff();
+	if (stale(AutoExposure)) m_shadow.autoExposure = m_device->QueryColorAutoExposure();
+	if (stale(AutoWhiteBalance)) m_shadow.autoWhiteBalance = m_device->QueryColorAutoWhiteBalance();
+	m_staleProperties = 0;
+
+	const pxcI32 values[PROPERTY_COUNT] = {
+		wanted.accuracy, wanted.laserPower, wanted.filterOption,
+		wanted.motionTradeoff, wanted.autoExposure, wanted.autoWhiteBalance,
+	};
+	auto dropped = [&](Property p) {
+		return m_rejections[p] >= MAX_REJECTIONS && m_rejectedValue[p] == values[p];
+	};
+
+	// Only properties the device accepted go into the shadow. Failures that
+	// have not yet used up their rejections make the batch retry.
+	int32_t failures = 0;
+	auto written = [&](Property p, pxcStatus status) {
+		if (status < PXC_STATUS_NO_ERROR) {
+			writeFailures++;
+			m_staleProperties |= 1u << p;
+			if (m_rejectedValue[p] != values[p]) {
+				m_rejectedValue[p] = values[p];
+				m_rejections[p] = 0;
+			}
+			if (++m_rejections[p] < MAX_REJECTIONS) {
+				failures++;
+			}
+			else {
+				valuesDropped++;
+				printf("DeviceControl: dropping %s %d after %d rejected writes\n", PROPERTY_NAMES[p], (int)values[p],
+					m_rejections[p]);
+			}
+			return false;
+		}
+		m_rejections[p] = 0;
+		propertiesWritten++;
+		return true;
+	};
+
+	if (wanted.accuracy != m_shadow.accuracy && !dropped(Accuracy) &&
+		written(Accuracy, m_device->SetIVCAMAccuracy((PXCCapture::Device::IVCAMAccuracy)wanted.accuracy)))
+		m_shadow.accuracy = wanted.accuracy;
+
+	if (wanted.laserPower != m_shadow.laserPower && !dropped(LaserPower) &&
+		written(LaserPower, m_device->SetIVCAMLaserPower(wanted.laserPower)))
+		m_shadow.laserPower = wanted.laserPower;
+
+	if (wanted.filterOption != m_shadow.filterOption && !dropped(FilterOption) &&
+		written(FilterOption, m_device->SetIVCAMFilterOption(wanted.filterOption)))
+		m_shadow.filterOption = wanted.filterOption;
+
+	if (wanted.motionTradeoff != m_shadow.motionTradeoff && !dropped(MotionTradeoff) &&
+		written(MotionTradeoff, m_device->SetIVCAMMotionRangeTradeOff(wanted.motionTradeoff)))
+		m_shadow.motionTradeoff = wanted.motionTradeoff;
+
+	if (wanted.autoExposure != m_shadow.autoExposure && !dropped(AutoExposure) &&
+		written(AutoExposure, m_device->SetColorAutoExposure(wanted.autoExposure)))
+		m_shadow.autoExposure = wanted.autoExposure;
+
+	if (wanted.autoWhiteBalance != m_shadow.autoWhiteBalance && !dropped(AutoWhiteBalance) &&
+		written(AutoWhiteBalance, m_device->SetColorAutoWhiteBalance(wanted.autoWhiteBalance)))
+		m_shadow.autoWhiteBalance = wanted.autoWhiteBalance;
+
+	// A value stays listed while it is still the one requested
+	std::string list;
+	for (int p = 0; p < PROPERTY_COUNT; p++) {
+		if (!dropped((Property)p)) continue;
+		if (!list.empty()) list += ' ';
+		list += PROPERTY_NAMES[p];
+		list += '=';
+		list += std::to_string(values[p]);
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_droppedMutex);
+		m_dropped.swap(list);
+	}
+
+	if (failures > 0) return BatchResult::Failed;
+	batchesApplied++;
+	return BatchResult::Applied;
+}
@@ -0,0 +1,139 @@
+#ifndef DeviceControl_h
+#define DeviceControl_h
+
+#include "pxcsensemanager.h"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
+// The device properties exposed on the Device page
+struct DeviceSettings
+{
+	pxcI32 accuracy = 1;
+	pxcI32 laserPower = 10;
+	pxcI32 filterOption = 4;
+	pxcI32 motionTradeoff = 10;
+	pxcBool autoExposure = 1;
+	pxcBool autoWhiteBalance = 1;
+
+	bool operator==(const DeviceSettings &o) const
+	{
+		return accuracy == o.accuracy && laserPower == o.laserPower &&
+			filterOption == o.filterOption && motionTradeoff == o.motionTradeoff &&
+			autoExposure == o.autoExposure && autoWhiteBalance == o.autoWhiteBalance;
+	}
+	bool operator!=(const DeviceSettings &o) const { return !(*this == o); }
+};
+
+// Applies device property writes on a dedicated control thread, so USB round
+// trips never happen on the cook thread.
+// The control thread keeps a shadow of the device state and only writes the
+// properties that differ from it. Requests that arrive while a batch is still
+// pending replace it, so a slider drag collapses into its latest value.
+// Requests made with atFrameBoundary set (preset switches) are held until the
+// capture thread reaches the end of a frame, which then waits for the whole
+// batch to be written before acquiring the next one.
+// A write the device rejects leaves its property out of the shadow, and only
+// that property is queried again before the batch is retried after RETRY_MS,
+// at a frame boundary again if it was held for one. A value rejected
+// MAX_REJECTIONS times in a row is dropped: the device keeps its own value
+// and no more retries are made for it until a different value is requested
+// or the device is recreated.
+class DeviceControl
+{
+
+public:
+	static const int RETRY_MS = 500;
+	static const int MAX_REJECTIONS = 3;
+
+	DeviceControl();
+	virtual ~DeviceControl();
+
+	void start();
+	void stop();
+
+	// Called by the capture thread whenever the device is (re)created, or with
+	// nullptr while it is down. Blocks until any batch in flight has finished.
+	void setDevice(PXCCapture::Device *in_device);
+
+	// Called from the cook thread with the current parameter values
+	void request(const DeviceSettings &settings, bool atFrameBoundary = false);
+
+	// Called by the capture thread after each frame has been released
+	void frameBoundary(int64_t frame);
+
+	// The values currently dropped, as "name=value" separated by spaces, or
+	// an empty string if none are
+	std::string droppedValues();
+
+	// Telemetry
+	// Last frame captured before the latest frame-boundary batch was written
+	// to the device, -1 until it has been. Frames the SDK had already
+	// buffered may still follow it with the old settings.
+	std::atomic<int64_t> boundaryFrame{ -1 };
+	std::atomic<int32_t> batchesApplied{ 0 };
+	std::atomic<int32_t> propertiesWritten{ 0 };
+	std::atomic<int32_t> requestsCoalesced{ 0 };
+	std::atomic<int32_t> writeFailures{ 0 };
+	std::atomic<int32_t> valuesDropped{ 0 };
+
+private:
+	enum class BatchResult
+	{
+		Applied,
+		Failed,
+		NoDevice,
+	};
+
+	enum Property
+	{
+		Accuracy,
+		LaserPower,
+		FilterOption,
+		MotionTradeoff,
+		AutoExposure,
+		AutoWhiteBalance,
+		PROPERTY_COUNT,
+	};
+
+	void controlThread();
+	BatchResult applyBatch(const DeviceSettings &wanted);
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_running;
+
+	// Latest requested settings, and whether they still need applying
+	DeviceSettings m_desired;
+	bool m_hasDesired;
+	bool m_hasPending;
+	bool m_retryPending;
+	bool m_retryAtBoundary;
+
+	// Frame-boundary handshake with the capture thread
+	bool m_boundaryPending;
+	bool m_boundaryReady;
+	int64_t m_lastFrame;
+
+	// Guards the device and its shadow state
+	std::mutex m_deviceMutex;
+	PXCCapture::Device *m_device;
+	DeviceSettings m_shadow;
+	// One bit per Property to query before it is compared with the shadow
+	uint32_t m_staleProperties;
+	// Value each property last rejected and how many writes of it in a row
+	// were rejected
+	pxcI32 m_rejectedValue[PROPERTY_COUNT];
+	int m_rejections[PROPERTY_COUNT];
+
+	// Guards m_dropped, which the cook thread reads while a batch may be
+	// holding m_deviceMutex
+	std::mutex m_droppedMutex;
+	std::string m_dropped;
+
+};
+
+#endif
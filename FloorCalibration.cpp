@@ -0,0 +1,289 @@
+#include "FloorCalibration.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+static const float RADIANS = 3.14159265f / 180.0f;
+
+static inline float
+dot3(const float *a, const float *b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void
+cross3(const float *a, const float *b, float *out)
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline bool
+normalize3(float *v)
+{
+	float length = std::sqrt(dot3(v, v));
+	if (length < 1e-9f) return false;
+	v[0] /= length;
+	v[1] /= length;
+	v[2] /= length;
+	return true;
+}
+
+// Eigenvector of the smallest eigenvalue of a symmetric 3x3 matrix, by
+// cyclic Jacobi rotations
+static void
+smallestEigenvector(double a[3][3], float out[3])
+{
+	double v[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+	for (int sweep = 0; sweep < 16; sweep++) {
+		double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+		if (off < 1e-20) break;
+		for (int p = 0; p < 2; p++) {
+			for (int q = p + 1; q < 3; q++) {
+				if (std::abs(a[p][q]) < 1e-30) continue;
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+				double c = 1.0 / std::sqrt(t * t + 1.0);
+				double s = t * c;
+				for (int k = 0; k < 3; k++) {
+					double akp = a[k][p], akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < 3; k++) {
+					double apk = a[p][k], aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < 3; k++) {
+					double vkp = v[k][p], vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+
+	int smallest = 0;
+	for (int i = 1; i < 3; i++)
+		if (a[i][i] < a[smallest][smallest]) smallest = i;
+	for (int k = 0; k < 3; k++)
+		out[k] = (float)v[k][smallest];
+}
+
+FloorCalibration::FloorCalibration()
+: m_running(false), m_hasResult(false), m_worker(new ThreadPool(1))
+{
+}
+
+FloorCalibration::~FloorCalibration()
+{
+	// Let a calibration in progress finish
+	m_worker.reset();
+}
+
+bool
+FloorCalibration::start(const float *points, size_t count, const float up[3], float maxTiltDegrees, ThreadPool &pool)
+{
+	if (m_running) return false;
+
+	// Every valid point if there are few enough, otherwise an even spread
+	size_t valid = 0;
+	for (size_t i = 0; i < count; i++)
+		if (points[i * 4 + 3] > 0.0f) valid++;
+	size_t stride = std::max<size_t>(1, (valid + MAX_POINTS - 1) / MAX_POINTS);
+
+	m_points.clear();
+	for (size_t i = 0, n = 0; i < count; i++) {
+		const float *p = points + i * 4;
+		if (p[3] <= 0.0f || n++ % stride != 0) continue;
+		m_points.insert(m_points.end(), p, p + 3);
+	}
+
+	m_running = true;
+	float hint[3] = { up[0], up[1], up[2] };
+	m_worker->enqueue([this, hint, maxTiltDegrees, &pool] { run(hint, maxTiltDegrees, pool); });
+	return true;
+}
+
+void
+FloorCalibration::run(const float up[3], float maxTiltDegrees, ThreadPool &pool)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	FloorPlane plane;
+	bool found = fit(m_points, up, maxTiltDegrees, plane, pool);
+
+	lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	runs++;
+	if (found) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_result = plane;
+		m_hasResult = true;
+		printf("Floor found %.3fm below the camera, pitch %.1f, roll %.1f, %d of %d points\n",
+			plane.distance, plane.pitch, plane.roll, plane.inliers, plane.points);
+	}
+	else {
+		failures++;
+		printf("No floor found\n");
+	}
+	m_running = false;
+}
+
+bool
+FloorCalibration::result(FloorPlane &plane) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_hasResult) plane = m_result;
+	return m_hasResult;
+}
+
+bool
+FloorCalibration::fit(const std::vector<float> &points, const float up[3], float maxTiltDegrees, FloorPlane &plane,
+	ThreadPool &pool)
+{
+	const int count = (int)(points.size() / 3);
+	if (count < 3) return false;
+
+	float hint[3] = { up[0], up[1], up[2] };
+	if (!normalize3(hint)) return false;
+	const float minCos = std::cos(maxTiltDegrees * RADIANS);
+	const float *p = points.data();
+
+	// RANSAC. Each chunk of hypotheses has its own random sequence and best
+	// plane, merged under the lock once per chunk.
+	struct Candidate
+	{
+		int score = -1;
+		float normal[3];
+		float distance;
+	};
+	Candidate best;
+	std::mutex bestMutex;
+
+	pool.parallelFor(HYPOTHESES, [&](int begin, int end) {
+		uint32_t state = 0x9E3779B9u * (uint32_t)(begin + 1);
+		auto random = [&state, count]() {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return (int)(state % (uint32_t)count);
+		};
+
+		Candidate local;
+		for (int h = begin; h < end; h++) {
+			const float *a = p + random() * 3;
+			const float *b = p + random() * 3;
+			const float *c = p + random() * 3;
+			float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			float n[3];
+			cross3(ab, ac, n);
+			if (!normalize3(n)) continue;
+
+			float facing = dot3(n, hint);
+			if (facing < 0.0f) {
+				n[0] = -n[0]; n[1] = -n[1]; n[2] = -n[2];
+				facing = -facing;
+			}
+			if (facing < minCos) continue;
+
+			float d = -dot3(n, a);
+			int score = 0;
+			for (int i = 0; i < count; i++)
+				if (std::abs(dot3(n, p + i * 3) + d) < INLIER_DISTANCE) score++;
+
+			if (score > local.score) {
+				local.score = score;
+				std::copy(n, n + 3, local.normal);
+				local.distance = d;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(bestMutex);
+		if (local.score > best.score) best = local;
+	}, 16);
+
+	if (best.score < 3) return false;
+
+	// Least squares on the inliers: the plane through their centroid,
+	// normal to the direction they vary least in. Repeated as the inlier
+	// set settles.
+	float n[3] = { best.normal[0], best.normal[1], best.normal[2] };
+	float d = best.distance;
+	int inliers = 0;
+	double sumSquares = 0.0;
+	for (int iteration = 0; iteration < 3; iteration++) {
+		double centroid[3] = { 0, 0, 0 };
+		inliers = 0;
+		for (int i = 0; i < count; i++) {
+			const float *q = p + i * 3;
+			if (std::abs(dot3(n, q) + d) >= INLIER_DISTANCE) continue;
+			centroid[0] += q[0]; centroid[1] += q[1]; centroid[2] += q[2];
+			inliers++;
+		}
+		if (inliers < 3) return false;
+		for (int k = 0; k < 3; k++) centroid[k] /= inliers;
+
+		double covariance[3][3] = {};
+		for (int i = 0; i < count; i++) {
+			const float *q = p + i * 3;
+			if (std::abs(dot3(n, q) + d) >= INLIER_DISTANCE) continue;
+			double e[3] = { q[0] - centroid[0], q[1] - centroid[1], q[2] - centroid[2] };
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 3; c++)
+					covariance[r][c] += e[r] * e[c];
+		}
+
+		float refined[3];
+		smallestEigenvector(covariance, refined);
+		if (!normalize3(refined)) break;
+		if (dot3(refined, hint) < 0.0f) {
+			refined[0] = -refined[0]; refined[1] = -refined[1]; refined[2] = -refined[2];
+		}
+		std::copy(refined, refined + 3, n);
+		float c[3] = { (float)centroid[0], (float)centroid[1], (float)centroid[2] };
+		d = -dot3(n, c);
+	}
+
+	inliers = 0;
+	sumSquares = 0.0;
+	for (int i = 0; i < count; i++) {
+		float e = dot3(n, p + i * 3) + d;
+		if (std::abs(e) >= INLIER_DISTANCE) continue;
+		sumSquares += e * e;
+		inliers++;
+	}
+
+	std::copy(n, n + 3, plane.normal);
+	plane.distance = d;
+	plane.inliers = inliers;
+	plane.points = count;
+	plane.rms = inliers > 0 ? (float)std::sqrt(sumSquares / inliers) : 0.0f;
+
+	// The camera looks down -z with x to its right
+	plane.pitch = std::asin(std::max(-1.0f, std::min(1.0f, -n[2]))) / RADIANS;
+	plane.roll = std::asin(std::max(-1.0f, std::min(1.0f, n[0]))) / RADIANS;
+
+	// Floor axes in camera space: y is the normal, x the camera's right
+	// flattened onto the floor, z completes a right-handed frame. The
+	// origin is the point on the floor straight below the camera.
+	float x[3] = { 1.0f - n[0] * n[0], -n[0] * n[1], -n[0] * n[2] };
+	if (!normalize3(x)) {
+		x[0] = 0.0f; x[1] = -n[2]; x[2] = n[1];
+		normalize3(x);
+	}
+	float z[3];
+	cross3(x, n, z);
+
+	Matrix floorToCamera;
+	for (int k = 0; k < 3; k++) {
+		floorToCamera[0 + k] = x[k];
+		floorToCamera[4 + k] = n[k];
+		floorToCamera[8 + k] = z[k];
+		floorToCamera[12 + k] = -d * n[k];
+	}
+	return floorToCamera.inverse(plane.cameraToFloor);
+}
@@ -0,0 +1,82 @@
+#ifndef FloorCalibration_h
+#define FloorCalibration_h
+
+#include "Matrix.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Floor plane found by FloorCalibration, in camera space: points p on the
+// floor satisfy dot(normal, p) + distance = 0, with normal pointing up
+// towards the camera.
+struct FloorPlane
+{
+	float normal[3] = { 0.0f, 1.0f, 0.0f };
+	float distance = 0.0f;			// camera height above the floor, metres
+
+	int32_t inliers = 0;
+	int32_t points = 0;
+	float rms = 0.0f;				// of the inliers' distances, metres
+	float pitch = 0.0f;				// camera tilt, degrees, negative looking down
+	float roll = 0.0f;				// degrees
+
+	// Floor coordinates: origin on the floor below the camera, y up, x along
+	// the camera's right, in metres
+	Matrix cameraToFloor;
+};
+
+// Finds the floor in a camera-space point cloud and derives the camera's
+// pose from it. start() copies a subsample of the points and returns; a
+// background worker runs RANSAC plane fitting, with the hypotheses spread
+// over a thread pool, then refines the best plane by least squares on its
+// inliers. Capture and cook never wait for it.
+class FloorCalibration
+{
+
+public:
+	FloorCalibration();
+	virtual ~FloorCalibration();
+
+	// points are xyzw, w = 0 for pixels without depth. up is the expected
+	// floor normal in camera space; planes tilted more than maxTilt degrees
+	// from it are ignored, so walls and tables aren't taken for the floor.
+	// Returns false if a calibration is still running. The fit runs on pool,
+	// which must outlive the calibration.
+	bool start(const float *points, size_t count, const float up[3], float maxTiltDegrees, ThreadPool &pool);
+	bool isRunning() const { return m_running; }
+
+	// Copies the last result, false if there is none
+	bool result(FloorPlane &plane) const;
+
+	// Telemetry
+	std::atomic<int32_t> runs{ 0 };
+	std::atomic<int32_t> failures{ 0 };
+	std::atomic<double> lastMs{ 0.0 };
+
+	// Points kept from the cloud, hypotheses tried, and the inlier band
+	static const int MAX_POINTS = 40000;
+	static const int HYPOTHESES = 1024;
+	const float INLIER_DISTANCE = 0.02f;
+
+	// The fit itself, run on the calling thread with help from the pool.
+	// points are packed xyz.
+	bool fit(const std::vector<float> &points, const float up[3], float maxTiltDegrees, FloorPlane &plane, ThreadPool &pool);
+
+private:
+	void run(const float up[3], float maxTiltDegrees, ThreadPool &pool);
+
+	std::vector<float> m_points;		// xyz, owned by the worker while running
+	std::atomic<bool> m_running;
+
+	mutable std::mutex m_mutex;
+	bool m_hasResult;
+	FloorPlane m_result;
+
+	std::unique_ptr<ThreadPool> m_worker;
+
+};
+
+#endif
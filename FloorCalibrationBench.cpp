@@ -0,0 +1,179 @@
+// Accuracy and speed of FloorCalibration on synthetic point clouds with a
+// known floor. Not part of the plugin; build it on its own:
+//
+//	g++ -O2 -std=c++14 FloorCalibrationBench.cpp FloorCalibration.cpp
+//		ThreadPool.cpp Matrix.cpp -lpthread -o FloorCalibrationBench
+//
+// Matrix.h includes TouchDesigner's headers, so use the plugin's include
+// paths.
+//
+// Each cloud is a 640 x 480 frame of camera-space points: the floor, seen
+// from a known height, pitch and roll, with some noise, plus a wall facing
+// the camera, points scattered through the room and pixels with no depth.
+// The floor is calibrated as SenseTOP does it, with the expected up
+// direction a few degrees off, and the fitted normal and height compared
+// with the true ones. Returns 0 if every fit is within tolerance.
+
+#include "FloorCalibration.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+static const int WIDTH = 640;
+static const int HEIGHT = 480;
+
+// Share of the frame on the floor, on the wall, scattered, and with no
+// depth; the rest
+static const float FLOOR_SHARE = 0.5f;
+static const float WALL_SHARE = 0.2f;
+static const float SCATTERED_SHARE = 0.2f;
+
+// Standard deviation of the floor and wall points, metres
+static const float NOISE = 0.005f;
+
+// Error allowed in the normal, degrees, and in the height, metres
+static const float MAX_ANGLE_ERROR = 1.0f;
+static const float MAX_HEIGHT_ERROR = 0.01f;
+
+static const float RADIANS = 3.14159265f / 180.0f;
+
+struct Setup
+{
+	float height;		// metres
+	float pitch;		// degrees, negative looking down
+	float roll;			// degrees
+};
+
+static void
+cross(const float a[3], const float b[3], float out[3])
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static void
+normalize(float v[3])
+{
+	float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	for (int i = 0; i < 3; i++)
+		v[i] /= length;
+}
+
+// Floor normal in camera space for a camera with this pitch and roll. The
+// camera looks down -z with y up.
+static void
+floorNormal(float pitch, float roll, float n[3])
+{
+	float p = pitch * RADIANS, r = roll * RADIANS;
+	n[0] = std::sin(r);
+	n[1] = std::cos(r) * std::cos(p);
+	n[2] = -std::cos(r) * std::sin(p);
+	normalize(n);
+}
+
+// xyzw points, w = 0 where there is no depth
+static void
+buildCloud(const Setup &setup, std::mt19937 &random, std::vector<float> &points, float n[3])
+{
+	floorNormal(setup.pitch, setup.roll, n);
+
+	// Two directions along the floor, one of them heading away from the
+	// camera, and the wall facing back along it 4 m out
+	float side[3], ahead[3], forward[3] = { 0.0f, 0.0f, -1.0f };
+	cross(forward, n, side);
+	normalize(side);
+	cross(n, side, ahead);
+	normalize(ahead);
+
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::normal_distribution<float> noise(0.0f, NOISE);
+	const size_t count = (size_t)WIDTH * HEIGHT;
+	points.assign(count * 4, 0.0f);
+	for (size_t i = 0; i < count; i++) {
+		float *p = &points[i * 4];
+		float kind = uniform(random), a = uniform(random), b = uniform(random);
+		float offset[3];
+		if (kind < FLOOR_SHARE) {
+			// Within 4 m ahead and 2 m either side
+			float u = (a - 0.5f) * 4.0f, v = 0.5f + b * 3.5f, e = noise(random);
+			for (int c = 0; c < 3; c++)
+				offset[c] = -setup.height * n[c] + u * side[c] + v * ahead[c] + e * n[c];
+		}
+		else if (kind < FLOOR_SHARE + WALL_SHARE) {
+			// Up to 2.5 m high
+			float u = (a - 0.5f) * 4.0f, h = b * 2.5f, e = noise(random);
+			for (int c = 0; c < 3; c++)
+				offset[c] = -setup.height * n[c] + u * side[c] + (4.0f + e) * ahead[c] + h * n[c];
+		}
+		else if (kind < FLOOR_SHARE + WALL_SHARE + SCATTERED_SHARE) {
+			float u = (a - 0.5f) * 4.0f, h = uniform(random) * 2.5f;
+			for (int c = 0; c < 3; c++)
+				offset[c] = -setup.height * n[c] + u * side[c] + (0.5f + b * 3.5f) * ahead[c] + h * n[c];
+		}
+		else {
+			continue;
+		}
+		p[0] = offset[0];
+		p[1] = offset[1];
+		p[2] = offset[2];
+		p[3] = 1.0f;
+	}
+}
+
+int
+main()
+{
+	const Setup setups[] = {
+		{ 1.5f, -30.0f, 0.0f },
+		{ 2.5f, -45.0f, 5.0f },
+		{ 1.0f, -15.0f, -10.0f },
+		{ 3.0f, -60.0f, 2.0f },
+	};
+
+	std::mt19937 random(1);
+	std::vector<float> points;
+	FloorCalibration floor;
+	ThreadPool pool;
+	bool ok = true;
+	for (const Setup &setup : setups) {
+		float n[3];
+		buildCloud(setup, random, points, n);
+
+		// The expected up direction, as if the camera transform were a few
+		// degrees out
+		float up[3];
+		floorNormal(setup.pitch + 4.0f, setup.roll - 3.0f, up);
+
+		auto start = std::chrono::steady_clock::now();
+		if (!floor.start(points.data(), points.size() / 4, up, 20.0f, pool)) {
+			fprintf(stderr, "A calibration is already running\n");
+			return 1;
+		}
+		double startMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		while (floor.isRunning())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		FloorPlane plane;
+		if (!floor.result(plane)) {
+			printf("Height %.1f m, pitch %.0f, roll %.0f: no floor found\n", setup.height, setup.pitch, setup.roll);
+			ok = false;
+			continue;
+		}
+		float between[3];
+		cross(plane.normal, n, between);
+		float dot = plane.normal[0] * n[0] + plane.normal[1] * n[1] + plane.normal[2] * n[2];
+		float angleError = std::atan2(std::sqrt(between[0] * between[0] + between[1] * between[1] +
+			between[2] * between[2]), dot) / RADIANS;
+		float heightError = std::fabs(plane.distance - setup.height);
+		printf("Height %.1f m, pitch %.0f, roll %.0f: normal within %.3f degrees, height within %.1f mm, "
+			"%d of %d points, %.1f ms fitting (%.2f ms to start)\n", setup.height, setup.pitch, setup.roll,
+			angleError, heightError * 1e3, plane.inliers, plane.points, (double)floor.lastMs, startMs);
+		ok = ok && angleError <= MAX_ANGLE_ERROR && heightError <= MAX_HEIGHT_ERROR;
+	}
+
+	printf("%s\n", ok ? "Passed" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#ifndef FrameRing_h
+#define FrameRing_h
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Lock-free single-producer single-consumer ring of preallocated slots.
+// The producer fills a slot in place between beginWrite() and commitWrite();
+// the consumer reads slots in place with peek() and hands them back with
+// pop(). Neither side ever blocks or allocates.
+template <typename T>
+class FrameRing
+{
+
+public:
+	explicit FrameRing(size_t capacity) : m_slots(capacity), m_capacity(capacity) {}
+
+	size_t capacity() const { return m_capacity; }
+
+	// Producer: returns the next free slot, or nullptr if limit slots (at
+	// most capacity()) are already queued
+	T* beginWrite(size_t limit)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		size_t tail = m_tail.load(std::memory_order_acquire);
+		if (limit > m_capacity) limit = m_capacity;
+		if (head - tail >= limit) return nullptr;
+		return &m_slots[head % m_capacity];
+	}
+
+	// Producer: publishes the slot returned by beginWrite()
+	void commitWrite()
+	{
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer: number of queued slots
+	size_t size() const
+	{
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_relaxed);
+	}
+
+	// Consumer: i-th queued slot, oldest first. i must be less than size().
+	T* peek(size_t i)
+	{
+		return &m_slots[(m_tail.load(std::memory_order_relaxed) + i) % m_capacity];
+	}
+
+	// Consumer: releases the n oldest slots back to the producer
+	void pop(size_t n = 1)
+	{
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+	}
+
+	// Access to every slot, for preallocating them before the producer starts
+	std::vector<T>& slots() { return m_slots; }
+
+private:
+	std::vector<T> m_slots;
+	size_t m_capacity;
+
+	// Padded onto separate cache lines so the two threads don't contend.
+	// Padding rather than alignas, since the ring lives inside heap-allocated
+	// objects that plain operator new doesn't over-align.
+	char m_pad0[64];
+	std::atomic<size_t> m_head{ 0 };
+	char m_pad1[64];
+	std::atomic<size_t> m_tail{ 0 };
+	char m_pad2[64];
+
+};
+
+#endif
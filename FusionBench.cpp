@@ -0,0 +1,149 @@
+// Speed of heightmap fusion with four other cameras, against the size of the
+// processing pool. Not part of the plugin; build it on its own:
+//
+//	g++ -O2 -std=c++14 FusionBench.cpp FusionCamera.cpp Heightmap.cpp
+//		CameraCalibration.cpp NetworkDepthSource.cpp SyntheticDepthSource.cpp
+//		TcpSocket.cpp DepthCodec.cpp DepthPyramid.cpp Deprojection.cpp
+//		Matrix.cpp ThreadPool.cpp -lpthread -o FusionBench
+//
+// FusionCamera.h includes UiHelper.h, and with it TouchDesigner's and the
+// RealSense SDK's headers, so use the plugin's include paths.
+//
+//	FusionBench [seconds]
+//
+// Four FusionCameras read synthetic sources at 30 fps, each placed by its
+// own calibration file: 1.5 m up in the middle of the grid, facing a
+// different way and tilted down. The cook's part runs as SenseTOP runs it,
+// 30 times a second: this TOP's own synthetic frame is projected and the
+// newest layer of every camera fused with it by Heightmap::project(). That
+// is timed for each pool size from one thread up to the number of cores,
+// along with the rate each camera kept. Returns 0 if every frame set fused
+// all four layers.
+
+#include "FusionCamera.h"
+#include "SyntheticDepthSource.h"
+#include "SteadyClock.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+static const int WIDTH = 640;
+static const int HEIGHT = 480;
+static const int CAMERAS = 4;
+static const double COOK_FPS = 30.0;
+
+// Camera 1.5 m up at the middle of the default grid, turned yaw degrees
+// about y and tilted 30 degrees down
+static Matrix
+cameraPose(double yaw)
+{
+	double y = yaw * 3.14159265 / 180.0, p = -30.0 * 3.14159265 / 180.0;
+	double rows[4][4] = {
+		{ std::cos(y), std::sin(y) * std::sin(p), std::sin(y) * std::cos(p), 0.0 },
+		{ 0.0, std::cos(p), -std::sin(p), 1.5 },
+		{ -std::sin(y), std::cos(y) * std::sin(p), std::cos(y) * std::cos(p), -3.0 },
+		{ 0.0, 0.0, 0.0, 1.0 },
+	};
+	return Matrix::fromRows(rows);
+}
+
+int
+main(int argc, char **argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 5.0;
+
+	// The other cameras, each with its calibration file
+	HeightmapSettings grid;
+	std::vector<std::unique_ptr<FusionCamera> > cameras;
+	std::vector<std::string> paths;
+	for (int i = 0; i < CAMERAS; i++) {
+		CameraCalibration calibration;
+		calibration.cameraToWorld = cameraPose(90.0 * i);
+		paths.push_back("FusionBench" + std::to_string(i) + ".txt");
+		if (!calibration.save(paths.back().c_str())) {
+			fprintf(stderr, "Could not write %s\n", paths.back().c_str());
+			return 1;
+		}
+		FusionCameraSettings settings;
+		settings.source.type = DepthSourceType::Synthetic;
+		settings.calibrationPath = paths.back();
+		cameras.emplace_back(new FusionCamera(settings, WIDTH, HEIGHT));
+		cameras.back()->configure(grid);
+	}
+
+	// This TOP's own camera, looking along the grid from its near edge
+	SyntheticDepthSource scene(WIDTH, HEIGHT, COOK_FPS);
+	std::vector<uint16_t> raw;
+	scene.render(0, raw);
+	std::vector<float> depth(raw.begin(), raw.end()), cameraPoints(WIDTH * HEIGHT * 4), worldPoints(WIDTH * HEIGHT * 4);
+	deprojectDepth(depth.data(), WIDTH, HEIGHT, scene.intrinsics(), cameraPoints.data());
+	cameraPose(0.0).transformPoints(cameraPoints.data(), worldPoints.data(), WIDTH * HEIGHT);
+
+	// Wait for every camera's first layer
+	std::vector<const HeightmapLayer*> layers(CAMERAS, nullptr);
+	double start = steadySeconds();
+	while (std::count(layers.begin(), layers.end(), nullptr) > 0 && steadySeconds() - start < 5.0) {
+		for (int i = 0; i < CAMERAS; i++)
+			if (!layers[i]) layers[i] = cameras[i]->latest();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	std::vector<int> poolSizes;
+	int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int threads = 1; threads < cores; threads *= 2)
+		poolSizes.push_back(threads);
+	poolSizes.push_back(cores);
+
+	Heightmap heightmap;
+	heightmap.configure(grid);
+	bool ok = std::count(layers.begin(), layers.end(), nullptr) == 0;
+	for (int threads : poolSizes) {
+		ThreadPool pool(threads);
+		std::vector<int64_t> framesBefore;
+		for (const auto &camera : cameras)
+			framesBefore.push_back(camera->frames);
+
+		int sets = 0, incomplete = 0;
+		double fuseMs = 0.0, worstMs = 0.0;
+		start = steadySeconds();
+		while (steadySeconds() - start < seconds) {
+			double due = start + sets / COOK_FPS;
+			while (steadySeconds() < due)
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+			std::vector<const HeightmapLayer*> current;
+			for (const auto &camera : cameras) {
+				const HeightmapLayer *layer = camera->latest();
+				if (layer && camera->connected) current.push_back(layer);
+			}
+			double before = steadySeconds();
+			heightmap.project(worldPoints.data(), WIDTH * HEIGHT, before, current, pool);
+			double ms = (steadySeconds() - before) * 1e3;
+			fuseMs += ms;
+			worstMs = std::max(worstMs, ms);
+			if (heightmap.layersFused != CAMERAS) incomplete++;
+			sets++;
+		}
+		double elapsed = steadySeconds() - start;
+
+		printf("Pool of %d: %.2f ms a frame set (worst %.2f ms), %d of %d sets missing a layer; cameras at", threads,
+			fuseMs / sets, worstMs, incomplete, sets);
+		double projectMs = 0.0;
+		for (size_t i = 0; i < cameras.size(); i++) {
+			printf(" %.1f", (cameras[i]->frames - framesBefore[i]) / elapsed);
+			projectMs += cameras[i]->projectMs;
+		}
+		printf(" fps, %.2f ms projecting each frame\n", projectMs / cameras.size());
+		ok = ok && incomplete == 0;
+	}
+
+	cameras.clear();
+	for (const std::string &path : paths)
+		remove(path.c_str());
+
+	printf("%s\n", ok ? "Passed" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+#include "FusionCamera.h"
+#include "NetworkDepthSource.h"
+#include "SyntheticDepthSource.h"
+#include "SteadyClock.h"
+#include <chrono>
+#include <cstring>
+
+// Rate of synthetic fusion cameras, and the field of view assumed for
+// sources that don't report intrinsics
+static const double FUSION_SYNTHETIC_FPS = 30.0;
+static const float FUSION_DEFAULT_FOV = 70.0f;
+
+FusionCamera::FusionCamera(const FusionCameraSettings &settings, int width, int height)
+: m_settings(settings), m_width(width), m_height(height), m_workerVersion(-1),
+	m_clockOffset(0.0), m_clockSynced(false), m_hasLayer(false), m_running(true)
+{
+	m_cameraPoints.resize(width * height * 4);
+	m_worldPoints.resize(width * height * 4);
+	m_thread = std::thread(&FusionCamera::workerThread, this);
+}
+
+FusionCamera::~FusionCamera()
+{
+	m_running = false;
+	m_stopCv.notify_all();
+	m_thread.join();
+}
+
+void
+FusionCamera::configure(const HeightmapSettings &grid)
+{
+	std::lock_guard<std::mutex> lock(m_gridMutex);
+	if (grid == m_grid) return;
+	m_grid = grid;
+	m_gridVersion++;
+}
+
+const HeightmapLayer*
+FusionCamera::latest()
+{
+	if (m_layers.update()) m_hasLayer = true;
+	return m_hasLayer ? &m_layers.front() : nullptr;
+}
+
+// Sleeps for ms, returns false if the camera is being destroyed
+bool
+FusionCamera::waitFor(int ms)
+{
+	std::unique_lock<std::mutex> lock(m_stopMutex);
+	return !m_stopCv.wait_for(lock, std::chrono::milliseconds(ms), [this] { return !m_running; });
+}
+
+void
+FusionCamera::workerThread()
+{
+	const SourceSettings &source = m_settings.source;
+	DepthFrame frame;
+
+	while (m_running) {
+		if (!m_source) {
+			if (source.type == DepthSourceType::Network)
+				m_source.reset(new NetworkDepthSource(source.host, source.port));
+			else
+				m_source.reset(new SyntheticDepthSource(m_width, m_height, FUSION_SYNTHETIC_FPS));
+
+			if (!m_source->open()) {
+				m_source.reset();
+				if (!waitFor(RETRY_MS)) break;
+				continue;
+			}
+
+			// Calibration is reread on every connect, so it can be edited
+			// without reloading the fusion file
+			m_calibration.load(m_settings.calibrationPath.c_str());
+			m_intrinsics = m_calibration.intrinsics;
+			if (!m_intrinsics.isValid()) m_intrinsics = m_source->intrinsics();
+			if (!m_intrinsics.isValid()) m_intrinsics = DepthIntrinsics::fromFieldOfView(m_width, m_height, FUSION_DEFAULT_FOV);
+			m_clockSynced = false;
+			connected = true;
+			printf("Fusion camera %s connected\n", m_settings.calibrationPath.c_str());
+		}
+
+		DepthSourceResult result = m_source->read(frame, READ_TIMEOUT_MS);
+		if (result == DepthSourceResult::Timeout) continue;
+		if (result == DepthSourceResult::Lost || frame.width != m_width || frame.height != m_height) {
+			printf("Fusion camera %s lost\n", m_settings.calibrationPath.c_str());
+			m_source->close();
+			m_source.reset();
+			connected = false;
+			if (!waitFor(RETRY_MS)) break;
+			continue;
+		}
+
+		// Same mapping from device to host clock as the main capture thread
+		double arrival = steadySeconds() - frame.deviceTime * 1e-7;
+		if (!m_clockSynced || arrival < m_clockOffset) {
+			m_clockOffset = arrival;
+			m_clockSynced = true;
+		}
+		project(frame, frame.deviceTime * 1e-7 + m_clockOffset);
+	}
+
+	if (m_source) m_source->close();
+	connected = false;
+}
+
+void
+FusionCamera::project(const DepthFrame &frame, double time)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	if (m_gridVersion != m_workerVersion) {
+		std::lock_guard<std::mutex> lock(m_gridMutex);
+		m_workerGrid = m_grid;
+		m_workerVersion = m_gridVersion;
+	}
+
+	deprojectDepth(frame.depth.data(), m_width, m_height, m_intrinsics, m_cameraPoints.data());
+	m_calibration.cameraToWorld.transformPoints(m_cameraPoints.data(), m_worldPoints.data(), m_width * m_height);
+
+	HeightmapLayer &layer = m_layers.back();
+	size_t cells = (size_t)m_workerGrid.width * m_workerGrid.height;
+	if (layer.cells.size() != cells)
+		layer.cells.resize(cells);
+	memset(layer.cells.data(), 0, cells * sizeof(float));
+	scatterHeightmap(m_workerGrid, m_worldPoints.data(), 0, m_width * m_height, layer.cells.data());
+	layer.settings = m_workerGrid;
+	layer.time = time;
+	m_layers.publish();
+
+	frames++;
+	projectMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
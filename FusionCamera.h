@@ -0,0 +1,81 @@
+#ifndef FusionCamera_h
+#define FusionCamera_h
+
+#include "UiHelper.h"
+#include "DepthSource.h"
+#include "Heightmap.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One more camera fused into the heightmap. It has its own worker thread,
+// which reads the camera's source, deprojects and places each frame with the
+// camera's calibration, and scatters it into a heightmap layer. Finished
+// layers are handed to the cook through a lock-free triple buffer, so the
+// cameras never wait on the cook or on each other.
+class FusionCamera
+{
+
+public:
+	FusionCamera(const FusionCameraSettings &settings, int width, int height);
+	virtual ~FusionCamera();
+
+	const FusionCameraSettings& settings() const { return m_settings; }
+
+	// Cook thread. Grid the following frames are projected into.
+	void configure(const HeightmapSettings &grid);
+
+	// Cook thread. The newest layer, or nullptr while the camera has none.
+	// Valid until the next call.
+	const HeightmapLayer* latest();
+	bool hasUpdate() const { return m_layers.hasUpdate(); }
+
+	// Telemetry
+	std::atomic<bool> connected{ false };
+	std::atomic<int64_t> frames{ 0 };
+	std::atomic<double> projectMs{ 0.0 };
+
+	// Reconnect wait, and how long read() may block
+	const int RETRY_MS = 1000;
+	const int READ_TIMEOUT_MS = 100;
+
+private:
+	void workerThread();
+	bool waitFor(int ms);
+	void project(const DepthFrame &frame, double time);
+
+	FusionCameraSettings m_settings;
+	int m_width;
+	int m_height;
+
+	// Written by the cook, picked up by the worker when the version changes
+	std::mutex m_gridMutex;
+	HeightmapSettings m_grid;
+	std::atomic<int32_t> m_gridVersion{ 0 };
+
+	// Only used by the worker
+	std::unique_ptr<DepthSource> m_source;
+	CameraCalibration m_calibration;
+	DepthIntrinsics m_intrinsics;
+	HeightmapSettings m_workerGrid;
+	int32_t m_workerVersion;
+	std::vector<float> m_cameraPoints;
+	std::vector<float> m_worldPoints;
+	double m_clockOffset;
+	bool m_clockSynced;
+
+	TripleBuffer<HeightmapLayer> m_layers;
+	bool m_hasLayer;
+
+	std::atomic<bool> m_running;
+	std::mutex m_stopMutex;
+	std::condition_variable m_stopCv;
+	std::thread m_thread;
+
+};
+
+#endif
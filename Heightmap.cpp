@@ -0,0 +1,121 @@
+#include "Heightmap.h"
+#include "SteadyClock.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+void
+scatterHeightmap(const HeightmapSettings &s, const float *points, size_t begin, size_t end, float *grid)
+{
+	float scaleX = s.width / (s.maxX - s.minX);
+	float scaleZ = s.height / (s.maxZ - s.minZ);
+	bool count = s.value == HeightmapValue::Count;
+
+	for (size_t i = begin; i < end; i++) {
+		const float *p = points + i * 4;
+		if (p[3] <= 0.0f || p[1] < s.minY || p[1] > s.maxY) continue;
+
+		// Negated comparisons so NaN bounds drop the point too
+		float u = (p[0] - s.minX) * scaleX;
+		float v = (s.maxZ - p[2]) * scaleZ;
+		if (!(u >= 0.0f && u < s.width && v >= 0.0f && v < s.height)) continue;
+
+		float &cell = grid[(int)v * s.width + (int)u];
+		if (count)
+			cell += 1.0f;
+		else
+			cell = std::max(cell, p[1]);
+	}
+}
+
+Heightmap::Heightmap()
+{
+	configure(m_settings);
+}
+
+Heightmap::~Heightmap()
+{
+}
+
+void
+Heightmap::configure(const HeightmapSettings &settings)
+{
+	m_settings = settings;
+	size_t cells = (size_t)std::max(1, settings.width) * std::max(1, settings.height);
+	if (m_lastSeen.size() == cells) return;
+
+	m_texels.assign(cells * 2, 0.0f);
+	m_lastSeen.assign(cells, -1.0);
+}
+
+void
+Heightmap::project(const float *points, size_t count, double time, const std::vector<const HeightmapLayer*> &layers,
+					ThreadPool &pool)
+{
+	auto start = std::chrono::steady_clock::now();
+	double now = steadySeconds();
+
+	m_partials.resize(pool.slices());
+	pool.parallelSlices(count, [&](int slice, size_t begin, size_t end) {
+		std::vector<float> &partial = m_partials[slice];
+		partial.assign(m_lastSeen.size(), 0.0f);
+		scatterHeightmap(m_settings, points, begin, end, partial.data());
+	});
+
+	m_layers.clear();
+	for (const HeightmapLayer *layer : layers)
+		if (layer && layer->settings == m_settings) m_layers.push_back(layer);
+	layersFused = (int32_t)m_layers.size();
+
+	occupiedCells = 0;
+	pool.parallelFor(m_settings.height, [this, time, now](int begin, int end) { reduce(begin, end, time, now); }, 8);
+
+	lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Empty cells are 0 in every partial and layer, so max and sum both combine
+// them as is. Rows are independent, and each grid is only read here, so the
+// layers need no locking while their cameras fill the next ones.
+void
+Heightmap::reduce(int rowBegin, int rowEnd, double time, double now)
+{
+	int width = m_settings.width;
+	bool count = m_settings.value == HeightmapValue::Count;
+	int32_t occupied = 0;
+	std::vector<float> row(width);
+
+	for (int y = rowBegin; y < rowEnd; y++) {
+		size_t first = (size_t)y * width;
+		double *lastSeen = &m_lastSeen[first];
+
+		memcpy(row.data(), &m_partials[0][first], width * sizeof(float));
+		for (size_t s = 1; s < m_partials.size(); s++) {
+			const float *in = &m_partials[s][first];
+			if (count) {
+				for (int x = 0; x < width; x++) row[x] += in[x];
+			}
+			else {
+				for (int x = 0; x < width; x++) row[x] = std::max(row[x], in[x]);
+			}
+		}
+		for (int x = 0; x < width; x++)
+			if (row[x] > 0.0f) lastSeen[x] = std::max(lastSeen[x], time);
+
+		for (const HeightmapLayer *layer : m_layers) {
+			const float *in = &layer->cells[first];
+			for (int x = 0; x < width; x++) {
+				if (in[x] <= 0.0f) continue;
+				row[x] = count ? row[x] + in[x] : std::max(row[x], in[x]);
+				lastSeen[x] = std::max(lastSeen[x], layer->time);
+			}
+		}
+
+		float *out = &m_texels[first * 2];
+		for (int x = 0; x < width; x++) {
+			if (row[x] > 0.0f) occupied++;
+			out[x * 2] = row[x];
+			out[x * 2 + 1] = lastSeen[x] < 0.0 ? -1.0f : (float)std::max(0.0, now - lastSeen[x]);
+		}
+	}
+	occupiedCells += occupied;
+}
@@ -0,0 +1,93 @@
+#ifndef Heightmap_h
+#define Heightmap_h
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <vector>
+
+// What each heightmap cell holds
+enum class HeightmapValue : int32_t
+{
+	MaxHeight = 0,		// highest point in the cell, metres, 0 if empty
+	Count,				// number of points in the cell
+};
+
+// Floor area covered by the heightmap, in world coordinates. Rows run from
+// maxZ (row 0, nearest a camera looking down -z) to minZ, columns from minX
+// to maxX. Points outside minY..maxY are ignored, so the floor itself and
+// the ceiling can be left out.
+struct HeightmapSettings
+{
+	int32_t width = 256;
+	int32_t height = 256;
+	float minX = -3.0f;
+	float maxX = 3.0f;
+	float minZ = -6.0f;
+	float maxZ = 0.0f;
+	float minY = 0.05f;
+	float maxY = 3.0f;
+	HeightmapValue value = HeightmapValue::MaxHeight;
+
+	bool operator==(const HeightmapSettings &o) const
+	{
+		return width == o.width && height == o.height && minX == o.minX && maxX == o.maxX &&
+			minZ == o.minZ && maxZ == o.maxZ && minY == o.minY && maxY == o.maxY && value == o.value;
+	}
+	bool operator!=(const HeightmapSettings &o) const { return !(*this == o); }
+};
+
+// Grid projected by another camera, fused into the heightmap as it is.
+// time is when its frame was captured, on the steady clock.
+struct HeightmapLayer
+{
+	HeightmapSettings settings;
+	std::vector<float> cells;
+	double time = 0.0;
+};
+
+// Scatters points [begin, end) into grid, which must be zeroed first
+void scatterHeightmap(const HeightmapSettings &settings, const float *points, size_t begin, size_t end, float *grid);
+
+// Top-down projection of world-space points onto a floor grid.
+// The points are split into one slice per thread, and each slice is scattered
+// into its own partial grid, so the inner loop is plain loads and stores.
+// The partial grids, and the layers of any other cameras, are then reduced
+// cell by cell, again spread over the pool. Each cell also remembers when it
+// was last occupied. Cook thread only.
+class Heightmap
+{
+
+public:
+	Heightmap();
+	virtual ~Heightmap();
+
+	// Reallocates the grids when the size changes
+	void configure(const HeightmapSettings &settings);
+	const HeightmapSettings& settings() const { return m_settings; }
+
+	// points are xyzw, w = 0 for pixels without depth, captured at time.
+	// Layers that don't match settings() are skipped.
+	void project(const float *points, size_t count, double time, const std::vector<const HeightmapLayer*> &layers,
+				 ThreadPool &pool);
+
+	// width * height cells, row 0 first, 2 floats each: the cell value, and
+	// seconds since the cell last held a point, -1 if it never has
+	const float* data() const { return m_texels.data(); }
+
+	// Telemetry
+	std::atomic<int32_t> occupiedCells{ 0 };
+	std::atomic<double> lastMs{ 0.0 };
+	std::atomic<int32_t> layersFused{ 0 };
+
+private:
+	void reduce(int rowBegin, int rowEnd, double time, double now);
+
+	HeightmapSettings m_settings;
+	std::vector<float> m_texels;
+	std::vector<double> m_lastSeen;
+	std::vector<std::vector<float> > m_partials;
+	std::vector<const HeightmapLayer*> m_layers;
+
+};
+
+#endif
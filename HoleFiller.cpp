@@ -0,0 +1,133 @@
+#include "HoleFiller.h"
+#include "Simd.h"
+#include <algorithm>
+#include <chrono>
+
+const float HoleFiller::TOO_LARGE = -1.0f;
+
+// Farthest of each 2x2 texels of in, an odd last column or row paired with
+// itself. Missing depth is 0, so max() skips it.
+static void
+push(const float *in, int inWidth, int inHeight, float *out, int width, int height)
+{
+	const int pairs = inWidth / 2;
+	for (int y = 0; y < height; y++) {
+		const float *a = in + (size_t)(2 * y) * inWidth;
+		const float *b = 2 * y + 1 < inHeight ? a + inWidth : a;
+		float *row = out + (size_t)y * width;
+		int x = 0;
+#ifdef SENSETOP_SSE2
+		for (; x + 4 <= pairs; x += 4) {
+			__m128 v0 = _mm_max_ps(_mm_loadu_ps(a + 2 * x), _mm_loadu_ps(b + 2 * x));
+			__m128 v1 = _mm_max_ps(_mm_loadu_ps(a + 2 * x + 4), _mm_loadu_ps(b + 2 * x + 4));
+			_mm_storeu_ps(row + x, _mm_max_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1))));
+		}
+#endif
+		for (; x < width; x++) {
+			int x0 = 2 * x, x1 = std::min(x0 + 1, inWidth - 1);
+			row[x] = std::max(std::max(a[x0], a[x1]), std::max(b[x0], b[x1]));
+		}
+	}
+}
+
+#ifdef SENSETOP_SSE2
+// Set bits in each 4-bit lane mask
+static const int BITS[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+#endif
+
+// Gives texels of out without depth their parent's value in the level
+// above. With mark set, those that stay empty get TOO_LARGE. Returns the
+// number filled and marked.
+static void
+pull(float *out, int width, int height, const float *parents, int parentWidth, bool mark, int &filled, int &marked)
+{
+	const float empty = mark ? HoleFiller::TOO_LARGE : 0.0f;
+	for (int y = 0; y < height; y++) {
+		float *row = out + (size_t)y * width;
+		const float *parent = parents + (size_t)(y / 2) * parentWidth;
+		int x = 0;
+#ifdef SENSETOP_SSE2
+		const __m128 zero = _mm_setzero_ps();
+		for (; x + 4 <= width; x += 4) {
+			__m128 v = _mm_loadu_ps(row + x);
+			__m128 hole = _mm_cmpeq_ps(v, zero);
+			int holes = _mm_movemask_ps(hole);
+
+			// Two parents, each spread over two children
+			__m128 p = _mm_castpd_ps(_mm_load_sd((const double*)(parent + x / 2)));
+			p = _mm_unpacklo_ps(p, p);
+			__m128 found = _mm_cmpgt_ps(p, zero);
+			__m128 fill = _mm_or_ps(_mm_and_ps(found, p), _mm_andnot_ps(found, _mm_set1_ps(empty)));
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(hole, fill), _mm_andnot_ps(hole, v)));
+
+			int hits = holes & _mm_movemask_ps(found);
+			filled += BITS[hits];
+			marked += BITS[holes & ~hits];
+		}
+#endif
+		for (; x < width; x++) {
+			if (row[x] != 0.0f) continue;
+			float p = parent[x / 2];
+			if (p > 0.0f) {
+				row[x] = p;
+				filled++;
+			}
+			else {
+				row[x] = empty;
+				marked++;
+			}
+		}
+	}
+}
+
+HoleFiller::HoleFiller()
+{
+}
+
+HoleFiller::~HoleFiller()
+{
+}
+
+void
+HoleFiller::fill(float *depth, int width, int height, int maxRadius)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Enough levels that a texel of the last one spans twice the radius
+	int levels = 1;
+	while ((1 << levels) < 2 * maxRadius && ((width >> levels) > 1 || (height >> levels) > 1)) levels++;
+
+	if ((int)m_levels.size() != levels || m_levels[0].width != (width + 1) / 2 || m_levels[0].height != (height + 1) / 2) {
+		m_levels.resize(levels);
+		int w = width, h = height;
+		for (Level &level : m_levels) {
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+			level.width = w;
+			level.height = h;
+			level.depth.resize((size_t)w * h);
+		}
+	}
+
+	// Push
+	push(depth, width, height, m_levels[0].depth.data(), m_levels[0].width, m_levels[0].height);
+	for (int l = 1; l < levels; l++) {
+		const Level &in = m_levels[l - 1];
+		Level &out = m_levels[l];
+		push(in.depth.data(), in.width, in.height, out.depth.data(), out.width, out.height);
+	}
+
+	// Pull. Only the frame's own pixels are counted.
+	int filled = 0, marked = 0;
+	for (int l = levels - 2; l >= 0; l--) {
+		Level &out = m_levels[l];
+		const Level &in = m_levels[l + 1];
+		int unused = 0;
+		pull(out.depth.data(), out.width, out.height, in.depth.data(), in.width, false, unused, unused);
+	}
+	pull(depth, width, height, m_levels[0].depth.data(), m_levels[0].width, true, filled, marked);
+
+	filledPixels = filled;
+	markedPixels = marked;
+	lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
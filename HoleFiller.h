@@ -0,0 +1,48 @@
+#ifndef HoleFiller_h
+#define HoleFiller_h
+
+#include <atomic>
+#include <vector>
+
+// Push-pull hole filling for depth frames.
+// The push pass halves the frame level by level, each texel keeping the
+// farthest depth under it; the pull pass then walks back down, giving every
+// texel without depth its parent's. Pixels that had depth are never
+// written. Taking the farthest rather than an average fills occlusion
+// shadows, which belong to the background, without smearing the edge of the
+// object in front across them.
+//
+// Only as many levels are built as maxRadius needs, so a hole whose pixels
+// are more than about maxRadius from any depth gets no value from the pull
+// and is set to TOO_LARGE instead.
+class HoleFiller
+{
+
+public:
+	// Depth written to pixels of holes too large to fill
+	static const float TOO_LARGE;
+
+	HoleFiller();
+	virtual ~HoleFiller();
+
+	// depth in mm, width * height, filled in place. Allocates only when
+	// the frame size changes.
+	void fill(float *depth, int width, int height, int maxRadius);
+
+	// Telemetry, for the last frame
+	std::atomic<int32_t> filledPixels{ 0 };
+	std::atomic<int32_t> markedPixels{ 0 };
+	std::atomic<double> lastMs{ 0.0 };
+
+private:
+	struct Level
+	{
+		int width;
+		int height;
+		std::vector<float> depth;
+	};
+	std::vector<Level> m_levels;
+
+};
+
+#endif
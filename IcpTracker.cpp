@@ -0,0 +1,361 @@
+#include "IcpTracker.h"
+#include "Simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+// Iterations per level, finest first
+static const int ITERATIONS[IcpTracker::LEVELS] = { 4, 5, 10 };
+
+// Matches further apart than this at the finest level are rejected, metres;
+// doubled at each coarser level
+static const float MATCH_DISTANCE = 0.05f;
+
+// Matches whose normals differ by more than about 35 degrees are rejected
+static const float MATCH_COS_ANGLE = 0.8f;
+
+// Neighbours differing by more than this are averaged separately, mm
+static const float DEPTH_EDGE = 30.0f;
+
+// A frame moving further than this from the last is taken as a failure
+static const float MAX_TRANSLATION = 0.2f;
+static const float MAX_ROTATION = 0.35f;		// radians
+
+// Fewer matched points than this share of the valid ones counts as lost
+static const double MIN_INLIERS = 0.15;
+
+IcpTracker::IcpTracker(int width, int height)
+: m_referenceLevel(0), m_hasReference(false)
+{
+	for (int l = 0; l < LEVELS; l++) {
+		for (Level *level : { &m_current[l], &m_reference[l] }) {
+			level->width = width >> l;
+			level->height = height >> l;
+			size_t pixels = (size_t)level->width * level->height;
+			level->depth.resize(pixels);
+			level->vertices.resize(pixels * 4);
+			level->normals.resize(pixels * 4);
+		}
+	}
+}
+
+IcpTracker::~IcpTracker()
+{
+}
+
+// Level first is a copy of depth, each coarser level averages 2x2 blocks of
+// the one above, leaving out pixels across a depth edge from the first valid
+// one. Finer levels are left alone, and only levels from prepared up get
+// vertices and normals.
+void
+IcpTracker::buildPyramid(Level *levels, int first, const float *depth, int stride, const DepthIntrinsics &k, int prepared,
+	ThreadPool &pool)
+{
+	Level &top = levels[first];
+	top.k = k;
+	for (size_t i = 0; i < top.depth.size(); i++)
+		top.depth[i] = depth[i * stride];
+
+	for (int l = first + 1; l < LEVELS; l++) {
+		const Level &in = levels[l - 1];
+		Level &out = levels[l];
+		out.k = in.k.halved();
+
+		for (int y = 0; y < out.height; y++) {
+			for (int x = 0; x < out.width; x++) {
+				const float *row0 = &in.depth[(y * 2) * in.width + x * 2];
+				const float *row1 = row0 + in.width;
+				float d[4] = { row0[0], row0[1], row1[0], row1[1] };
+				float first = 0.0f, sum = 0.0f;
+				int count = 0;
+				for (int i = 0; i < 4; i++) {
+					if (d[i] <= 0.0f) continue;
+					if (count == 0) first = d[i];
+					if (std::fabs(d[i] - first) > DEPTH_EDGE) continue;
+					sum += d[i];
+					count++;
+				}
+				out.depth[y * out.width + x] = count ? sum / count : 0.0f;
+			}
+		}
+	}
+
+	for (int l = std::max(first, prepared); l < LEVELS; l++)
+		prepare(levels[l], pool);
+}
+
+// Camera-space vertices from the level's depth, then normals from the
+// vertices either side, left at 0 across depth edges
+void
+IcpTracker::prepare(Level &level, ThreadPool &pool)
+{
+	deprojectDepth(level.depth.data(), level.width, level.height, level.k, level.vertices.data());
+
+	int width = level.width, height = level.height;
+	pool.parallelFor(height, [&](int begin, int end) {
+		for (int y = begin; y < end; y++) {
+			for (int x = 0; x < width; x++) {
+				float *n = &level.normals[((size_t)y * width + x) * 4];
+				n[0] = n[1] = n[2] = n[3] = 0.0f;
+				if (x == 0 || y == 0 || x == width - 1 || y == height - 1) continue;
+
+				const float *c = &level.vertices[((size_t)y * width + x) * 4];
+				const float *l = c - 4, *r = c + 4, *u = c - width * 4, *d = c + width * 4;
+				if (c[3] <= 0.0f || l[3] <= 0.0f || r[3] <= 0.0f || u[3] <= 0.0f || d[3] <= 0.0f) continue;
+				float edge = DEPTH_EDGE * 0.002f;
+				if (std::fabs(r[2] - l[2]) > edge || std::fabs(u[2] - d[2]) > edge) continue;
+
+				// Right cross up faces the camera
+				float dx[3] = { r[0] - l[0], r[1] - l[1], r[2] - l[2] };
+				float dy[3] = { u[0] - d[0], u[1] - d[1], u[2] - d[2] };
+				float nx = dx[1] * dy[2] - dx[2] * dy[1];
+				float ny = dx[2] * dy[0] - dx[0] * dy[2];
+				float nz = dx[0] * dy[1] - dx[1] * dy[0];
+				float norm = std::sqrt(nx * nx + ny * ny + nz * nz);
+				if (norm <= 0.0f) continue;
+				n[0] = nx / norm;
+				n[1] = ny / norm;
+				n[2] = nz / norm;
+			}
+		}
+	}, 8);
+}
+
+void
+IcpTracker::setReference(const float *depth, int stride, int level, const DepthIntrinsics &k, const Matrix &cameraToWorld,
+	ThreadPool &pool)
+{
+	m_referenceLevel = std::max(0, std::min(level, LEVELS - 1));
+	buildPyramid(m_reference, m_referenceLevel, depth, stride, k, m_referenceLevel, pool);
+	m_referenceToWorld = cameraToWorld;
+	m_hasReference = cameraToWorld.inverse(m_worldToReference);
+}
+
+// Point-to-plane normal equations for the current level, with the current
+// points moved into the reference camera by currentToReference. Each chunk
+// of rows sums into its own floats, then adds them to the totals once.
+void
+IcpTracker::accumulate(int l, const Matrix &m, Equations &sums, ThreadPool &pool) const
+{
+	const Level &cur = m_current[l];
+	const Level &ref = m_reference[l];
+	const float maxDistance = MATCH_DISTANCE * (1 << l);
+	std::mutex mutex;
+	memset(&sums, 0, sizeof(sums));
+
+	pool.parallelFor(cur.height, [&](int begin, int end) {
+#ifdef SENSETOP_SSE2
+		__m128 acc[6][2];
+		for (int i = 0; i < 6; i++)
+			acc[i][0] = acc[i][1] = _mm_setzero_ps();
+#else
+		float acc[6][8] = {};
+#endif
+		float error = 0.0f;
+		int64_t count = 0;
+
+		for (int y = begin; y < end; y++) {
+			for (int x = 0; x < cur.width; x++) {
+				size_t i = (size_t)y * cur.width + x;
+				const float *p = &cur.vertices[i * 4];
+				const float *pn = &cur.normals[i * 4];
+				if (p[3] <= 0.0f || (pn[0] == 0.0f && pn[1] == 0.0f && pn[2] == 0.0f)) continue;
+
+				// Into the reference camera, and onto its image
+				float v[3], vn[3];
+				for (int c = 0; c < 3; c++) {
+					v[c] = m[c] * p[0] + m[4 + c] * p[1] + m[8 + c] * p[2] + m[12 + c];
+					vn[c] = m[c] * pn[0] + m[4 + c] * pn[1] + m[8 + c] * pn[2];
+				}
+				if (v[2] >= 0.0f) continue;
+				int u = (int)(v[0] / -v[2] * ref.k.fx + ref.k.cx + 0.5f);
+				int w = (int)(-v[1] / -v[2] * ref.k.fy + ref.k.cy + 0.5f);
+				if (u < 0 || u >= ref.width || w < 0 || w >= ref.height) continue;
+
+				size_t j = (size_t)w * ref.width + u;
+				const float *q = &ref.vertices[j * 4];
+				const float *n = &ref.normals[j * 4];
+				if (q[3] <= 0.0f || (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)) continue;
+
+				float d[3] = { v[0] - q[0], v[1] - q[1], v[2] - q[2] };
+				if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > maxDistance * maxDistance) continue;
+				if (vn[0] * n[0] + vn[1] * n[1] + vn[2] * n[2] < MATCH_COS_ANGLE) continue;
+
+				// r + J x, with x the small rotation then translation
+				float r = n[0] * d[0] + n[1] * d[1] + n[2] * d[2];
+				float J[8] = {
+					v[1] * n[2] - v[2] * n[1],
+					v[2] * n[0] - v[0] * n[2],
+					v[0] * n[1] - v[1] * n[0],
+					n[0], n[1], n[2], r, 0.0f,
+				};
+
+#ifdef SENSETOP_SSE2
+				__m128 lo = _mm_loadu_ps(J);
+				__m128 hi = _mm_loadu_ps(J + 4);
+				for (int a = 0; a < 6; a++) {
+					__m128 ja = _mm_set1_ps(J[a]);
+					acc[a][0] = _mm_add_ps(acc[a][0], _mm_mul_ps(ja, lo));
+					acc[a][1] = _mm_add_ps(acc[a][1], _mm_mul_ps(ja, hi));
+				}
+#else
+				for (int a = 0; a < 6; a++)
+					for (int b = 0; b < 8; b++)
+						acc[a][b] += J[a] * J[b];
+#endif
+				error += r * r;
+				count++;
+			}
+		}
+
+		float rows[6][8];
+#ifdef SENSETOP_SSE2
+		for (int a = 0; a < 6; a++) {
+			_mm_storeu_ps(rows[a], acc[a][0]);
+			_mm_storeu_ps(rows[a] + 4, acc[a][1]);
+		}
+#else
+		memcpy(rows, acc, sizeof(rows));
+#endif
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int a = 0; a < 6; a++)
+			for (int b = 0; b < 7; b++)
+				sums.a[a][b] += rows[a][b];
+		sums.error += error;
+		sums.count += count;
+	}, 8);
+}
+
+// Solves the 6x6 system in place by Cholesky, false if it is degenerate
+static bool
+solve(double a[6][7], double x[6])
+{
+	double L[6][6] = {};
+	for (int i = 0; i < 6; i++) {
+		for (int j = 0; j <= i; j++) {
+			double sum = a[i][j];
+			for (int k = 0; k < j; k++)
+				sum -= L[i][k] * L[j][k];
+			if (i == j) {
+				if (sum <= 1e-12) return false;
+				L[i][i] = std::sqrt(sum);
+			}
+			else {
+				L[i][j] = sum / L[j][j];
+			}
+		}
+	}
+
+	// L y = -Jtr, then Lt x = y
+	double y[6];
+	for (int i = 0; i < 6; i++) {
+		double sum = -a[i][6];
+		for (int k = 0; k < i; k++)
+			sum -= L[i][k] * y[k];
+		y[i] = sum / L[i][i];
+	}
+	for (int i = 5; i >= 0; i--) {
+		double sum = y[i];
+		for (int k = i + 1; k < 6; k++)
+			sum -= L[k][i] * x[k];
+		x[i] = sum / L[i][i];
+	}
+	return true;
+}
+
+// Rotation by the small angle vector w (Rodrigues) followed by t
+static Matrix
+increment(const double x[6])
+{
+	double angle = std::sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+	double ax[3] = { 1.0, 0.0, 0.0 };
+	if (angle > 1e-12)
+		for (int i = 0; i < 3; i++) ax[i] = x[i] / angle;
+	double c = std::cos(angle), s = std::sin(angle), t = 1.0 - c;
+
+	double rows[4][4] = {
+		{ t * ax[0] * ax[0] + c,         t * ax[0] * ax[1] - s * ax[2], t * ax[0] * ax[2] + s * ax[1], x[3] },
+		{ t * ax[0] * ax[1] + s * ax[2], t * ax[1] * ax[1] + c,         t * ax[1] * ax[2] - s * ax[0], x[4] },
+		{ t * ax[0] * ax[2] - s * ax[1], t * ax[1] * ax[2] + s * ax[0], t * ax[2] * ax[2] + c,         x[5] },
+		{ 0.0, 0.0, 0.0, 1.0 },
+	};
+	return Matrix::fromRows(rows);
+}
+
+// Re-orthonormalises the rotation so float error doesn't build up over a
+// long sequence of increments
+static void
+orthonormalize(Matrix &m)
+{
+	float *x = &m.matrix[0], *y = &m.matrix[4], *z = &m.matrix[8];
+	float lx = std::sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+	for (int i = 0; i < 3; i++) x[i] /= lx;
+	float dot = x[0] * y[0] + x[1] * y[1] + x[2] * y[2];
+	for (int i = 0; i < 3; i++) y[i] -= dot * x[i];
+	float ly = std::sqrt(y[0] * y[0] + y[1] * y[1] + y[2] * y[2]);
+	for (int i = 0; i < 3; i++) y[i] /= ly;
+	z[0] = x[1] * y[2] - x[2] * y[1];
+	z[1] = x[2] * y[0] - x[0] * y[2];
+	z[2] = x[0] * y[1] - x[1] * y[0];
+}
+
+bool
+IcpTracker::track(const float *depth, const DepthIntrinsics &k, Matrix &cameraToWorld, ThreadPool &pool)
+{
+	if (!m_hasReference) return false;
+	auto start = std::chrono::steady_clock::now();
+
+	buildPyramid(m_current, 0, depth, 1, k, m_referenceLevel, pool);
+
+	// Everything is solved in the reference camera's space
+	Matrix guess = m_worldToReference * cameraToWorld;
+	Matrix m = guess;
+	Equations sums;
+	bool ok = true;
+	for (int l = LEVELS - 1; l >= m_referenceLevel && ok; l--) {
+		for (int it = 0; it < ITERATIONS[l]; it++) {
+			accumulate(l, m, sums, pool);
+			if (sums.count < 6) {
+				ok = false;
+				break;
+			}
+			double x[6];
+			if (!solve(sums.a, x)) {
+				ok = false;
+				break;
+			}
+			m = increment(x) * m;
+			orthonormalize(m);
+		}
+	}
+
+	// Inliers at the finest level aligned, against every point that could
+	// match
+	const Level &finest = m_current[m_referenceLevel];
+	size_t valid = 0;
+	for (size_t i = 0; i < finest.depth.size(); i++)
+		if (finest.depth[i] > 0.0f) valid++;
+	double inliers = valid ? (double)sums.count / valid : 0.0;
+
+	// The change from the guess, which should be small between frames
+	Matrix inverseGuess;
+	guess.inverse(inverseGuess);
+	Matrix change = m * inverseGuess;
+	float moved = std::sqrt(change[12] * change[12] + change[13] * change[13] + change[14] * change[14]);
+	float turned = std::acos(std::max(-1.0f, std::min(1.0f, (change[0] + change[5] + change[10] - 1.0f) * 0.5f)));
+
+	ok = ok && inliers >= MIN_INLIERS && moved <= MAX_TRANSLATION && turned <= MAX_ROTATION;
+
+	lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	inlierRatio = inliers;
+	rmsError = sums.count ? std::sqrt(sums.error / sums.count) * 1000.0 : 0.0;
+	if (!ok) {
+		lost++;
+		return false;
+	}
+
+	cameraToWorld = m_referenceToWorld * m;
+	return true;
+}
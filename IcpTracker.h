@@ -0,0 +1,80 @@
+#ifndef IcpTracker_h
+#define IcpTracker_h
+
+#include "Matrix.h"
+#include "Deprojection.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <vector>
+
+// Estimates the camera's pose by aligning each depth frame to a reference
+// view of the scene, usually the TSDF volume rendered from the previous
+// pose. Point-to-plane ICP runs coarse to fine over a three level pyramid,
+// matching points by projecting them into the reference view. The normal
+// equations are accumulated with SSE2 over chunks of rows spread across the
+// pool, then reduced in double precision.
+class IcpTracker
+{
+
+public:
+	static const int LEVELS = 3;
+
+	IcpTracker(int width, int height);
+	virtual ~IcpTracker();
+
+	// The view frames are aligned to: depths in mm seen from cameraToWorld,
+	// stride floats apart, so a TsdfVolume::raycast() render can be passed as
+	// render + 3 with a stride of 4. The view is the size of the given
+	// pyramid level, with k its intrinsics; frames are then only aligned
+	// down to that level, which skips the costliest iterations.
+	void setReference(const float *depth, int stride, int level, const DepthIntrinsics &k, const Matrix &cameraToWorld,
+		ThreadPool &pool);
+	bool hasReference() const { return m_hasReference; }
+	void reset() { m_hasReference = false; }
+
+	// depth in mm. cameraToWorld is the starting guess, usually the last
+	// pose, and is replaced by the aligned pose. Returns false and leaves it
+	// alone if the frame could not be aligned.
+	bool track(const float *depth, const DepthIntrinsics &k, Matrix &cameraToWorld, ThreadPool &pool);
+
+	// Telemetry of the last track()
+	std::atomic<double> lastMs{ 0.0 };
+	std::atomic<double> rmsError{ 0.0 };		// mm, point-to-plane
+	std::atomic<double> inlierRatio{ 0.0 };
+	std::atomic<int32_t> lost{ 0 };
+
+private:
+	struct Level
+	{
+		int width = 0;
+		int height = 0;
+		DepthIntrinsics k;
+		std::vector<float> depth;		// mm
+		std::vector<float> vertices;	// camera space xyzw, w = 0 where there is no depth
+		std::vector<float> normals;		// camera space xyz0, all 0 where unknown
+	};
+
+	// Sums of one pass over the points, in the reference camera's space:
+	// JtJ with Jtr beside it, the squared residuals and the number of matches
+	struct Equations
+	{
+		double a[6][7];
+		double error;
+		int64_t count;
+	};
+
+	void buildPyramid(Level *levels, int first, const float *depth, int stride, const DepthIntrinsics &k, int prepared,
+		ThreadPool &pool);
+	static void prepare(Level &level, ThreadPool &pool);
+	void accumulate(int level, const Matrix &currentToReference, Equations &sums, ThreadPool &pool) const;
+
+	Level m_current[LEVELS];
+	Level m_reference[LEVELS];
+	Matrix m_referenceToWorld;
+	Matrix m_worldToReference;
+	int m_referenceLevel;
+	bool m_hasReference;
+
+};
+
+#endif
@@ -9,6 +9,7 @@
  */
 
 #include "Matrix.h"
+#include "Simd.h"
 
 Matrix::Matrix()
 : matrix{1.0, 0.0, 0.0, 0.0,
@@ -19,10 +20,34 @@ Matrix::Matrix()
 
 }
 
+Matrix Matrix::fromRows(const double rows[4][4])
+{
+    Matrix result;
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            result[c * 4 + r] = (GLfloat)rows[r][c];
+    return result;
+}
+
 Matrix operator*(const Matrix &a, const Matrix &b)
 {
     Matrix result;
 
+#ifdef SENSETOP_SSE2
+    // Each result column is a's columns weighted by one column of b
+    __m128 a0 = _mm_loadu_ps(&a.matrix[0]);
+    __m128 a1 = _mm_loadu_ps(&a.matrix[4]);
+    __m128 a2 = _mm_loadu_ps(&a.matrix[8]);
+    __m128 a3 = _mm_loadu_ps(&a.matrix[12]);
+    for (int c = 0; c < 4; c++) {
+        const GLfloat *col = &b.matrix[c * 4];
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(col[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(col[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(col[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(col[3])));
+        _mm_storeu_ps(&result.matrix[c * 4], r);
+    }
+#else
     result[ 0] = a[ 0] * b[ 0] + a[ 4] * b[ 1] + a[ 8] * b[ 2] + a[12] * b[ 3];
     result[ 1] = a[ 1] * b[ 0] + a[ 5] * b[ 1] + a[ 9] * b[ 2] + a[13] * b[ 3];
     result[ 2] = a[ 2] * b[ 0] + a[ 6] * b[ 1] + a[10] * b[ 2] + a[14] * b[ 3];
@@ -42,6 +67,68 @@ Matrix operator*(const Matrix &a, const Matrix &b)
     result[13] = a[ 1] * b[12] + a[ 5] * b[13] + a[ 9] * b[14] + a[13] * b[15];
     result[14] = a[ 2] * b[12] + a[ 6] * b[13] + a[10] * b[14] + a[14] * b[15];
     result[15] = a[ 3] * b[12] + a[ 7] * b[13] + a[11] * b[14] + a[15] * b[15];
+#endif
 
     return result;
 }
+
+bool Matrix::inverse(Matrix &result) const
+{
+    // Cofactor expansion, as in MESA's gluInvertMatrix
+    const GLfloat *m = matrix;
+    GLfloat inv[16];
+
+    inv[ 0] =  m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[ 4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[ 8] =  m[4] * m[ 9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[ 9];
+    inv[12] = -m[4] * m[ 9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[ 9];
+    inv[ 1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[ 5] =  m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[ 9] = -m[0] * m[ 9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[ 9];
+    inv[13] =  m[0] * m[ 9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[ 9];
+    inv[ 2] =  m[1] * m[ 6] * m[15] - m[1] * m[ 7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[ 7] - m[13] * m[3] * m[ 6];
+    inv[ 6] = -m[0] * m[ 6] * m[15] + m[0] * m[ 7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[ 7] + m[12] * m[3] * m[ 6];
+    inv[10] =  m[0] * m[ 5] * m[15] - m[0] * m[ 7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[ 7] - m[12] * m[3] * m[ 5];
+    inv[14] = -m[0] * m[ 5] * m[14] + m[0] * m[ 6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[ 6] + m[12] * m[2] * m[ 5];
+    inv[ 3] = -m[1] * m[ 6] * m[11] + m[1] * m[ 7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[ 9] * m[2] * m[ 7] + m[ 9] * m[3] * m[ 6];
+    inv[ 7] =  m[0] * m[ 6] * m[11] - m[0] * m[ 7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[ 8] * m[2] * m[ 7] - m[ 8] * m[3] * m[ 6];
+    inv[11] = -m[0] * m[ 5] * m[11] + m[0] * m[ 7] * m[ 9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[ 9] - m[ 8] * m[1] * m[ 7] + m[ 8] * m[3] * m[ 5];
+    inv[15] =  m[0] * m[ 5] * m[10] - m[0] * m[ 6] * m[ 9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[ 9] + m[ 8] * m[1] * m[ 6] - m[ 8] * m[2] * m[ 5];
+
+    GLfloat det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if (det == 0.0f)
+        return false;
+
+    GLfloat scale = 1.0f / det;
+    for (int i = 0; i < 16; i++)
+        result[i] = inv[i] * scale;
+    return true;
+}
+
+void Matrix::transformPoints(const float *in, float *out, size_t count) const
+{
+#ifdef SENSETOP_SSE2
+    // One point per register: the columns weighted by x, y, z and w
+    __m128 c0 = _mm_loadu_ps(&matrix[0]);
+    __m128 c1 = _mm_loadu_ps(&matrix[4]);
+    __m128 c2 = _mm_loadu_ps(&matrix[8]);
+    __m128 c3 = _mm_loadu_ps(&matrix[12]);
+    for (size_t i = 0; i < count; i++, in += 4, out += 4) {
+        __m128 p = _mm_loadu_ps(in);
+        __m128 r = _mm_mul_ps(c0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+        r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm_storeu_ps(out, r);
+    }
+#else
+    const GLfloat *m = matrix;
+    for (size_t i = 0; i < count; i++, in += 4, out += 4) {
+        float x = in[0], y = in[1], z = in[2], w = in[3];
+        out[0] = m[0] * x + m[4] * y + m[ 8] * z + m[12] * w;
+        out[1] = m[1] * x + m[5] * y + m[ 9] * z + m[13] * w;
+        out[2] = m[2] * x + m[6] * y + m[10] * z + m[14] * w;
+        out[3] = m[3] * x + m[7] * y + m[11] * z + m[15] * w;
+    }
+#endif
+}
@@ -12,10 +12,25 @@
 #define Matrix_h
 
 #include "TOP_CPlusPlusBase.h"
+#include <cstddef>
 
+// 4x4 matrix, column-major like OpenGL: matrix[12..14] is the translation,
+// and points are column vectors multiplied on the right.
 class Matrix {
 public:
     Matrix();
+
+    // From TouchDesigner's double[4][4] object transforms, which are indexed
+    // [row][column] with the translation in the last column
+    static Matrix fromRows(const double rows[4][4]);
+
+    // Returns false and leaves result alone if the matrix is singular
+    bool inverse(Matrix &result) const;
+
+    // Transforms count points of 4 floats each (x, y, z, w). in and out may
+    // be the same buffer.
+    void transformPoints(const float *in, float *out, size_t count) const;
+
     GLfloat matrix[16];
     GLfloat operator[](int i) const
     {
@@ -0,0 +1,102 @@
+#include "NetworkDepthSource.h"
+#include "DepthCodec.h"
+#include "SteadyClock.h"
+#include <cstdio>
+#include <cstring>
+
+static const int CONNECT_TIMEOUT_MS = 1000;
+
+// Once a frame has started arriving, the rest of it should follow promptly
+static const int RECEIVE_TIMEOUT_MS = 2000;
+
+NetworkDepthSource::NetworkDepthSource(const std::string &host, int port)
+: m_host(host), m_port(port), m_width(0), m_height(0), m_lastSequence(-1),
+	m_megabytesPerSecond(0.0), m_latency(0.0), m_windowBytes(0), m_windowStart(0.0)
+{
+}
+
+NetworkDepthSource::~NetworkDepthSource()
+{
+	close();
+}
+
+bool
+NetworkDepthSource::open()
+{
+	close();
+	if (!m_socket.connect(m_host.c_str(), m_port, CONNECT_TIMEOUT_MS)) return false;
+	m_socket.setNoDelay();
+	m_socket.setReceiveTimeout(RECEIVE_TIMEOUT_MS);
+	m_socket.setSendTimeout(RECEIVE_TIMEOUT_MS);
+
+	uint8_t hello[STREAM_HELLO_SIZE];
+	int32_t width, height;
+	if (!m_socket.waitReadable(CONNECT_TIMEOUT_MS) ||
+		!m_socket.recvAll(hello, sizeof(hello)) ||
+		!unpackStreamHello(hello, width, height, m_intrinsics)) {
+		close();
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_encoded.resize(DepthCodec::maxEncodedSize(m_width * m_height));
+	m_decoded.resize(m_width * m_height);
+	m_lastSequence = -1;
+	m_windowBytes = 0;
+	m_windowStart = steadySeconds();
+
+	printf("Receiving depth from %s\n", m_socket.peer().c_str());
+	return true;
+}
+
+void
+NetworkDepthSource::close()
+{
+	m_socket.close();
+	m_megabytesPerSecond = 0.0;
+}
+
+DepthSourceResult
+NetworkDepthSource::read(DepthFrame &frame, int timeoutMs)
+{
+	if (!m_socket.isOpen()) return DepthSourceResult::Lost;
+	if (!m_socket.waitReadable(timeoutMs)) return DepthSourceResult::Timeout;
+
+	uint8_t packed[STREAM_FRAME_HEADER_SIZE];
+	StreamFrameHeader header;
+	if (!m_socket.recvAll(packed, sizeof(packed))) return DepthSourceResult::Lost;
+	unpackStreamFrameHeader(packed, header);
+
+	if (header.encodedSize > m_encoded.size() ||
+		!m_socket.recvAll(m_encoded.data(), header.encodedSize) ||
+		!m_socket.sendAll(&header.sendTime, sizeof(header.sendTime)))
+		return DepthSourceResult::Lost;
+
+	if (!DepthCodec::decode(m_encoded.data(), header.encodedSize, m_decoded.data(), m_decoded.size()))
+		return DepthSourceResult::Lost;
+
+	framesReceived++;
+	if (m_lastSequence >= 0 && header.sequence > m_lastSequence + 1)
+		framesSkipped += header.sequence - m_lastSequence - 1;
+	m_lastSequence = header.sequence;
+	m_latency = header.latency;
+
+	double now = steadySeconds();
+	m_windowBytes += sizeof(packed) + header.encodedSize;
+	if (now - m_windowStart >= 1.0) {
+		m_megabytesPerSecond = m_windowBytes / (now - m_windowStart) * 1e-6;
+		m_windowBytes = 0;
+		m_windowStart = now;
+	}
+
+	frame.sequence = header.sequence;
+	frame.deviceTime = header.deviceTime;
+	frame.time = header.time;
+	frame.width = m_width;
+	frame.height = m_height;
+	frame.depth.resize(m_decoded.size());
+	for (size_t i = 0; i < m_decoded.size(); i++)
+		frame.depth[i] = (float)m_decoded[i];
+	return DepthSourceResult::Frame;
+}
@@ -0,0 +1,56 @@
+#ifndef NetworkDepthSource_h
+#define NetworkDepthSource_h
+
+#include "DepthSource.h"
+#include "DepthStream.h"
+#include "TcpSocket.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Receives depth from a DepthStreamServer on another SenseTOP, or the same
+// one over loopback. Each frame is acknowledged so the server can measure
+// the link's latency, which it sends back with the following frames.
+class NetworkDepthSource : public DepthSource
+{
+
+public:
+	NetworkDepthSource(const std::string &host, int port);
+	virtual ~NetworkDepthSource();
+
+	virtual bool open() override;
+	virtual void close() override;
+	virtual DepthSourceResult read(DepthFrame &frame, int timeoutMs) override;
+
+	virtual DepthIntrinsics intrinsics() const override { return m_intrinsics; }
+	virtual double megabytesPerSecond() const override { return m_megabytesPerSecond; }
+	virtual double latency() const override { return m_latency; }
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+
+	// Frames the server sent and we received
+	int64_t framesReceived = 0;
+	// Frames the server dropped for this link, from gaps in the sequence
+	int64_t framesSkipped = 0;
+
+private:
+	std::string m_host;
+	int m_port;
+	TcpSocket m_socket;
+	int m_width;
+	int m_height;
+	DepthIntrinsics m_intrinsics;
+	int64_t m_lastSequence;
+
+	std::vector<uint8_t> m_encoded;
+	std::vector<uint16_t> m_decoded;
+
+	std::atomic<double> m_megabytesPerSecond;
+	std::atomic<double> m_latency;
+	int64_t m_windowBytes;
+	double m_windowStart;
+
+};
+
+#endif
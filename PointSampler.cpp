@@ -0,0 +1,93 @@
+#include "PointSampler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+PointSampler::PointSampler()
+{
+}
+
+PointSampler::~PointSampler()
+{
+}
+
+void
+PointSampler::sample(const float *cameraPoints, const float *worldPoints, int width, int height, float nearDepth, float farDepth,
+	int count, uint32_t seed, float *samples, ThreadPool &pool)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Camera space looks down -z, in metres
+	const float nearZ = -nearDepth * 0.001f, farZ = -farDepth * 0.001f;
+	auto inRange = [=](const float *p) { return p[3] > 0.0f && p[2] <= nearZ && p[2] >= farZ; };
+
+	const int tilesX = (width + TILE - 1) / TILE, tilesY = (height + TILE - 1) / TILE;
+	m_counts.assign(tilesX * tilesY, 0);
+	m_offsets.resize(tilesX * tilesY);
+
+	// Count each row of tiles in one go, row by row of pixels
+	pool.parallelFor(tilesY, [&](int begin, int end) {
+		for (int ty = begin; ty < end; ty++) {
+			int32_t *counts = m_counts.data() + ty * tilesX;
+			for (int y = ty * TILE; y < std::min(height, (ty + 1) * TILE); y++) {
+				const float *row = cameraPoints + (size_t)y * width * 4;
+				for (int x = 0; x < width; x++)
+					counts[x / TILE] += inRange(row + x * 4);
+			}
+		}
+	});
+
+	int32_t total = 0;
+	for (size_t t = 0; t < m_counts.size(); t++) {
+		m_offsets[t] = total;
+		total += m_counts[t];
+	}
+	candidates = total;
+
+	if (total == 0 || count <= 0) {
+		memset(samples, 0, std::max(count, 0) * 4 * sizeof(float));
+		lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return;
+	}
+
+	// One jittered pick per stratum, in increasing order. xorshift is plenty
+	// for jitter.
+	m_targets.resize(count);
+	uint32_t state = seed * 2654435761u + 1u;
+	for (int k = 0; k < count; k++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		double jitter = (state >> 8) * (1.0 / 16777216.0);
+		m_targets[k] = std::min((int32_t)((k + jitter) * total / count), total - 1);
+	}
+
+	// Each tile walks its pixels in the order they were counted, handing out
+	// the picks that fall in it
+	pool.parallelFor(tilesY, [&](int begin, int end) {
+		for (int ty = begin; ty < end; ty++) {
+			for (int tx = 0; tx < tilesX; tx++) {
+				int t = ty * tilesX + tx;
+				if (m_counts[t] == 0) continue;
+				int k = (int)(std::lower_bound(m_targets.begin(), m_targets.end(), m_offsets[t]) - m_targets.begin());
+				if (k == count || m_targets[k] >= m_offsets[t] + m_counts[t]) continue;
+
+				int32_t number = m_offsets[t];
+				for (int y = ty * TILE; y < std::min(height, (ty + 1) * TILE) && k < count; y++) {
+					for (int x = tx * TILE; x < std::min(width, (tx + 1) * TILE); x++) {
+						size_t i = (size_t)y * width + x;
+						if (!inRange(cameraPoints + i * 4)) continue;
+						for (; k < count && m_targets[k] == number; k++) {
+							float *s = samples + (size_t)k * 4;
+							memcpy(s, worldPoints + i * 4, 3 * sizeof(float));
+							s[3] = 1.0f;
+						}
+						number++;
+					}
+				}
+			}
+		}
+	});
+
+	lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,47 @@
+#ifndef PointSampler_h
+#define PointSampler_h
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Picks a fixed number of world points from the foreground, for particle
+// emitters that want exactly N points a frame rather than a whole frame of
+// positions to filter.
+// The frame is cut into tiles, and the pixels of each tile whose depth is in
+// range are counted in parallel. A prefix sum over the counts numbers every
+// such pixel, in tile order. Sample k then takes the pixel numbered
+// (k + jitter) * total / N, so the samples are stratified: spread evenly
+// over the foreground, tile by tile, but never on a fixed grid. Each tile
+// finds its own samples in a second parallel pass.
+class PointSampler
+{
+
+public:
+	// Pixels on a side of a tile
+	static const int TILE = 16;
+
+	PointSampler();
+	virtual ~PointSampler();
+
+	// cameraPoints and worldPoints are xyzw per pixel, width * height, as
+	// from deprojectDepth(); camera points pick the pixels, between
+	// nearDepth and farDepth mm in front of the camera, and their world
+	// points are written to samples as count xyzw, with w = 1. Without any
+	// such pixel every sample is 0. seed varies the jitter.
+	void sample(const float *cameraPoints, const float *worldPoints, int width, int height, float nearDepth, float farDepth,
+		int count, uint32_t seed, float *samples, ThreadPool &pool);
+
+	// Telemetry
+	std::atomic<int32_t> candidates{ 0 };		// pixels in range in the last frame
+	std::atomic<double> lastMs{ 0.0 };
+
+private:
+	std::vector<int32_t> m_counts;
+	std::vector<int32_t> m_offsets;
+	std::vector<int32_t> m_targets;
+
+};
+
+#endif
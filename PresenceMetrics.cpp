@@ -0,0 +1,123 @@
+#include "PresenceMetrics.h"
+#include "Simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+PresenceMetrics::PresenceMetrics()
+: m_width(0), m_height(0)
+{
+}
+
+PresenceMetrics::~PresenceMetrics()
+{
+}
+
+void
+PresenceMetrics::update(const float *depth, int32_t pitch, int width, int height)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Without a previous frame every pixel compares against no depth, so
+	// nothing counts as motion
+	if (width != m_width || height != m_height) {
+		m_previous.assign((size_t)width * height, 0.0f);
+		m_width = width;
+		m_height = height;
+	}
+
+	// Rows are summed in float and added up in double. Depths are taken
+	// relative to the last mean, so the squares stay small and the spread
+	// doesn't lose precision to them.
+	const float shift = (float)mean;
+	int64_t valid = 0, both = 0, moving = 0;
+	float nearestDepth = std::numeric_limits<float>::infinity(), farthestDepth = 0.0f;
+	double sum = 0.0, squares = 0.0, change = 0.0;
+	for (int y = 0; y < height; y++) {
+		const float *row = (const float*)((const uint8_t*)depth + (size_t)y * pitch);
+		float *previous = m_previous.data() + (size_t)y * width;
+		float rowSum = 0.0f, rowSquares = 0.0f, rowChange = 0.0f;
+		int x = 0;
+#ifdef SENSETOP_SSE2
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128 threshold = _mm_set1_ps(MOVING_MM);
+		const __m128 offset = _mm_set1_ps(shift);
+		__m128i validCount = _mm_setzero_si128(), bothCount = _mm_setzero_si128(), movingCount = _mm_setzero_si128();
+		__m128 lo = inf, hi = zero, s = zero, s2 = zero, ds = zero;
+		for (; x + 4 <= width; x += 4) {
+			__m128 d = _mm_loadu_ps(row + x);
+			__m128 p = _mm_loadu_ps(previous + x);
+			_mm_storeu_ps(previous + x, d);
+
+			__m128 has = _mm_cmpgt_ps(d, zero);
+			lo = _mm_min_ps(lo, _mm_or_ps(_mm_and_ps(has, d), _mm_andnot_ps(has, inf)));
+			hi = _mm_max_ps(hi, d);
+			__m128 d0 = _mm_and_ps(has, _mm_sub_ps(d, offset));
+			s = _mm_add_ps(s, d0);
+			s2 = _mm_add_ps(s2, _mm_mul_ps(d0, d0));
+			validCount = _mm_sub_epi32(validCount, _mm_castps_si128(has));
+
+			__m128 pair = _mm_and_ps(has, _mm_cmpgt_ps(p, zero));
+			__m128 diff = _mm_and_ps(pair, _mm_andnot_ps(sign, _mm_sub_ps(d, p)));
+			ds = _mm_add_ps(ds, diff);
+			bothCount = _mm_sub_epi32(bothCount, _mm_castps_si128(pair));
+			movingCount = _mm_sub_epi32(movingCount, _mm_castps_si128(_mm_cmpgt_ps(diff, threshold)));
+		}
+
+		alignas(16) float lanes[5][4];
+		alignas(16) int32_t counts[3][4];
+		_mm_store_ps(lanes[0], lo);
+		_mm_store_ps(lanes[1], hi);
+		_mm_store_ps(lanes[2], s);
+		_mm_store_ps(lanes[3], s2);
+		_mm_store_ps(lanes[4], ds);
+		_mm_store_si128((__m128i*)counts[0], validCount);
+		_mm_store_si128((__m128i*)counts[1], bothCount);
+		_mm_store_si128((__m128i*)counts[2], movingCount);
+		for (int i = 0; i < 4; i++) {
+			nearestDepth = std::min(nearestDepth, lanes[0][i]);
+			farthestDepth = std::max(farthestDepth, lanes[1][i]);
+			rowSum += lanes[2][i];
+			rowSquares += lanes[3][i];
+			rowChange += lanes[4][i];
+			valid += counts[0][i];
+			both += counts[1][i];
+			moving += counts[2][i];
+		}
+#endif
+		for (; x < width; x++) {
+			float d = row[x], p = previous[x];
+			previous[x] = d;
+			if (d <= 0.0f) continue;
+			nearestDepth = std::min(nearestDepth, d);
+			farthestDepth = std::max(farthestDepth, d);
+			rowSum += d - shift;
+			rowSquares += (d - shift) * (d - shift);
+			valid++;
+			if (p <= 0.0f) continue;
+			float diff = std::abs(d - p);
+			rowChange += diff;
+			both++;
+			if (diff > MOVING_MM) moving++;
+		}
+		sum += rowSum;
+		squares += rowSquares;
+		change += rowChange;
+	}
+
+	const double pixels = (double)width * height;
+	validRatio = pixels > 0.0 ? valid / pixels : 0.0;
+	nearest = valid > 0 ? nearestDepth : 0.0;
+	farthest = valid > 0 ? farthestDepth : 0.0;
+	double average = valid > 0 ? sum / valid : 0.0;
+	mean = valid > 0 ? shift + average : 0.0;
+	spread = valid > 0 ? std::sqrt(std::max(squares / valid - average * average, 0.0)) : 0.0;
+	motionEnergy = both > 0 ? change / both : 0.0;
+	movingRatio = pixels > 0.0 ? moving / pixels : 0.0;
+
+	lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
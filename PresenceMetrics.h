@@ -0,0 +1,51 @@
+#ifndef PresenceMetrics_h
+#define PresenceMetrics_h
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Whole-frame numbers for deciding whether anyone is there and how much
+// they move: the share of pixels with depth, the nearest and farthest depth,
+// the mean and spread of the depth, and the difference from the previous
+// frame. All of them come from a single SSE2 pass over the frame, which
+// also keeps the frame for the next difference. Written by the capture
+// thread, read by the cook.
+class PresenceMetrics
+{
+
+public:
+	// Change in depth, in mm, for a pixel to count as moving
+	const float MOVING_MM = 30.0f;
+
+	PresenceMetrics();
+	virtual ~PresenceMetrics();
+
+	// depth in mm, rows pitch bytes apart. Pixels without depth are 0 or
+	// less. A change of size restarts the difference.
+	void update(const float *depth, int32_t pitch, int width, int height);
+
+	// Share of pixels with depth
+	std::atomic<double> validRatio{ 0.0 };
+
+	// Depth of the pixels that have it, in mm, 0 if none do
+	std::atomic<double> nearest{ 0.0 };
+	std::atomic<double> farthest{ 0.0 };
+	std::atomic<double> mean{ 0.0 };
+	std::atomic<double> spread{ 0.0 };		// standard deviation
+
+	// Mean absolute change, in mm, over pixels with depth in both frames,
+	// and the share of all pixels that changed by more than MOVING_MM
+	std::atomic<double> motionEnergy{ 0.0 };
+	std::atomic<double> movingRatio{ 0.0 };
+
+	std::atomic<double> lastMs{ 0.0 };
+
+private:
+	std::vector<float> m_previous;
+	int m_width;
+	int m_height;
+
+};
+
+#endif
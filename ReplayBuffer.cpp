@@ -0,0 +1,174 @@
+#include "ReplayBuffer.h"
+#include "DepthCodec.h"
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+// Frames that may be waiting for the encoder at once
+static const int REPLAY_SCRATCH = 3;
+
+ReplayBuffer::ReplayBuffer()
+: m_enabled(false), m_maxSeconds(30.0), m_maxBytes(0), m_width(0), m_height(0),
+	m_ringBytes(0)
+{
+}
+
+ReplayBuffer::~ReplayBuffer()
+{
+	// Let a dump in progress finish, then stop the encoder before the ring
+	// and scratch buffers go away
+	m_writer.reset();
+	m_enabled = false;
+	m_encoder.reset();
+}
+
+void
+ReplayBuffer::configure(bool enabled, double seconds, size_t maxBytes, int width, int height)
+{
+	m_maxSeconds = seconds;
+	m_maxBytes = maxBytes;
+	if (enabled == m_enabled) return;
+
+	// The buffers and threads are only made once replay is first turned on,
+	// so an instance that never uses it costs nothing
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (enabled && m_scratch.empty()) {
+		m_width = width;
+		m_height = height;
+		m_encoder.reset(new ThreadPool(1));
+		m_writer.reset(new ThreadPool(1));
+		for (int i = 0; i < REPLAY_SCRATCH; i++) {
+			m_scratch.emplace_back(new std::vector<uint16_t>(width * height));
+			m_freeScratch.push_back(m_scratch.back().get());
+		}
+		m_encodeBuffer.resize(DepthCodec::maxEncodedSize(width * height));
+	}
+	if (!enabled) {
+		m_ring.clear();
+		m_ringBytes = 0;
+		frames = 0;
+		bytes = 0;
+		this->seconds = 0.0;
+	}
+	m_enabled = enabled;
+}
+
+bool
+ReplayBuffer::push(const uint16_t *depth, int32_t pitch, int64_t sequence, int64_t deviceTime, double time)
+{
+	std::vector<uint16_t> *scratch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_enabled) return false;
+		if (m_freeScratch.empty()) {
+			framesDropped++;
+			return false;
+		}
+		scratch = m_freeScratch.back();
+		m_freeScratch.pop_back();
+	}
+
+	for (int y = 0; y < m_height; y++)
+		memcpy(&(*scratch)[y * m_width], (const uint8_t*)depth + y * pitch, m_width * sizeof(uint16_t));
+
+	RecordingFrameHeader header;
+	header.encodedSize = 0;
+	header.sequence = sequence;
+	header.deviceTime = deviceTime;
+	header.time = time;
+
+	m_encoder->enqueue([this, scratch, header] { encode(scratch, header); });
+	return true;
+}
+
+// Runs on the single encoder thread, which owns m_encodeBuffer
+void
+ReplayBuffer::encode(std::vector<uint16_t> *depth, RecordingFrameHeader header)
+{
+	header.encodedSize = (uint32_t)DepthCodec::encode(depth->data(), depth->size(), m_encodeBuffer.data());
+
+	std::shared_ptr<Entry> entry(new Entry);
+	entry->header = header;
+	entry->encoded.assign(m_encodeBuffer.begin(), m_encodeBuffer.begin() + header.encodedSize);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_freeScratch.push_back(depth);
+	if (!m_enabled) return;
+
+	m_ring.push_back(entry);
+	m_ringBytes += entry->encoded.size();
+	trim();
+}
+
+// Evicts the oldest frames beyond the duration or memory cap. Called with
+// m_mutex held.
+void
+ReplayBuffer::trim()
+{
+	double newest = m_ring.back()->header.time;
+	size_t maxBytes = m_maxBytes;
+	while (m_ring.size() > 1 &&
+		(newest - m_ring.front()->header.time > m_maxSeconds || (maxBytes && m_ringBytes > maxBytes))) {
+		m_ringBytes -= m_ring.front()->encoded.size();
+		m_ring.pop_front();
+	}
+
+	frames = (int32_t)m_ring.size();
+	bytes = (int64_t)m_ringBytes;
+	seconds = newest - m_ring.front()->header.time;
+}
+
+bool
+ReplayBuffer::dump(const char *folder)
+{
+	if (dumping) return false;
+
+	Ring snapshot;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_ring.empty()) return false;
+		snapshot = m_ring;
+	}
+
+	// replay_YYYYMMDD_HHMMSS_mmm.sdr in the given folder; the milliseconds
+	// keep two dumps in the same second apart
+	auto clock = std::chrono::system_clock::now();
+	std::time_t now = std::chrono::system_clock::to_time_t(clock);
+	int milliseconds = (int)(std::chrono::duration_cast<std::chrono::milliseconds>(clock.time_since_epoch()).count() % 1000);
+	std::tm local;
+#ifdef WIN32
+	localtime_s(&local, &now);
+#else
+	localtime_r(&now, &local);
+#endif
+	char stamp[32], name[64];
+	strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &local);
+	snprintf(name, sizeof(name), "replay_%s_%03d.sdr", stamp, milliseconds);
+
+	std::string path = folder ? folder : "";
+	if (!path.empty() && path.back() != '/' && path.back() != '\\') path += '/';
+	path += name;
+
+	dumping = true;
+	m_writer->enqueue([this, snapshot, path] { writeDump(snapshot, path); });
+	return true;
+}
+
+void
+ReplayBuffer::writeDump(Ring snapshot, std::string path)
+{
+	FILE *file = DepthRecorder::openFile(path.c_str(), "wb");
+	if (file) {
+		DepthRecorder::writeHeader(file, m_width, m_height);
+		for (const std::shared_ptr<const Entry> &entry : snapshot)
+			DepthRecorder::writeFrame(file, entry->header, entry->encoded.data());
+		fclose(file);
+
+		dumps++;
+		printf("Wrote %d replay frames to %s\n", (int)snapshot.size(), path.c_str());
+	}
+	else {
+		printf("Could not write replay to %s\n", path.c_str());
+	}
+	dumping = false;
+}
@@ -0,0 +1,73 @@
+#ifndef ReplayBuffer_h
+#define ReplayBuffer_h
+
+#include "DepthRecorder.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+
+// In-memory ring of the last few seconds of compressed depth.
+// push() is called from the capture thread and only copies the frame; a
+// single worker compresses it and appends it to the ring, evicting the
+// oldest frames beyond the configured duration or memory cap. dump() snapshots
+// the ring (shared pointers, no frame copies) and a background writer saves
+// it as a recording file, so neither capture nor cook waits on the disk.
+class ReplayBuffer
+{
+
+public:
+	ReplayBuffer();
+	virtual ~ReplayBuffer();
+
+	// Cook thread. Disabling releases the buffered frames.
+	void configure(bool enabled, double seconds, size_t maxBytes, int width, int height);
+	bool isEnabled() const { return m_enabled; }
+
+	// Capture thread. pitch is the row stride of depth in bytes.
+	bool push(const uint16_t *depth, int32_t pitch, int64_t sequence, int64_t deviceTime, double time);
+
+	// Cook thread. Writes the buffered frames to a new file in folder.
+	// Returns false if a previous dump is still being written.
+	bool dump(const char *folder);
+
+	// Telemetry
+	std::atomic<int32_t> frames{ 0 };
+	std::atomic<int64_t> bytes{ 0 };
+	std::atomic<double> seconds{ 0.0 };
+	std::atomic<int32_t> dumps{ 0 };
+	std::atomic<bool> dumping{ false };
+	std::atomic<int32_t> framesDropped{ 0 };
+
+private:
+	struct Entry
+	{
+		RecordingFrameHeader header;
+		std::vector<uint8_t> encoded;
+	};
+	typedef std::deque<std::shared_ptr<const Entry> > Ring;
+
+	void encode(std::vector<uint16_t> *depth, RecordingFrameHeader header);
+	void writeDump(Ring snapshot, std::string path);
+	void trim();
+
+	std::atomic<bool> m_enabled;
+	std::atomic<double> m_maxSeconds;
+	std::atomic<size_t> m_maxBytes;
+	int m_width;
+	int m_height;
+
+	// Guards the ring and the scratch buffers
+	std::mutex m_mutex;
+	Ring m_ring;
+	size_t m_ringBytes;
+	std::vector<std::unique_ptr<std::vector<uint16_t> > > m_scratch;
+	std::vector<std::vector<uint16_t>*> m_freeScratch;
+	std::vector<uint8_t> m_encodeBuffer;
+
+	std::unique_ptr<ThreadPool> m_encoder;
+	std::unique_ptr<ThreadPool> m_writer;
+
+};
+
+#endif
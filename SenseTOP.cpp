@@ -9,7 +9,11 @@
  */
 
 #include "SenseTOP.h"
+#include "SteadyClock.h"
 #include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 #include <assert.h>
 #ifdef __APPLE__
@@ -73,8 +77,12 @@ DestroyTOPInstance(TOP_CPlusPlusBase* instance, TOP_Context *context)
 
 
 SenseTOP::SenseTOP(const OP_NodeInfo* info, TOP_Context *context)
-: myNodeInfo(info), myExecuteCount(0), myRotation(0.0), myError(nullptr),
-    didGLSetup(false)
+: m_senseManager(nullptr), m_device(nullptr), frames(FRAME_QUEUE_MAX),
+	myNodeInfo(info), myExecuteCount(0), myError(nullptr),
+    didGLSetup(false), myRecordFailed(false), mySharedMemoryFailed(false),
+	myStreamFailed(false), myStreamPort(0), myOutputMode(OutputMode::Depth),
+	myPointsMs(0.0), myPointsTime(0.0), myTransformSource("none"), myCalibrateFloor(false), myHeightmapWidth(0), myHeightmapHeight(0), myOutputWidth(0), myOutputHeight(0),
+	myContours(nullptr), mySamplesWidth(0)
 {
 
 #ifdef WIN32
@@ -98,21 +106,66 @@ SenseTOP::SenseTOP(const OP_NodeInfo* info, TOP_Context *context)
 	//context->beginGLCommands();
 	// Custom GL initialization here
 	//context->endGLCommands();
+
+	// allocate the frame queue up front, so the capture thread never
+	// allocates. Until the first frame arrives the TOP outputs black.
+	for (DepthFrame &frame : frames.slots()) {
+		frame.width = WIDTH;
+		frame.height = HEIGHT;
+		frame.depth.resize(WIDTH * HEIGHT);
+	}
+	for (int i = 0; i < 3; i++) {
+		DepthFrame &frame = latestFrames.slots()[i];
+		frame.width = WIDTH;
+		frame.height = HEIGHT;
+		frame.depth.resize(WIDTH * HEIGHT);
+	}
+
+	// World position buffers, 4 floats per pixel
+	myCameraPoints.resize(WIDTH * HEIGHT * 4);
+	myWorldPoints.resize(WIDTH * HEIGHT * 4);
+	myPyramidTexels.resize(WIDTH * HEIGHT * 2);
+	mySampleRange[0] = mySampleRange[1] = 0.0f;
+
+	control.start();
+
+	// Device bring-up happens on the capture thread, so creating the TOP
+	// never blocks TouchDesigner while the SDK enumerates cameras.
+	if (!startedThread) {
+		threads.emplace_back(std::bind(&SenseTOP::captureThread, this));
+		startedThread = true;
+	}
 }
 
 SenseTOP::~SenseTOP()
 {
-	// Stop the threads
+	// Stop the threads. Acquisition and backoff waits are bounded, so the
+	// joins return promptly even if the camera has stalled.
+	running = false;
+	stopCv.notify_all();
 	for (std::thread & t : threads) {
-		running = false;
 		t.join();
 		printf("Stopped thread\n");
 	}
+	control.stop();
+	recorder.stop();
+
+	// The GL context is current here, see DestroyTOPInstance()
+	if (didGLSetup) {
+		glDeleteFramebuffers(1, &readFBO);
+		glDeleteTextures(1, &textureId);
+		glDeleteFramebuffers(1, &pointFBO);
+		glDeleteTextures(1, &pointTextureId);
+		glDeleteFramebuffers(1, &heightmapFBO);
+		glDeleteTextures(1, &heightmapTextureId);
+		glDeleteFramebuffers(1, &pyramidFBO);
+		glDeleteTextures(1, &pyramidTextureId);
+		glDeleteFramebuffers(1, &samplesFBO);
+		glDeleteTextures(1, &samplesTextureId);
+	}
 	
 	// Clean up
-	m_senseManager->Release();
-	if (m_depthmap != 0) delete[] m_depthmap;
-	if (m_image != 0) delete[] m_image;
+	releaseSenseManager();
 	printf("Closed SenseManager\n");
 }
 
@@ -122,7 +175,14 @@ SenseTOP::getGeneralInfo(TOP_GeneralInfo* ginfo)
 	// Setting cookEveryFrame to true causes the TOP to cook every frame even
 	// if none of its inputs/parameters are changing. Set it to false if it
     // only needs to cook when inputs/parameters change.
-	ginfo->cookEveryFrame = true;
+	// In "On New Frame" mode we only cook while something uses the output,
+	// and execute() skips cooks that have no new camera frame.
+	ginfo->cookEveryFrame = !ui.cookOnNewFrame;
+	ginfo->cookEveryFrameIfAsked = ui.cookOnNewFrame;
+
+	// execute() overwrites the entire output, so there's no need for the
+	// TOP to clear it first
+	ginfo->clearBuffers = false;
 }
 
 bool
@@ -132,49 +192,378 @@ SenseTOP::getOutputFormat(TOP_OutputFormat* format)
 	// the pixel format/resolution etc that we want to output to.
 	// If we did that, we'd want to return true to tell the TOP to use the settings we've
 	// specified.
-	// In this example we'll return false and use the TOP's settings
-	format->width = 1280;
-	format->height = 720;
-	format->numColorBuffers = 4;
-	return false;
+	// The depth texture is blitted into the output, which requires a float
+	// color buffer, so we ask for 32bit float mono at the camera resolution,
+	// or 32bit float RGBA for world positions and the TSDF render. The
+	// heightmap is red-green at the grid resolution, the depth pyramid
+	// red-green at the size of its atlas, and the samples RGBA, one row of
+	// the sample count.
+	bool sampling = ui.outputMode == OutputMode::Samples;
+	bool world = ui.outputMode == OutputMode::WorldXYZ || ui.outputMode == OutputMode::Tsdf || sampling;
+	bool top = ui.outputMode == OutputMode::Heightmap;
+	bool pyramid = ui.outputMode == OutputMode::DepthPyramid;
+	int atlasWidth, atlasHeight;
+	DepthPyramid::atlasSize(WIDTH, HEIGHT, atlasWidth, atlasHeight);
+	format->width = top ? ui.heightmap.width : pyramid ? atlasWidth : sampling ? ui.sampleCount : WIDTH;
+	format->height = top ? ui.heightmap.height : pyramid ? atlasHeight : sampling ? 1 : HEIGHT;
+	format->bitsPerChannel = 32;
+	format->floatPrecision = true;
+	format->redChannel = true;
+	format->greenChannel = world || top || pyramid;
+	format->blueChannel = world;
+	format->alphaChannel = world;
+
+	// The results are blitted and uploaded straight into the FBO, which a
+	// multisampled buffer would not take, so never let it be antialiased
+	format->antiAlias = 1;
+	return true;
+}
+
+ThreadPool&
+SenseTOP::processingPool()
+{
+	std::call_once(m_processingPoolOnce, [this] { m_processingPool.reset(new ThreadPool()); });
+	return *m_processingPool;
+}
+
+// Creates and initializes the sense manager, returns false if no device could
+// be brought up
+bool
+SenseTOP::initSenseManager()
+{
+	m_senseManager = PXCSenseManager::CreateInstance();
+	if (!m_senseManager) return false;
+
+	m_senseManager->EnableStream(PXCCapture::STREAM_TYPE_DEPTH , 640, 480);
+	if (m_senseManager->Init() < PXC_STATUS_NO_ERROR) {
+		m_senseManager->Release();
+		m_senseManager = nullptr;
+		return false;
+	}
+	printf("SenseManager initalized\n");
+
+	// The new device has its own clock
+	m_clockSynced = false;
+
+	PXCCaptureManager *m_capMan = m_senseManager->QueryCaptureManager();
+	m_device = m_capMan->QueryDevice();
+	control.setDevice(m_device);
+
+	// Print device info
+	PXCCapture *cap = m_capMan->QueryCapture();
+	for (int i = 0;; i++) {
+		PXCCapture::DeviceInfo dinfo;
+		if (cap->QueryDeviceInfo(i, &dinfo) < PXC_STATUS_NO_ERROR) break;
+		wprintf_s(L"device[%d]: %s\n\n", i, dinfo.name);
+	}
+
+	return m_device != nullptr;
+}
+
+void
+SenseTOP::releaseSenseManager()
+{
+	control.setDevice(nullptr);
+	m_device = nullptr;
+	if (m_senseManager) {
+		m_senseManager->Release();
+		m_senseManager = nullptr;
+	}
+}
+
+// Sleeps for up to ms milliseconds, returns false if the TOP is shutting down
+bool
+SenseTOP::waitFor(int ms)
+{
+	std::unique_lock<std::mutex> lock(stopMutex);
+	return !stopCv.wait_for(lock, std::chrono::milliseconds(ms), [this] { return !running; });
+}
+
+// Opens the selected source, the camera or one of the DepthSource
+// alternatives. Returns false if it couldn't be brought up.
+bool
+SenseTOP::openSource(const SourceSettings &source)
+{
+	// Each source has its own clock
+	m_clockSynced = false;
+
+	bool opened;
+	switch (source.type)
+	{
+	case DepthSourceType::Network:
+		m_source.reset(new NetworkDepthSource(source.host, source.port));
+		opened = m_source->open();
+		break;
+	case DepthSourceType::Synthetic:
+		m_source.reset(new SyntheticDepthSource(WIDTH, HEIGHT, SYNTHETIC_FPS));
+		opened = m_source->open();
+		break;
+	default:
+		opened = initSenseManager();
+		break;
+	}
+
+	if (opened) {
+		// Pinhole model for deprojection, from the camera or the source
+		DepthIntrinsics k;
+		if (m_source) {
+			k = m_source->intrinsics();
+		}
+		else {
+			PXCPointF32 focal = m_device->QueryDepthFocalLength();
+			PXCPointF32 center = m_device->QueryDepthPrincipalPoint();
+			k.fx = focal.x;
+			k.fy = focal.y;
+			k.cx = center.x;
+			k.cy = center.y;
+		}
+		if (!k.isValid()) k = DepthIntrinsics::fromFieldOfView(WIDTH, HEIGHT, DEFAULT_FOV);
+
+		std::lock_guard<std::mutex> lock(intrinsicsMutex);
+		m_intrinsics = k;
+		streamer.setIntrinsics(k);
+	}
+	return opened;
+}
+
+void
+SenseTOP::closeSource()
+{
+	releaseSenseManager();
+	m_source.reset();
+	sourceMegabytesPerSecond = 0.0;
+	sourceLatency = 0.0;
+}
+
+// Waits for the next camera frame and delivers it
+DepthSourceResult
+SenseTOP::acquireCamera()
+{
+	pxcStatus sts = m_senseManager->AcquireFrame(true, ACQUIRE_TIMEOUT_MS);
+	if (sts == PXC_STATUS_EXEC_TIMEOUT) return DepthSourceResult::Timeout;
+	if (sts < PXC_STATUS_NO_ERROR) {
+		printf("Device lost (%d), reconnecting\n", (int)sts);
+		return DepthSourceResult::Lost;
+	}
+
+	PXCCapture::Sample *sample;
+	sample = (PXCCapture::Sample*)m_senseManager->QuerySample();
+	if (sample && sample->depth) {
+		PXCImage::ImageData imageData;
+		sample->depth->AcquireAccess(PXCImage::ACCESS_READ, PXCImage::PIXEL_FORMAT_DEPTH_F32, &imageData);
+
+		// Recordings, the replay buffer and the stream use the device's
+		// native 16-bit depth, so they are lossless
+		PXCImage::ImageData rawData;
+		bool raw = wantsRawDepth() &&
+			sample->depth->AcquireAccess(PXCImage::ACCESS_READ, PXCImage::PIXEL_FORMAT_DEPTH, &rawData) >= PXC_STATUS_NO_ERROR;
+
+		deliverFrame((const float*)imageData.planes[0], imageData.pitches[0], sample->depth->QueryTimeStamp(),
+			raw ? (const uint16_t*)rawData.planes[0] : nullptr, raw ? rawData.pitches[0] : 0);
+
+		if (raw) sample->depth->ReleaseAccess(&rawData);
+		sample->depth->ReleaseAccess(&imageData);
+	}
+	m_senseManager->ReleaseFrame();
+	return DepthSourceResult::Frame;
+}
+
+// Waits for the next frame from m_source and delivers it
+DepthSourceResult
+SenseTOP::acquireSource()
+{
+	DepthSourceResult result = m_source->read(m_sourceFrame, ACQUIRE_TIMEOUT_MS);
+	sourceMegabytesPerSecond = m_source->megabytesPerSecond();
+	sourceLatency = m_source->latency();
+	if (result != DepthSourceResult::Frame) return result;
+
+	if (m_sourceFrame.width != WIDTH || m_sourceFrame.height != HEIGHT) {
+		printf("Source is %dx%d, expected %dx%d\n", m_sourceFrame.width, m_sourceFrame.height, WIDTH, HEIGHT);
+		return DepthSourceResult::Lost;
+	}
+
+	deliverFrame(m_sourceFrame.depth.data(), WIDTH * sizeof(float), m_sourceFrame.deviceTime, nullptr, 0);
+	return DepthSourceResult::Frame;
+}
+
+bool
+SenseTOP::wantsRawDepth() const
+{
+	return recorder.isRecording() || replay.isEnabled() || (streamer.isRunning() && streamer.clients > 0);
+}
+
+// Hands a captured frame to the cook and every other consumer. raw is the
+// same frame as 16-bit depth if the source has it, otherwise it's
+// converted here when needed.
+void
+SenseTOP::deliverFrame(const float *depth, int32_t pitch, int64_t deviceTime, const uint16_t *raw, int32_t rawPitch)
+{
+	// Map the device clock onto the host clock. The smallest observed
+	// arrival delay is the best estimate of the offset between them.
+	double arrival = steadySeconds() - deviceTime * 1e-7;
+	if (!m_clockSynced || arrival < m_clockOffset) {
+		m_clockOffset = arrival;
+		m_clockSynced = true;
+	}
+	double captureTime = deviceTime * 1e-7 + m_clockOffset;
+
+	// From the source's own depth, so frames the queue drops still count
+	// and filled holes don't
+	presence.update(depth, pitch, WIDTH, HEIGHT);
+
+	// Hand the frame to the cook. Latest Only overwrites whatever the cook
+	// hasn't picked up yet. Otherwise the frame is queued, or dropped here if
+	// the queue is full; the cook is never made to wait.
+	FrameDelivery delivery = deliveryMode;
+	DepthFrame *frame = delivery == FrameDelivery::Latest ? &latestFrames.back() : frames.beginWrite(queueLimit);
+	if (frame) {
+		// With the automatic range on, the copy also counts the histogram
+		// and writes the normalised depth, unless holes are still to be
+		// filled. Each slot's buffer is allocated the first time.
+		int32_t radius = holeRadius;
+		frame->hasNormalized = autoRange;
+		if (frame->hasNormalized) {
+			frame->normalized.resize(WIDTH * HEIGHT);
+			histogram.convert(depth, pitch, WIDTH, HEIGHT, frame->depth.data(), radius > 0 ? nullptr : frame->normalized.data(),
+				processingPool());
+		}
+		else {
+			histogram.reset();
+			for (int y = 0; y < HEIGHT; y++)
+				memcpy(&frame->depth[y * WIDTH], (const uint8_t*)depth + y * pitch, WIDTH * sizeof(float));
+		}
+		frame->sequence = frameCount;
+		frame->deviceTime = deviceTime;
+		frame->time = captureTime;
+
+		// Only the cook's copy is filled; recordings, streams and shared
+		// memory keep the sensor's own depth
+		if (radius > 0) holes.fill(frame->depth.data(), WIDTH, HEIGHT, radius);
+		if (radius > 0 && frame->hasNormalized)
+			histogram.normalize(frame->depth.data(), frame->normalized.data(), WIDTH * HEIGHT);
+
+		// The pyramid is built here rather than in the cook, for every frame
+		// while the cook wants it
+		if (pyramidWanted) {
+			auto start = std::chrono::steady_clock::now();
+			frame->pyramid.build(frame->depth.data(), WIDTH, HEIGHT);
+			pyramidMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		else {
+			frame->pyramid.clear();
+		}
+		if (delivery == FrameDelivery::Latest)
+			latestFrames.publish();
+		else
+			frames.commitWrite();
+	}
+	else if (delivery == FrameDelivery::Fifo) {
+		// Only FIFO delivery lets the queue fill up in normal running.
+		// Timestamp matching counts the frames it misses as dropped.
+		queueOverflows++;
+	}
+
+	// Other processes read the same buffer through shared memory
+	sharedOutput.publish(depth, pitch, frameCount, deviceTime, captureTime);
+
+	if (!wantsRawDepth()) return;
+	if (!raw) {
+		m_rawDepth.resize(WIDTH * HEIGHT);
+		for (int y = 0; y < HEIGHT; y++) {
+			const float *row = (const float*)((const uint8_t*)depth + y * pitch);
+			for (int x = 0; x < WIDTH; x++)
+				m_rawDepth[y * WIDTH + x] = (uint16_t)std::min(std::max(row[x], 0.0f), 65535.0f);
+		}
+		raw = m_rawDepth.data();
+		rawPitch = WIDTH * sizeof(uint16_t);
+	}
+
+	// Encoding happens on the consumers' own worker threads
+	recorder.push(raw, rawPitch, frameCount, deviceTime, captureTime);
+	replay.push(raw, rawPitch, frameCount, deviceTime, captureTime);
+	streamer.push(raw, rawPitch, frameCount, deviceTime, captureTime);
 }
 
-// Threaded image capture from device
+// Threaded image capture.
+// The thread starts in the Connecting state and opens the selected source
+// itself, so the TOP never waits on the SDK or the network. Frames are
+// acquired with a bounded timeout. A source that stops delivering frames is
+// reported as stalled, and after STALL_TIMEOUT_MS (or when it reports
+// itself lost) it is closed and reopened with exponential backoff until it
+// comes back. Selecting a different source closes the current one.
 bool 
 SenseTOP::captureThread()
 {
-	bool started = false;
-	while (m_senseManager->AcquireFrame(true) == PXC_STATUS_NO_ERROR && running) {
-
-		if (!started) { printf("Started thread\n"); started = true; }
-
-		PXCCapture::Sample *sample;
-		sample = (PXCCapture::Sample*)m_senseManager->QuerySample();
-		if (sample && sample->depth) {
-			PXCImage::ImageInfo imageInfo = sample->depth->QueryInfo();
-			//int m_imageHeight = imageInfo.height;
-			//int m_imageWidth = imageInfo.width;
-			//int bufferSize = m_imageWidth * m_imageHeight * 4;
-			
-			int m_imageHeight = 640;
-			int m_imageWidth = 480;
-
-			PXCImage::ImageData imageData;
-			sample->depth->AcquireAccess(PXCImage::ACCESS_READ, PXCImage::PIXEL_FORMAT_DEPTH_F32, &imageData);
-
-			m.lock();
-			memcpy_s(m_depthmap, DATA_SIZE, imageData.planes[0], DATA_SIZE);
-			sample->depth->ReleaseAccess(&imageData);
-			m.unlock();
+	printf("Started thread\n");
+
+	int backoff = BACKOFF_MIN_MS;
+	auto lastFrame = std::chrono::steady_clock::now();
+	SourceSettings source;
+	int32_t openedVersion = -1;
+	bool open = false;
+
+	while (running) {
+
+		if (sourceVersion != openedVersion) {
+			{
+				std::lock_guard<std::mutex> lock(sourceMutex);
+				source = m_sourceSettings;
+				openedVersion = sourceVersion;
+			}
+			if (open) closeSource();
+			open = false;
+			backoff = BACKOFF_MIN_MS;
+			captureState = CaptureState::Connecting;
+		}
 
+		if (!open) {
+			if (!openSource(source)) {
+				closeSource();
+				if (!waitFor(backoff)) break;
+				backoff = std::min(backoff * 2, BACKOFF_MAX_MS);
+				continue;
+			}
+			if (captureState == CaptureState::Reconnecting) {
+				reconnectCount++;
+				printf("Reconnected source\n");
+			}
+			open = true;
+			backoff = BACKOFF_MIN_MS;
+			lastFrame = std::chrono::steady_clock::now();
+			captureState = CaptureState::Streaming;
 		}
-		m_senseManager->ReleaseFrame();
 
-		// Sleep, for debugging
-		//const auto wait_duration = std::chrono::milliseconds(100);
-		//std::this_thread::sleep_for(wait_duration);
+		DepthSourceResult result = m_source ? acquireSource() : acquireCamera();
+
+		if (result == DepthSourceResult::Timeout) {
+			auto stalledFor = std::chrono::steady_clock::now() - lastFrame;
+			if (stalledFor > std::chrono::milliseconds(STALL_TIMEOUT_MS)) {
+				printf("Source stalled, reconnecting\n");
+				closeSource();
+				open = false;
+				captureState = CaptureState::Reconnecting;
+			}
+			else if (captureState != CaptureState::Stalled) {
+				stallCount++;
+				captureState = CaptureState::Stalled;
+			}
+			continue;
+		}
+
+		if (result == DepthSourceResult::Lost) {
+			closeSource();
+			open = false;
+			captureState = CaptureState::Reconnecting;
+			continue;
+		}
+
+		control.frameBoundary(frameCount++);
+
+		lastFrame = std::chrono::steady_clock::now();
+		captureState = CaptureState::Streaming;
 
 	}
+	closeSource();
 	return true;
 }
 
@@ -188,109 +577,381 @@ SenseTOP::execute(const TOP_OutputFormatSpecs* outputFormat ,
 
 	myExecuteCount++;
 
-	// Update settings from custom parameters
-	if (myExecuteCount%10 == 0) ui.update(inputs);
+	// Update settings from custom parameters. Only changed values are handed
+	// to the control thread, which does the actual device writes.
+	// Preset switches are written together between two frames.
+	if (ui.update(inputs)) control.request(ui.settings, ui.presetSwitched);
+	ui.updateOutput(inputs);
+
+	// Start or stop recording. A file that could not be opened is not tried
+	// again every cook, only once Record is toggled or the path changes.
+	if (!ui.record) {
+		if (recorder.isRecording()) recorder.stop();
+		myRecordFailed = false;
+	}
+	else if (!recorder.isRecording() && !(myRecordFailed && ui.recordPath == myRecordFailedPath)) {
+		myRecordFailed = !recorder.start(ui.recordPath.c_str(), WIDTH, HEIGHT, ui.encoderThreads);
+		myRecordFailedPath = ui.recordPath;
+	}
+	replay.configure(ui.replay, ui.replaySeconds, (size_t)ui.replayMemoryMB << 20, WIDTH, HEIGHT);
+	bool shared = sharedOutput.configure(ui.sharedMemory, ui.sharedMemoryName.c_str(), WIDTH, HEIGHT, SHARED_SLOTS);
+	mySharedMemoryFailed = ui.sharedMemory && !shared;
+
+	// (Re)start the stream server when it's toggled or the port changes
+	int32_t streamPort = ui.stream ? ui.streamPort : 0;
+	if (streamPort != myStreamPort) {
+		myStreamPort = streamPort;
+		streamer.stop();
+		myStreamFailed = streamPort && !streamer.start(streamPort, WIDTH, HEIGHT);
+	}
+
+	holeRadius = ui.fillHoles ? ui.holeRadius : 0;
+	histogram.lowPercentile = ui.rangePercentiles[0];
+	histogram.highPercentile = ui.rangePercentiles[1];
+	histogram.smoothing = ui.rangeSmoothing;
+	autoRange = ui.autoRange && ui.outputMode == OutputMode::Depth;
+
+	// The capture thread reopens when the source changes
+	{
+		std::lock_guard<std::mutex> lock(sourceMutex);
+		if (ui.source != m_sourceSettings) {
+			m_sourceSettings = ui.source;
+			sourceVersion++;
+		}
+	}
 
 	int width = outputFormat->width;
 	int height = outputFormat->height;
 
+	// Pick the frame to show according to the delivery policy. consume is
+	// the number of queued frames released after this cook.
+	deliveryMode = ui.delivery;
+	queueLimit = ui.delivery == FrameDelivery::Fifo ? ui.queueSize : FRAME_QUEUE_MAX;
+	size_t available = frames.size();
+	size_t consume = 0;
+	DepthFrame *frame = nullptr;
+	switch (ui.delivery)
+	{
+	case FrameDelivery::Latest:
+		// Frames queued before switching to Latest Only are dropped
+		consume = available;
+		if (latestFrames.update()) frame = &latestFrames.front();
+		break;
+	case FrameDelivery::Fifo:
+		if (available > 0) {
+			frame = frames.peek(0);
+			consume = 1;
+		}
+		break;
+	case FrameDelivery::Timestamp:
+	{
+		// Frames captured well before the target, such as those queued while
+		// nothing cooked, are dropped rather than shown late. Of the rest,
+		// the one closest to this cook's time minus the requested delay is
+		// shown, and the ones before it dropped.
+		double target = steadySeconds() - ui.matchDelay;
+		while (consume < available && frames.peek(consume)->time < target - MATCH_WINDOW)
+			consume++;
+		double bestError = 0.0;
+		for (size_t i = consume; i < available; i++) {
+			double error = std::abs(frames.peek(i)->time - target);
+			if (!frame || error < bestError) {
+				bestError = error;
+				frame = frames.peek(i);
+				consume = i + 1;
+			}
+		}
+		break;
+	}
+	}
+	// A frame left from Latest Only is stale once the queue is used again
+	if (ui.delivery != FrameDelivery::Latest)
+		latestFrames.update();
+	bool newFrame = frame != nullptr;
+
+	// Latest Only and timestamp matching skip frames; FIFO only loses the
+	// ones that overflow the queue
+	if (newFrame && ui.delivery != FrameDelivery::Fifo && m_uploadedSequence >= 0 && frame->sequence > m_uploadedSequence)
+		framesDropped += (int32_t)(frame->sequence - m_uploadedSequence - 1);
+
+	// A used floor calibration replaces the object or file transform
+	Matrix cameraToWorld = ui.cameraToWorld;
+	myTransformSource = ui.transformSource;
+	FloorPlane plane;
+	if (ui.useFloor && floor.result(plane)) {
+		cameraToWorld = plane.cameraToFloor;
+		myTransformSource = "floor";
+	}
+
+	// World positions, the heightmap, the samples, the triggers and the
+	// targets need the points in the world
+	bool top = ui.outputMode == OutputMode::Heightmap;
+	bool fusing = ui.outputMode == OutputMode::Tsdf;
+	bool showPoints = ui.outputMode == OutputMode::WorldXYZ;
+	bool sampling = ui.outputMode == OutputMode::Samples;
+	bool world = showPoints || top || sampling || ui.trackTargets || !ui.triggers.empty();
+	bool pyramid = ui.outputMode == OutputMode::DepthPyramid;
+	pyramidWanted = pyramid || fusing;
+	bool modeChanged = ui.outputMode != myOutputMode;
+	bool transformChanged = world &&
+		memcmp(cameraToWorld.matrix, myCameraToWorld.matrix, sizeof(myCameraToWorld.matrix)) != 0;
+	bool gridChanged = top && ui.heightmap != heightmap.settings();
+	bool triggersChanged = ui.triggersChanged;
+	if (triggersChanged) triggers.configure(ui.triggers);
+	bool samplesChanged = sampling && (mySamples.size() != (size_t)ui.sampleCount * 4 ||
+		memcmp(ui.foreground, mySampleRange, sizeof(mySampleRange)) != 0);
+
+	// Other cameras only run while the heightmap is shown. Any of them
+	// finishing a layer is reason enough to fuse again.
+	bool fusionChanged = fusion.size() != (top ? ui.fusionCameras.size() : 0);
+	for (size_t i = 0; i < fusion.size() && !fusionChanged; i++)
+		fusionChanged = fusion[i]->settings() != ui.fusionCameras[i];
+	if (fusionChanged) {
+		fusion.clear();
+		if (top) {
+			for (const FusionCameraSettings &camera : ui.fusionCameras)
+				fusion.emplace_back(new FusionCamera(camera, WIDTH, HEIGHT));
+		}
+	}
+	bool fusionUpdated = false;
+	for (std::unique_ptr<FusionCamera> &camera : fusion) {
+		camera->configure(ui.heightmap);
+		fusionUpdated = fusionUpdated || camera->hasUpdate();
+	}
+	bool calibrate = myCalibrateFloor && newFrame && !floor.isRunning();
+
+	DepthIntrinsics k = ui.calibration.intrinsics;
+	if (!k.isValid()) {
+		std::lock_guard<std::mutex> lock(intrinsicsMutex);
+		k = m_intrinsics;
+	}
+
+	// Frames queued before the pyramid was asked for don't have one yet
+	if ((pyramid || fusing) && newFrame && !frame->pyramid.isBuilt())
+		frame->pyramid.build(frame->depth.data(), WIDTH, HEIGHT);
+
+	// TSDF fusion runs on its own workers, only created once it is used.
+	// Frames arriving while it is still busy are skipped. The raycast
+	// skips empty space with the frame's pyramid.
+	if (fusing && !tsdf) tsdf.reset(new TsdfFusion(WIDTH, HEIGHT));
+	if (fusing && newFrame) tsdf->submit(frame->depth.data(), frame->pyramid, k, cameraToWorld, ui.tsdf, processingPool());
+	bool tsdfRendered = fusing && tsdf->hasUpdate();
+
+	// Contours are traced in the background while they are turned on. The
+	// cook only swaps in the newest finished set.
+	if (!ui.traceContours) {
+		contours.reset();
+		myContours = nullptr;
+	}
+	else {
+		if (!contours) contours.reset(new ContourTracer(WIDTH, HEIGHT));
+		if (newFrame) contours->submit(frame->depth.data(), frame->sequence, ui.contours, processingPool());
+		myContours = &contours->latest();
+	}
+
+	// Nothing to do if the output already holds this frame. Buffers are not
+	// cleared between cooks, so the previous output stays in place.
+	bool resized = width != myOutputWidth || height != myOutputHeight;
+	if (!newFrame && !resized && !modeChanged && !transformChanged && !gridChanged && !triggersChanged && !samplesChanged && !fusionUpdated && !tsdfRendered && !calibrate && didGLSetup) {
+		duplicateSkips++;
+		frames.pop(consume);
+		return;
+	}
+	myOutputWidth = width;
+	myOutputHeight = height;
+	myOutputMode = ui.outputMode;
+
+	// World positions: deproject each new frame into camera space, then
+	// move the grid into the world whenever the frame or transform changes
+	auto pointsStart = std::chrono::steady_clock::now();
+	if (newFrame && (world || calibrate)) {
+		deprojectDepth(frame->depth.data(), WIDTH, HEIGHT, k, myCameraPoints.data());
+		myPointsTime = frame->time;
+	}
+
+	// The floor is searched for on a background worker. Up in camera space
+	// comes from the current transform, so a roughly placed camera object
+	// tells it which way the floor faces.
+	if (calibrate) {
+		Matrix worldToCamera;
+		float up[4] = { 0.0f, 1.0f, 0.0f, 0.0f };
+		if (ui.cameraToWorld.inverse(worldToCamera))
+			worldToCamera.transformPoints(up, up, 1);
+		floor.start(myCameraPoints.data(), WIDTH * HEIGHT, up, (float)ui.floorTilt, processingPool());
+		myCalibrateFloor = false;
+	}
+
+	bool pointsUpdated = false;
+	if (world && (newFrame || transformChanged || modeChanged || triggersChanged)) {
+		myCameraToWorld = cameraToWorld;
+		myCameraToWorld.transformPoints(myCameraPoints.data(), myWorldPoints.data(), WIDTH * HEIGHT);
+		myPointsMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pointsStart).count();
+		pointsUpdated = true;
+	}
+
+	// Top-down projection of the world points, fused with the newest layer
+	// of every connected camera
+	bool heightmapUpdated = false;
+	if (top && (pointsUpdated || gridChanged || fusionUpdated)) {
+		std::vector<const HeightmapLayer*> layers;
+		for (std::unique_ptr<FusionCamera> &camera : fusion) {
+			const HeightmapLayer *layer = camera->latest();
+			if (layer && camera->connected) layers.push_back(layer);
+		}
+		heightmap.configure(ui.heightmap);
+		heightmap.project(myWorldPoints.data(), WIDTH * HEIGHT, myPointsTime, layers, processingPool());
+		heightmapUpdated = true;
+	}
+
+	// A fixed number of points picked from the foreground
+	bool samplesUpdated = false;
+	if (sampling && (pointsUpdated || samplesChanged)) {
+		mySamples.resize((size_t)ui.sampleCount * 4);
+		memcpy(mySampleRange, ui.foreground, sizeof(mySampleRange));
+		sampler.sample(myCameraPoints.data(), myWorldPoints.data(), WIDTH, HEIGHT, ui.foreground[0], ui.foreground[1],
+			ui.sampleCount, (uint32_t)myExecuteCount, mySamples.data(), processingPool());
+		samplesUpdated = true;
+	}
+
+	// Targets follow the blobs of each new frame, timed by its capture
+	if (!ui.trackTargets)
+		targets.reset();
+	else if (pointsUpdated && newFrame)
+		targets.update(myCameraPoints.data(), myWorldPoints.data(), WIDTH, HEIGHT, myPointsTime, ui.tracker,
+			processingPool());
+
+	// Points inside each trigger box, on this cook so they are never a
+	// frame behind the output
+	if (pointsUpdated && !ui.triggers.empty())
+		triggers.evaluate(myWorldPoints.data(), WIDTH * HEIGHT, processingPool());
+
     context->beginGLCommands();
     
     setupGL();
 
     if (!myError)
     {
-		glViewport(0, 0, width, height);
-		glClearColor(0.0, 0.0, 0.0, 0.0);
-		glClear(GL_COLOR_BUFFER_BIT);
-
 		// Realsense stuff
-		// bind the texture and PBO
-		glBindTexture(GL_TEXTURE_2D, textureId);
-
-		//if (m_depthmap) glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, WIDTH, HEIGHT, 0, PIXEL_FORMAT, GL_UNSIGNED_BYTE, m_depthmap);
-		if (m_depthmap)
-			memcpy_s(m_image, DATA_SIZE, m_depthmap, DATA_SIZE);
-		
-		if(m_image)
-			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, PIXEL_FORMAT, GL_FLOAT, m_image);
+		// upload the latest depth frame
+		if (newFrame) {
+			glBindTexture(GL_TEXTURE_2D, textureId);
+			const float *texels = frame->hasNormalized ? frame->normalized.data() : frame->depth.data();
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, PIXEL_FORMAT, GL_FLOAT, texels);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			m_uploadedSequence = frame->sequence;
+			uploadCount++;
+		}
+		if (pointsUpdated && showPoints) {
+			glBindTexture(GL_TEXTURE_2D, pointTextureId);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RGBA, GL_FLOAT, myWorldPoints.data());
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
 
-		glBindTexture(GL_TEXTURE_2D, 0);
+		if (tsdfRendered) {
+			glBindTexture(GL_TEXTURE_2D, pointTextureId);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RGBA, GL_FLOAT, tsdf->latest());
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		const HeightmapSettings &grid = heightmap.settings();
+		if (heightmapUpdated) {
+			glBindTexture(GL_TEXTURE_2D, heightmapTextureId);
+			if (grid.width != myHeightmapWidth || grid.height != myHeightmapHeight) {
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, grid.width, grid.height, 0, GL_RG, GL_FLOAT, heightmap.data());
+				myHeightmapWidth = grid.width;
+				myHeightmapHeight = grid.height;
+			}
+			else {
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, grid.width, grid.height, GL_RG, GL_FLOAT, heightmap.data());
+			}
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
 
-		// save the initial ModelView matrix before modifying ModelView matrix
-		glPushMatrix();
+		if (samplesUpdated) {
+			int32_t count = (int32_t)(mySamples.size() / 4);
+			glBindTexture(GL_TEXTURE_2D, samplesTextureId);
+			if (count != mySamplesWidth) {
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, count, 1, 0, GL_RGBA, GL_FLOAT, mySamples.data());
+				mySamplesWidth = count;
+			}
+			else {
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, count, 1, GL_RGBA, GL_FLOAT, mySamples.data());
+			}
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
 
-		// draw a point with texture
-		glBindTexture(GL_TEXTURE_2D, textureId);
-		glColor4f(1, 1, 1, 1);
-		glBegin(GL_QUADS);
-		glNormal3f(0, 0, 1);
-		glTexCoord2f(0, 0); glVertex3f(-1, -1, 0);
-		glTexCoord2f(0, 1); glVertex3f(-1, 1, 0);
-		glTexCoord2f(1, 1); glVertex3f(1, 1, 0);
-		glTexCoord2f(1, 0); glVertex3f(1, -1, 0);
-		glEnd();
-
-		// unbind texture
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glPopMatrix();
+		// Pyramid levels go straight into their place in the atlas, except
+		// level 0, which needs its depth doubled up into both channels
+		if (pyramid && newFrame) {
+			const DepthPyramid &levels = frame->pyramid;
+			for (int i = 0; i < WIDTH * HEIGHT; i++)
+				myPyramidTexels[2 * i] = myPyramidTexels[2 * i + 1] = frame->depth[i];
+			glBindTexture(GL_TEXTURE_2D, pyramidTextureId);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RG, GL_FLOAT, myPyramidTexels.data());
+			for (int l = 1; l < levels.levels(); l++) {
+				int x, y;
+				levels.atlasOrigin(l, x, y);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, levels.width(l), levels.height(l), GL_RG, GL_FLOAT, levels.level(l));
+			}
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
 
+		// Copy it into the TOP's FBO. The blit covers the whole output, so
+		// no clear or draw state is needed.
+		int atlasWidth, atlasHeight;
+		DepthPyramid::atlasSize(WIDTH, HEIGHT, atlasWidth, atlasHeight);
+		GLuint source = top ? heightmapFBO : pyramid ? pyramidFBO : sampling ? samplesFBO : (showPoints || fusing) ? pointFBO : readFBO;
+		GLint sourceWidth = top ? myHeightmapWidth : pyramid ? atlasWidth : sampling ? mySamplesWidth : WIDTH;
+		GLint sourceHeight = top ? myHeightmapHeight : pyramid ? atlasHeight : sampling ? 1 : HEIGHT;
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context->getFBOIndex());
+		glBlitFramebuffer(0, 0, sourceWidth, sourceHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, context->getFBOIndex());
 
 	}
 
     context->endGLCommands();
 
+	// glTexSubImage2D has copied the frame, hand the slots back. The Latest
+	// Only frame stays in front of latestFrames until the next update().
+	frames.pop(consume);
+
 }
 
 
 void
 SenseTOP::setupParameters(OP_ParameterManager* manager)
 {
-	// allocate texture buffer
-	m_depthmap = new float[DATA_SIZE];
-	memset(m_depthmap, 0, DATA_SIZE);
-
-	m_image = new float[DATA_SIZE];
-	memset(m_image, 0, DATA_SIZE);
-
-
-	// Creates an instance of the PXCSenseManager */
-	m_senseManager = PXCSenseManager::CreateInstance();
+	// Only declares the TOP parameters. This is called again on every
+	// parameter page rebuild, so the device is brought up by the capture
+	// thread instead.
+	ui.init(manager);
 
-	m_senseManager->EnableStream(PXCCapture::STREAM_TYPE_DEPTH , 640, 480);
-	m_senseManager->Init();
-	printf("SenseManager initalized\n");
+}
 
-	PXCCaptureManager *m_capMan = m_senseManager->QueryCaptureManager();
-	m_device = m_capMan->QueryDevice();
-	
-	// Print device info
-	PXCCapture *cap = m_capMan->QueryCapture();
-	for (int i = 0;; i++) {
-		PXCCapture::DeviceInfo dinfo;
-		if (cap->QueryDeviceInfo(i, &dinfo) < PXC_STATUS_NO_ERROR) break;
-		wprintf_s(L"device[%d]: %s\n\n", i, dinfo.name);
+void
+SenseTOP::pulsePressed(const char* name)
+{
+	// Written by a background thread, so this returns immediately
+	if (!strcmp(name, "Dumpreplay"))
+	{
+		replay.dump(ui.replayFolder.c_str());
 	}
 
-	// Start thread to capture data
-	if (!startedThread) {
-		threads.emplace_back(std::bind(&SenseTOP::captureThread, this));
-		startedThread = true;
+	if (!strcmp(name, "Reloadpresets"))
+	{
+		ui.reloadPresets = true;
 	}
 
-	// Set up TOP parameters
-	ui.init(manager, m_device);
-
-}
+	if (!strcmp(name, "Tsdfreset") && tsdf)
+	{
+		tsdf->reset();
+	}
 
-void
-SenseTOP::pulsePressed(const char* name)
-{
-	if (!strcmp(name, "Reset"))
+	// Uses the next frame that arrives
+	if (!strcmp(name, "Calibratefloor"))
 	{
-		myRotation = 0.0;
+		myCalibrateFloor = true;
 	}
 }
 
@@ -303,18 +964,95 @@ void SenseTOP::setupGL()
 		glBindTexture(GL_TEXTURE_2D, textureId);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, WIDTH, HEIGHT, 0, PIXEL_FORMAT, GL_FLOAT, (GLvoid*)m_depthmap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		std::vector<float> black(WIDTH * HEIGHT, 0.0f);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, WIDTH, HEIGHT, 0, PIXEL_FORMAT, GL_FLOAT, (GLvoid*)black.data());
 		glBindTexture(GL_TEXTURE_2D, 0);
 
-		//glGenBuffers(1, &pboID);
-		//glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pboID);
-		//glBufferData(GL_PIXEL_UNPACK_BUFFER, DATA_SIZE, 0, GL_STREAM_DRAW);
-		//glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		// Framebuffer used as the source of the blit into the TOP's FBO
+		glGenFramebuffers(1, &readFBO);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureId, 0);
+		if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			myError = "Depth framebuffer is incomplete";
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+		// Same again for the world positions
+		glGenTextures(1, &pointTextureId);
+		glBindTexture(GL_TEXTURE_2D, pointTextureId);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, WIDTH, HEIGHT, 0, GL_RGBA, GL_FLOAT, (GLvoid*)myWorldPoints.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &pointFBO);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, pointFBO);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pointTextureId, 0);
+		if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			myError = "Point framebuffer is incomplete";
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+		// And the heightmap, which is resized along with the grid
+		const HeightmapSettings &grid = heightmap.settings();
+		glGenTextures(1, &heightmapTextureId);
+		glBindTexture(GL_TEXTURE_2D, heightmapTextureId);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, grid.width, grid.height, 0, GL_RG, GL_FLOAT, (GLvoid*)heightmap.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+		myHeightmapWidth = grid.width;
+		myHeightmapHeight = grid.height;
+
+		glGenFramebuffers(1, &heightmapFBO);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, heightmapFBO);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, heightmapTextureId, 0);
+		if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			myError = "Heightmap framebuffer is incomplete";
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+		// And the depth pyramid atlas. Texels outside the levels stay 0.
+		int atlasWidth, atlasHeight;
+		DepthPyramid::atlasSize(WIDTH, HEIGHT, atlasWidth, atlasHeight);
+		std::vector<float> empty(atlasWidth * atlasHeight * 2, 0.0f);
+		glGenTextures(1, &pyramidTextureId);
+		glBindTexture(GL_TEXTURE_2D, pyramidTextureId);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, atlasWidth, atlasHeight, 0, GL_RG, GL_FLOAT, (GLvoid*)empty.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
 
+		glGenFramebuffers(1, &pyramidFBO);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, pyramidFBO);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTextureId, 0);
+		if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			myError = "Pyramid framebuffer is incomplete";
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+		// And the samples, a single row resized along with the count
+		std::vector<float> none(4, 0.0f);
+		glGenTextures(1, &samplesTextureId);
+		glBindTexture(GL_TEXTURE_2D, samplesTextureId);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 1, 1, 0, GL_RGBA, GL_FLOAT, (GLvoid*)none.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+		mySamplesWidth = 1;
 
-		glEnable(GL_TEXTURE_2D);
+		glGenFramebuffers(1, &samplesFBO);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, samplesFBO);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, samplesTextureId, 0);
+		if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			myError = "Samples framebuffer is incomplete";
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 
 		didGLSetup = true;
 	}
@@ -322,12 +1060,222 @@ void SenseTOP::setupGL()
 
 }
 
+static const char*
+captureStateName(CaptureState state)
+{
+	switch (state)
+	{
+	case CaptureState::Connecting:		return "connecting";
+	case CaptureState::Streaming:		return "streaming";
+	case CaptureState::Stalled:			return "stalled";
+	case CaptureState::Reconnecting:	return "reconnecting";
+	}
+	return "unknown";
+}
+
+void
+SenseTOP::gatherInfo()
+{
+	CaptureState state = captureState;
+
+	myInfo.clear();
+	myInfo.push_back({ "executeCount", (double)myExecuteCount, nullptr });
+	myInfo.push_back({ "captureState", (double)state, captureStateName(state) });
+	myInfo.push_back({ "reconnects", (double)reconnectCount, nullptr });
+	myInfo.push_back({ "stalls", (double)stallCount, nullptr });
+	myInfo.push_back({ "controlBatches", (double)control.batchesApplied, nullptr });
+	myInfo.push_back({ "propertyWrites", (double)control.propertiesWritten, nullptr });
+	myInfo.push_back({ "coalescedRequests", (double)control.requestsCoalesced, nullptr });
+	myInfo.push_back({ "propertyWriteFailures", (double)control.writeFailures, nullptr });
+	myDroppedValues = control.droppedValues();
+	myInfo.push_back({ "droppedDeviceValues", (double)control.valuesDropped,
+		myDroppedValues.empty() ? nullptr : myDroppedValues.c_str() });
+	myInfo.push_back({ "frames", (double)frameCount, nullptr });
+	myInfo.push_back({ "sequence", (double)m_uploadedSequence, nullptr });
+	myInfo.push_back({ "uploads", (double)uploadCount, nullptr });
+	myInfo.push_back({ "duplicateSkips", (double)duplicateSkips, nullptr });
+	myInfo.push_back({ "queued", (double)frames.size(), nullptr });
+	myInfo.push_back({ "queueOverflows", (double)queueOverflows, nullptr });
+	myInfo.push_back({ "framesDropped", (double)framesDropped, nullptr });
+
+	int64_t recordedIn = recorder.bytesIn;
+	int64_t recordedOut = recorder.bytesOut;
+	int64_t encodeMicros = recorder.encodeMicros;
+	myInfo.push_back({ "recording", (double)recorder.isRecording(), nullptr });
+	myInfo.push_back({ "recordedFrames", (double)recorder.framesWritten, nullptr });
+	myInfo.push_back({ "recordDrops", (double)recorder.framesDropped, nullptr });
+	myInfo.push_back({ "compressionRatio", recordedOut > 0 ? (double)recordedIn / recordedOut : 0.0, nullptr });
+	myInfo.push_back({ "encodeMBps", encodeMicros > 0 ? (double)recordedIn / encodeMicros : 0.0, nullptr });
+	myInfo.push_back({ "replayFrames", (double)replay.frames, nullptr });
+	myInfo.push_back({ "replaySeconds", (double)replay.seconds, nullptr });
+	myInfo.push_back({ "replayMB", (double)replay.bytes / (1 << 20), nullptr });
+	myInfo.push_back({ "replayDumps", (double)replay.dumps, nullptr });
+	myInfo.push_back({ "replayDumping", (double)replay.dumping, nullptr });
+	myInfo.push_back({ "sharedMemory", (double)sharedOutput.isOpen(), nullptr });
+	myInfo.push_back({ "sharedPublished", (double)sharedOutput.framesPublished, nullptr });
+	myInfo.push_back({ "sharedPublishMs", (double)sharedOutput.publishMicros / 1000.0, nullptr });
+	myInfo.push_back({ "pointsMs", myPointsMs, nullptr });
+	myInfo.push_back({ "cameraToWorld", (double)(ui.outputMode != OutputMode::Depth), myTransformSource });
+	myInfo.push_back({ "heightmapMs", (double)heightmap.lastMs, nullptr });
+	myInfo.push_back({ "heightmapOccupied", (double)heightmap.occupiedCells, nullptr });
+	myInfo.push_back({ "heightmapLayers", (double)heightmap.layersFused, nullptr });
+	myInfo.push_back({ "sampleCandidates", (double)sampler.candidates, nullptr });
+	myInfo.push_back({ "samplesMs", (double)sampler.lastMs, nullptr });
+	myInfo.push_back({ "pyramidMs", (double)pyramidMs, nullptr });
+	myInfo.push_back({ "validRatio", (double)presence.validRatio, nullptr });
+	myInfo.push_back({ "nearestMm", (double)presence.nearest, nullptr });
+	myInfo.push_back({ "farthestMm", (double)presence.farthest, nullptr });
+	myInfo.push_back({ "meanDepthMm", (double)presence.mean, nullptr });
+	myInfo.push_back({ "depthSpreadMm", (double)presence.spread, nullptr });
+	myInfo.push_back({ "motionEnergyMm", (double)presence.motionEnergy, nullptr });
+	myInfo.push_back({ "movingRatio", (double)presence.movingRatio, nullptr });
+	myInfo.push_back({ "presenceMs", (double)presence.lastMs, nullptr });
+	bool ranging = autoRange;
+	myInfo.push_back({ "rangeLowMm", ranging ? (double)histogram.low : 0.0, nullptr });
+	myInfo.push_back({ "rangeHighMm", ranging ? (double)histogram.high : 0.0, nullptr });
+	myInfo.push_back({ "rangeMedianMm", ranging ? (double)histogram.median : 0.0, nullptr });
+	myInfo.push_back({ "rangeNearMm", ranging ? (double)histogram.nearDepth : 0.0, nullptr });
+	myInfo.push_back({ "rangeFarMm", ranging ? (double)histogram.farDepth : 0.0, nullptr });
+	myInfo.push_back({ "histogramMs", ranging ? (double)histogram.lastMs : 0.0, nullptr });
+	myInfo.push_back({ "holesFilled", ui.fillHoles ? (double)holes.filledPixels : 0.0, nullptr });
+	myInfo.push_back({ "holesMarked", ui.fillHoles ? (double)holes.markedPixels : 0.0, nullptr });
+	myInfo.push_back({ "holeFillMs", ui.fillHoles ? (double)holes.lastMs : 0.0, nullptr });
+
+	// TSDF fusion, once it has been used
+	if (tsdf) {
+		myInfo.push_back({ "tsdfIntegrated", (double)tsdf->framesIntegrated, nullptr });
+		myInfo.push_back({ "tsdfSkipped", (double)tsdf->framesSkipped, nullptr });
+		myInfo.push_back({ "tsdfIntegrateMs", (double)tsdf->integrateMs, nullptr });
+		myInfo.push_back({ "tsdfRaycastMs", (double)tsdf->raycastMs, nullptr });
+		myInfo.push_back({ "tsdfBlocks", (double)tsdf->blocks, tsdf->full ? "full" : nullptr });
+		myInfo.push_back({ "tsdfVisibleBlocks", (double)tsdf->visibleBlocks, nullptr });
+
+		// Camera tracking, with the pose one channel per element, row by row
+		const IcpTracker &tracker = tsdf->tracker();
+		myInfo.push_back({ "trackingLost", (double)tsdf->trackingLost, nullptr });
+		myInfo.push_back({ "trackingLostCount", (double)tracker.lost, nullptr });
+		myInfo.push_back({ "trackingMs", (double)tracker.lastMs, nullptr });
+		myInfo.push_back({ "trackingRmsMm", (double)tracker.rmsError, nullptr });
+		myInfo.push_back({ "trackingInliers", (double)tracker.inlierRatio, nullptr });
+		Matrix pose = tsdf->pose();
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+				myInfo.push_back({ "pose" + std::to_string(r) + std::to_string(c), pose[c * 4 + r], nullptr });
+	}
+
+	// Contours, one row each with its points as text, largest first
+	if (contours) {
+		myInfo.push_back({ "contours", (double)myContours->contours.size(), nullptr });
+		myInfo.push_back({ "contoursFound", (double)contours->contoursFound, nullptr });
+		myInfo.push_back({ "contourSequence", (double)myContours->sequence, nullptr });
+		myInfo.push_back({ "contourMs", (double)contours->lastMs, nullptr });
+		myInfo.push_back({ "contourSkipped", (double)contours->framesSkipped, nullptr });
+		for (size_t i = 0; i < myContours->contours.size(); i++) {
+			const Contour &contour = myContours->contours[i];
+			std::string name = "contour" + std::to_string(i);
+			myInfo.push_back({ name, (double)(contour.points.size() / 2), contour.text.c_str() });
+			myInfo.push_back({ name + "Area", contour.area, nullptr });
+		}
+	}
+
+	// Targets by slot, predicted to now plus the latency still to come.
+	// The prediction is made here, when the values are read, so it covers
+	// everything since the frame was captured.
+	if (ui.trackTargets) {
+		double latency = targets.time() > 0.0 ? steadySeconds() - targets.time() + ui.extraLatency * 0.001 : 0.0;
+		targets.predict(latency, myTargets);
+		myInfo.push_back({ "targets", (double)targets.trackCount, nullptr });
+		myInfo.push_back({ "blobs", (double)targets.blobCount, nullptr });
+		myInfo.push_back({ "targetLatencyMs", latency * 1000.0, nullptr });
+		myInfo.push_back({ "blobMs", (double)targets.blobMs, nullptr });
+		myInfo.push_back({ "trackMs", (double)targets.trackMs, nullptr });
+		for (size_t i = 0; i < myTargets.size(); i++) {
+			const Target &target = myTargets[i];
+			std::string name = "target" + std::to_string(i);
+			myInfo.push_back({ name, (double)target.present, nullptr });
+			myInfo.push_back({ name + "Id", (double)target.id, nullptr });
+			myInfo.push_back({ name + "X", target.position[0], nullptr });
+			myInfo.push_back({ name + "Y", target.position[1], nullptr });
+			myInfo.push_back({ name + "Z", target.position[2], nullptr });
+			myInfo.push_back({ name + "Vx", target.velocity[0], nullptr });
+			myInfo.push_back({ name + "Vy", target.velocity[1], nullptr });
+			myInfo.push_back({ name + "Vz", target.velocity[2], nullptr });
+		}
+	}
+
+	// One set of rows per trigger box, named by its name column
+	const std::vector<TriggerVolume> &volumes = triggers.volumes();
+	const std::vector<TriggerState> &states = triggers.states();
+	for (size_t i = 0; i < volumes.size(); i++) {
+		const TriggerState &state = states[i];
+		std::string name = "trigger" + std::to_string(i);
+		myInfo.push_back({ name, (double)state.occupied, volumes[i].name.c_str() });
+		myInfo.push_back({ name + "Count", (double)state.count, nullptr });
+		myInfo.push_back({ name + "X", state.centroid[0], nullptr });
+		myInfo.push_back({ name + "Y", state.centroid[1], nullptr });
+		myInfo.push_back({ name + "Z", state.centroid[2], nullptr });
+		myInfo.push_back({ name + "Enter", (double)state.entered, nullptr });
+		myInfo.push_back({ name + "Exit", (double)state.exited, nullptr });
+	}
+	myInfo.push_back({ "triggersMs", volumes.empty() ? 0.0 : (double)triggers.lastMs, nullptr });
+
+	// One set of rows per fusion camera, named by its calibration file
+	for (size_t i = 0; i < fusion.size(); i++) {
+		const FusionCamera &camera = *fusion[i];
+		std::string name = "fusion" + std::to_string(i);
+		myInfo.push_back({ name, (double)camera.connected, camera.settings().calibrationPath.c_str() });
+		myInfo.push_back({ name + "Frames", (double)camera.frames, nullptr });
+		myInfo.push_back({ name + "Ms", (double)camera.projectMs, nullptr });
+	}
+
+	// Floor calibration, with the camera-to-floor matrix one row per entry
+	FloorPlane plane;
+	bool hasFloor = floor.result(plane);
+	const char* floorStatus = floor.isRunning() ? "running" : hasFloor ? "found" : floor.failures > 0 ? "failed" : "none";
+	myInfo.push_back({ "floor", (double)hasFloor, floorStatus });
+	myInfo.push_back({ "floorHeight", plane.distance, nullptr });
+	myInfo.push_back({ "floorPitch", plane.pitch, nullptr });
+	myInfo.push_back({ "floorRoll", plane.roll, nullptr });
+	myInfo.push_back({ "floorInliers", plane.points > 0 ? (double)plane.inliers / plane.points : 0.0, nullptr });
+	myInfo.push_back({ "floorRmsMm", plane.rms * 1000.0, nullptr });
+	myInfo.push_back({ "floorMs", (double)floor.lastMs, nullptr });
+	for (int r = 0; r < 4; r++) {
+		const Matrix &m = plane.cameraToFloor;
+		char row[128];
+		snprintf(row, sizeof(row), "%g %g %g %g", m[r], m[4 + r], m[8 + r], m[12 + r]);
+		myFloorRows[r] = row;
+		myInfo.push_back({ "cameraToFloor" + std::to_string(r), (double)r, myFloorRows[r].c_str() });
+	}
+	myInfo.push_back({ "sourceMBps", (double)sourceMegabytesPerSecond, nullptr });
+	myInfo.push_back({ "sourceLatencyMs", sourceLatency * 1000.0, nullptr });
+	myInfo.push_back({ "streaming", (double)streamer.isRunning(), nullptr });
+	myInfo.push_back({ "streamClients", (double)streamer.clients, nullptr });
+	myInfo.push_back({ "streamFrames", (double)streamer.framesEncoded, nullptr });
+	myInfo.push_back({ "streamEncodeDrops", (double)streamer.framesDropped, nullptr });
+
+	// One group of rows per connected client, the first naming its address
+	myLinks = streamer.linkStats();
+	for (size_t i = 0; i < myLinks.size(); i++) {
+		const DepthStreamServer::LinkStats &link = myLinks[i];
+		std::string prefix = "link" + std::to_string(i);
+		myInfo.push_back({ prefix, (double)i, link.peer.c_str() });
+		myInfo.push_back({ prefix + "MBps", link.megabytesPerSecond, nullptr });
+		myInfo.push_back({ prefix + "LatencyMs", link.latency * 1000.0, nullptr });
+		myInfo.push_back({ prefix + "Sent", (double)link.framesSent, nullptr });
+		myInfo.push_back({ prefix + "Drops", (double)link.framesDropped, nullptr });
+	}
+	myInfo.push_back({ "preset", (double)ui.presets.count(ui.activePreset), ui.activePreset.c_str() });
+	myInfo.push_back({ "presetWrittenAfterFrame", (double)control.boundaryFrame, nullptr });
+}
+
 int32_t
 SenseTOP::getNumInfoCHOPChans()
 {
 	// We return the number of channel we want to output to any Info CHOP
-	// connected to the TOP. In this example we are just going to send one channel.
-	return 2;
+	// connected to the TOP. The values are snapshotted here so all channels
+	// of one cook are consistent.
+	gatherInfo();
+	return (int32_t)myInfo.size();
 }
 
 void
@@ -335,25 +1283,17 @@ SenseTOP::getInfoCHOPChan(int32_t index,
 	OP_InfoCHOPChan* chan)
 {
 	// This function will be called once for each channel we said we'd want to return
-	// In this example it'll only be called once.
+	if (index < 0 || index >= (int32_t)myInfo.size()) return;
 
-	if (index == 0)
-	{
-		chan->name = "executeCount";
-		chan->value = (float)myExecuteCount;
-	}
-
-	if (index == 1)
-	{
-		chan->name = "rotation";
-		chan->value = (float)myRotation;
-	}
+	chan->name = myInfo[index].name.c_str();
+	chan->value = (float)myInfo[index].value;
 }
 
 bool
 SenseTOP::getInfoDATSize(OP_InfoDATSize* infoSize)
 {
-	infoSize->rows = 2;
+	gatherInfo();
+	infoSize->rows = (int32_t)myInfo.size();
 	infoSize->cols = 2;
 	// Setting this to false means we'll be assigning values to the table
 	// one row at a time. True means we'll do it one column at a time.
@@ -372,42 +1312,50 @@ SenseTOP::getInfoDATEntries(int32_t index,
 	static char tempBuffer1[4096];
 	static char tempBuffer2[4096];
 
-	if (index == 0)
-	{
-		// Set the value for the first column
+	if (index < 0 || index >= (int32_t)myInfo.size()) return;
+	const InfoValue &info = myInfo[index];
+
+	// Set the value for the first column
 #ifdef WIN32
-		strcpy_s(tempBuffer1, "executeCount");
+	strcpy_s(tempBuffer1, info.name.c_str());
 #else // macOS
-		strlcpy(tempBuffer1, "executeCount", sizeof(tempBuffer1));
+	strlcpy(tempBuffer1, info.name.c_str(), sizeof(tempBuffer1));
 #endif
-		entries->values[0] = tempBuffer1;
+	entries->values[0] = tempBuffer1;
 
-		// Set the value for the second column
+	// Set the value for the second column. Text can be longer than the
+	// buffer, contour points for one, and is handed over as it is.
+	if (info.text) {
+		entries->values[1] = (char*)info.text;
+	}
+	else {
 #ifdef WIN32
-		sprintf_s(tempBuffer2, "%d", myExecuteCount);
+		sprintf_s(tempBuffer2, "%g", info.value);
 #else // macOS
-		snprintf(tempBuffer2, sizeof(tempBuffer2), "%d", myExecuteCount);
+		snprintf(tempBuffer2, sizeof(tempBuffer2), "%g", info.value);
 #endif
 		entries->values[1] = tempBuffer2;
 	}
+}
 
-	if (index == 1)
+const char *
+SenseTOP::getWarningString()
+{
+	if (myRecordFailed)
+		return "Could not open the record file";
+	if (mySharedMemoryFailed)
+		return sharedOutput.nameTaken() ? "Shared memory name is already in use" : "Could not create the shared memory";
+	if (myStreamFailed)
+		return "Could not open the stream port";
+	if (ui.outputMode == OutputMode::Tsdf && tsdf && tsdf->full)
+		return "TSDF volume is full, reset it or use larger voxels";
+
+	switch (captureState)
 	{
-		// Set the value for the first column
-#ifdef WIN32
-		strcpy_s(tempBuffer1, "rotation");
-#else // macOS
-		strlcpy(tempBuffer1, "rotation", sizeof(tempBuffer1));
-#endif
-		entries->values[0] = tempBuffer1;
-
-		// Set the value for the second column
-#ifdef WIN32
-		sprintf_s(tempBuffer2, "%g", myRotation);
-#else // macOS
-		snprintf(tempBuffer2, sizeof(tempBuffer2), "%g", myRotation);
-#endif
-		entries->values[1] = tempBuffer2;
+	case CaptureState::Connecting:		return "Connecting to camera";
+	case CaptureState::Stalled:			return "Camera stalled";
+	case CaptureState::Reconnecting:	return "Camera lost, reconnecting";
+	default:							return nullptr;
 	}
 }
 
@@ -15,9 +15,42 @@
 #include <thread>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
 #include "pxcsensemanager.h"
 #include "pxccapturemanager.h"
 #include "UiHelper.h"
+#include "DeviceControl.h"
+#include "DepthFrame.h"
+#include "ThreadPool.h"
+#include "FrameRing.h"
+#include "TripleBuffer.h"
+#include "DepthRecorder.h"
+#include "ReplayBuffer.h"
+#include "SharedMemoryOutput.h"
+#include "DepthStreamServer.h"
+#include "NetworkDepthSource.h"
+#include "SyntheticDepthSource.h"
+#include "FloorCalibration.h"
+#include "Heightmap.h"
+#include "FusionCamera.h"
+#include "TsdfFusion.h"
+#include "HoleFiller.h"
+#include "PresenceMetrics.h"
+#include "DepthHistogram.h"
+#include "PointSampler.h"
+#include "BlobTracker.h"
+#include "TriggerVolumes.h"
+#include "ContourTracer.h"
+#include <memory>
+
+// State of the capture thread, reported through the Info CHOP and Info DAT
+enum class CaptureState : int32_t
+{
+	Connecting = 0,
+	Streaming,
+	Stalled,
+	Reconnecting,
+};
 
 class SenseTOP : public TOP_CPlusPlusBase
 {
@@ -42,6 +75,7 @@ public:
 										int32_t nEntries,
 										OP_InfoDATEntries *entries) override;
 
+	virtual const char* getWarningString() override;
 	virtual const char* getErrorString() override;
 
 	virtual void		setupParameters(OP_ParameterManager *manager) override;
@@ -49,33 +83,162 @@ public:
 
 	PXCSenseManager *m_senseManager;
 	PXCCapture::Device *m_device;
+
+	// Worker threads for every stage that splits its work across cores, on
+	// the cook, the capture thread or a background worker, so they never
+	// run more threads than there are cores between them. Created the first
+	// time a stage needs it, and declared before the stages so it outlives
+	// their workers.
+	ThreadPool& processingPool();
+	std::unique_ptr<ThreadPool> m_processingPool;
+	std::once_flag m_processingPoolOnce;
 	UiHelper ui;
+	DeviceControl control;
+	DepthRecorder recorder;
+	ReplayBuffer replay;
+	SharedMemoryOutput sharedOutput;
+	DepthStreamServer streamer;
+	FloorCalibration floor;
+	Heightmap heightmap;
+	std::vector<std::unique_ptr<FusionCamera> > fusion;
+	std::unique_ptr<TsdfFusion> tsdf;
+	std::unique_ptr<ContourTracer> contours;
+	TriggerVolumes triggers;
+
+	// Fills holes in the queued frames on the capture thread. Set by the
+	// cook, 0 for off.
+	HoleFiller holes;
+	std::atomic<int32_t> holeRadius{ 0 };
+
+	// Presence and motion numbers, for every frame the source delivers
+	PresenceMetrics presence;
+
+	// Counts depth as frames are queued, and maps it to 0-1 for the Depth
+	// output while autoRange is set by the cook
+	DepthHistogram histogram;
+	std::atomic<bool> autoRange{ false };
+
+	// Frames kept in the shared-memory ring for other processes
+	static const int SHARED_SLOTS = 4;
 
 	const int WIDTH = 640;
 	const int HEIGHT = 480;
-	const int DATA_SIZE = WIDTH * HEIGHT * 4;
 
 	GLuint pboID;
 	GLuint textureId;
+	GLuint readFBO;
+	GLuint pointTextureId;
+	GLuint pointFBO;
+	GLuint heightmapTextureId;
+	GLuint heightmapFBO;
+	GLuint pyramidTextureId;
+	GLuint pyramidFBO;
+	GLuint samplesTextureId;
+	GLuint samplesFBO;
 	const GLenum PIXEL_FORMAT = GL_RED;
-	float* m_depthmap;
-	float* m_image;
+
+	// Frames handed from the capture thread to the cook. Latest Only goes
+	// through latestFrames, which always holds the newest frame. The other
+	// policies queue up to queueLimit frames, which the cook sets, and the
+	// capture thread drops new frames while the queue is full.
+	static const int FRAME_QUEUE_MAX = 16;
+	FrameRing<DepthFrame> frames;
+	TripleBuffer<DepthFrame> latestFrames;
+	std::atomic<size_t> queueLimit{ FRAME_QUEUE_MAX };
+	std::atomic<FrameDelivery> deliveryMode{ FrameDelivery::Latest };
+
+	// Queued frames captured this long before the timestamp match target
+	// are too old to show, s
+	const double MATCH_WINDOW = 0.1;
+
+	// Set by the cook while it shows the depth pyramid or fuses, so the
+	// capture thread builds it into each queued frame
+	std::atomic<bool> pyramidWanted{ false };
+
+	// Sequence number of the frame last uploaded to textureId
+	int64_t m_uploadedSequence = -1;
+
+	// Offset from device timestamps to the host's steady clock, in seconds.
+	// Only used by the capture thread.
+	double m_clockOffset = 0.0;
+	bool m_clockSynced = false;
+
+	// Source selected by the cook. sourceVersion is bumped on every change
+	// so the capture thread knows to reopen.
+	std::mutex sourceMutex;
+	SourceSettings m_sourceSettings;
+	std::atomic<int32_t> sourceVersion{ 0 };
+
+	// Only used by the capture thread. m_source is null for the camera.
+	std::unique_ptr<DepthSource> m_source;
+	DepthFrame m_sourceFrame;
+	std::vector<uint16_t> m_rawDepth;
+	const double SYNTHETIC_FPS = 30.0;
+
+	// Pinhole model of the open source, set by the capture thread. Cameras
+	// that don't report one are assumed to be about this wide.
+	std::mutex intrinsicsMutex;
+	DepthIntrinsics m_intrinsics;
+	const float DEFAULT_FOV = 70.0f;
 
 	bool captureThread();
+	bool openSource(const SourceSettings &source);
+	void closeSource();
+	DepthSourceResult acquireCamera();
+	DepthSourceResult acquireSource();
+	bool wantsRawDepth() const;
+	void deliverFrame(const float *depth, int32_t pitch, int64_t deviceTime, const uint16_t *raw, int32_t rawPitch);
+	bool initSenseManager();
+	void releaseSenseManager();
+	bool waitFor(int ms);
+
+	// How long AcquireFrame() may block, how long without frames before
+	// the device is considered lost, and the reinit backoff range
+	const int ACQUIRE_TIMEOUT_MS = 100;
+	const int STALL_TIMEOUT_MS = 2000;
+	const int BACKOFF_MIN_MS = 250;
+	const int BACKOFF_MAX_MS = 8000;
 
 	// For threading
 	std::vector<std::thread> threads;
-	std::mutex m;
 	std::atomic<bool> running{ true };
 	bool startedThread = false;
 
-	//pxcBYTE* m_depthmap;
-	//pxcBYTE* m_image;
+	std::mutex stopMutex;
+	std::condition_variable stopCv;
 
+	// Telemetry
+	std::atomic<CaptureState> captureState{ CaptureState::Connecting };
+	std::atomic<int32_t> reconnectCount{ 0 };
+	std::atomic<int32_t> stallCount{ 0 };
+	std::atomic<int64_t> frameCount{ 0 };
+	int32_t uploadCount = 0;
+	int32_t duplicateSkips = 0;
+	int32_t framesDropped = 0;
+	std::atomic<int32_t> queueOverflows{ 0 };
+	std::atomic<double> sourceMegabytesPerSecond{ 0.0 };
+	std::atomic<double> sourceLatency{ 0.0 };
+	std::atomic<double> pyramidMs{ 0.0 };
 
 
 private:
 	void                setupGL();
+
+	// Snapshot of the values reported through the Info CHOP and Info DAT,
+	// refreshed whenever TouchDesigner asks for their size
+	struct InfoValue
+	{
+		std::string		name;
+		double			value;
+		const char*		text;
+	};
+	void				gatherInfo();
+	std::vector<InfoValue>	myInfo;
+	// Hold the strings myInfo points to for the stream links and the
+	// dropped device values
+	std::vector<DepthStreamServer::LinkStats>	myLinks;
+	std::string				myDroppedValues;
+
 	// We don't need to store this pointer, but we do for the example.
 	// The OP_NodeInfo class store information about the node that's using
 	// this instance of the class (like its name).
@@ -84,11 +247,53 @@ private:
 	// In this example this value will be incremented each time the execute()
 	// function is called, then passes back to the TOP 
 	int32_t					 myExecuteCount;
-	double					 myRotation;
 
 	const char              *myError;
 
 	bool                    didGLSetup;
+	bool					myRecordFailed;
+	std::string				myRecordFailedPath;
+	bool					mySharedMemoryFailed;
+	bool					myStreamFailed;
+	int32_t					myStreamPort;
+	OutputMode				myOutputMode;
+
+	// World position output: camera-space points of the last frame, and
+	// the same moved by myCameraToWorld
+	std::vector<float>		myCameraPoints;
+	std::vector<float>		myWorldPoints;
+	Matrix					myCameraToWorld;
+	double					myPointsMs;
+	double					myPointsTime;
+	const char*				myTransformSource;
+
+	// Set by the Calibrate floor pulse until the next frame is handed over
+	bool					myCalibrateFloor;
+	std::string				myFloorRows[4];
+
+	// Size heightmapTextureId was last allocated at
+	int32_t					myHeightmapWidth;
+	int32_t					myHeightmapHeight;
+	int32_t					myOutputWidth;
+	int32_t					myOutputHeight;
+
+	// Level 0 of the pyramid atlas, with depth as both nearest and farthest
+	std::vector<float>		myPyramidTexels;
+
+	// Contours picked up by the last cook, owned by contours
+	const ContourSet*		myContours;
+
+	// Samples for the Samples output, the foreground range they were picked
+	// from, and the width samplesTextureId was last allocated at
+	PointSampler			sampler;
+	std::vector<float>		mySamples;
+	float					mySampleRange[2];
+	int32_t					mySamplesWidth;
+
+	// Foreground blobs tracked across frames, and their slots as last
+	// reported
+	BlobTracker				targets;
+	std::vector<Target>		myTargets;
 
 
 };
\ No newline at end of file
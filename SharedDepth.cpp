@@ -0,0 +1,112 @@
+#include "SharedDepth.h"
+
+#ifndef WIN32
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+SharedMemoryRegion::SharedMemoryRegion()
+: m_data(nullptr), m_size(0), m_owner(false), m_nameTaken(false)
+#ifdef WIN32
+	, m_handle(nullptr)
+#endif
+{
+}
+
+SharedMemoryRegion::~SharedMemoryRegion()
+{
+	unmap();
+}
+
+bool
+SharedMemoryRegion::map(const char *name, size_t size, bool create)
+{
+	unmap();
+	m_nameTaken = false;
+	if (!name || !*name) return false;
+
+#ifdef WIN32
+	m_name = std::string("Local\\") + name;
+	if (create) {
+		m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			(DWORD)((uint64_t)size >> 32), (DWORD)size, m_name.c_str());
+
+		// Another writer's region, which has to be left alone
+		if (m_handle && GetLastError() == ERROR_ALREADY_EXISTS) {
+			CloseHandle(m_handle);
+			m_handle = nullptr;
+			m_nameTaken = true;
+		}
+	}
+	else {
+		m_handle = OpenFileMappingA(FILE_MAP_READ, FALSE, m_name.c_str());
+	}
+	if (!m_handle) return false;
+
+	m_data = MapViewOfFile(m_handle, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, create ? size : 0);
+	if (!m_data) {
+		CloseHandle(m_handle);
+		m_handle = nullptr;
+		return false;
+	}
+
+	if (!create) {
+		MEMORY_BASIC_INFORMATION info;
+		VirtualQuery(m_data, &info, sizeof(info));
+		size = info.RegionSize;
+	}
+#else
+	m_name = std::string("/") + name;
+	int fd = create ? shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) : shm_open(m_name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		m_nameTaken = create && errno == EEXIST;
+		return false;
+	}
+
+	if (create) {
+		if (ftruncate(fd, size) != 0) {
+			close(fd);
+			shm_unlink(m_name.c_str());
+			return false;
+		}
+	}
+	else {
+		struct stat st;
+		fstat(fd, &st);
+		size = (size_t)st.st_size;
+	}
+
+	m_data = mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m_data == MAP_FAILED) {
+		m_data = nullptr;
+		if (create) shm_unlink(m_name.c_str());
+		return false;
+	}
+#endif
+
+	m_size = size;
+	m_owner = create;
+	return true;
+}
+
+void
+SharedMemoryRegion::unmap()
+{
+	if (!m_data) return;
+
+#ifdef WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_handle);
+	m_handle = nullptr;
+#else
+	munmap(m_data, m_size);
+	if (m_owner) shm_unlink(m_name.c_str());
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+}
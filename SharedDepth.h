@@ -0,0 +1,110 @@
+#ifndef SharedDepth_h
+#define SharedDepth_h
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#ifdef WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#endif
+
+// Layout of the shared-memory depth ring written by SharedMemoryOutput and
+// read by SharedDepthReader. Both sides include this header, so a change to
+// the layout must bump SHARED_DEPTH_VERSION.
+//
+// The region starts with a SharedDepthHeader, followed by slotCount
+// SharedDepthSlot headers, followed by slotCount depth images of slotBytes
+// each. Frame k is written to slot k % slotCount.
+//
+// Each slot is guarded by a seqlock: the writer sets state to 2k+1 before
+// writing frame k and to 2k+2 afterwards. A reader copies the frame and
+// accepts it only if state read 2k+2 both before and after the copy.
+
+static const uint32_t SHARED_DEPTH_MAGIC = 0x4D534453;		// "SDSM"
+static const uint32_t SHARED_DEPTH_VERSION = 1;
+
+enum class SharedDepthFormat : uint32_t
+{
+	Float32 = 0,		// depth in mm as 32-bit float
+};
+
+struct SharedDepthSlot
+{
+	std::atomic<uint64_t> state;
+	int64_t sequence;			// capture sequence number
+	int64_t deviceTime;			// 100ns device units
+	double time;				// capture time, seconds on the steady clock
+	double publishTime;			// when the writer finished, same clock
+};
+
+struct SharedDepthHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	SharedDepthFormat format;
+	uint32_t slotCount;
+	uint64_t slotBytes;
+	std::atomic<uint64_t> published;	// number of frames written so far
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "shared atomics must be plain 64-bit words");
+
+// Bytes needed for a region with the given geometry
+inline size_t
+sharedDepthSize(uint32_t slotCount, uint64_t slotBytes)
+{
+	return sizeof(SharedDepthHeader) + slotCount * (sizeof(SharedDepthSlot) + slotBytes);
+}
+
+inline SharedDepthSlot*
+sharedDepthSlot(SharedDepthHeader *header, uint32_t i)
+{
+	return (SharedDepthSlot*)(header + 1) + i;
+}
+
+inline uint8_t*
+sharedDepthData(SharedDepthHeader *header, uint32_t i)
+{
+	return (uint8_t*)((SharedDepthSlot*)(header + 1) + header->slotCount) + i * header->slotBytes;
+}
+
+// A named shared-memory mapping
+class SharedMemoryRegion
+{
+
+public:
+	SharedMemoryRegion();
+	virtual ~SharedMemoryRegion();
+
+	// create makes a new region of size bytes, and fails if one with the
+	// name already exists; otherwise an existing one is opened and size is
+	// ignored
+	bool map(const char *name, size_t size, bool create);
+	void unmap();
+
+	void* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+	// After a failed create, whether it was because the name was taken
+	bool nameTaken() const { return m_nameTaken; }
+
+private:
+	void *m_data;
+	size_t m_size;
+	std::string m_name;
+	bool m_owner;
+	bool m_nameTaken;
+#ifdef WIN32
+	HANDLE m_handle;
+#endif
+
+};
+
+#endif
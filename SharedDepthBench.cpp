@@ -0,0 +1,135 @@
+// Throughput and latency benchmark for the shared-memory output, with the
+// reader in a separate process. Not part of the plugin; build it on its own:
+//
+//	g++ -O2 -std=c++14 SharedDepthBench.cpp SharedDepth.cpp SharedDepthReader.cpp
+//		SharedMemoryOutput.cpp DepthPyramid.cpp -lpthread -lrt -o SharedDepthBench
+//
+// (or add those files to an empty console project on Windows), then run the
+// writer and the reader side by side:
+//
+//	SharedDepthBench write SenseTOP 60 10
+//	SharedDepthBench read SenseTOP 10
+//
+// The writer publishes generated 640 x 480 frames at the given rate, or as
+// fast as it can at 0. The reader takes every frame with readNext(), checks
+// each against the frame generated for its sequence number, and reports the
+// frame rate, bandwidth, lost frames and the time from publish, and from
+// capture, to the copy in the reader. A SenseTOP with Shared memory on can
+// stand in for the writer.
+
+#include "SharedDepthReader.h"
+#include "SharedMemoryOutput.h"
+#include "SteadyClock.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+static const int WIDTH = 640;
+static const int HEIGHT = 480;
+static const int SLOTS = 4;
+
+// Device time advances at this rate whatever rate frames are published at
+static const double DEVICE_FPS = 60.0;
+
+// A depth frame, in mm, that depends on every pixel and on the sequence
+// number, so a torn or misnumbered frame shows up
+static void
+generateFrame(int64_t sequence, std::vector<float> &depth)
+{
+	depth.resize(WIDTH * HEIGHT);
+	for (int y = 0; y < HEIGHT; y++)
+		for (int x = 0; x < WIDTH; x++)
+			depth[y * WIDTH + x] = (float)(500 + (x * 7 + y * 13 + sequence * 31) % 3000);
+}
+
+static int
+runWriter(const char *name, double fps, double seconds)
+{
+	SharedMemoryOutput output;
+	if (!output.configure(true, name, WIDTH, HEIGHT, SLOTS)) {
+		fprintf(stderr, "Could not create shared memory '%s'\n", name);
+		return 1;
+	}
+
+	std::vector<float> depth;
+	double start = steadySeconds(), publishMicros = 0.0;
+	for (int64_t index = 0; steadySeconds() - start < seconds; index++) {
+		generateFrame(index, depth);
+		if (fps > 0.0) {
+			double due = start + index / fps;
+			while (steadySeconds() < due)
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+		output.publish(depth.data(), WIDTH * sizeof(float), index, (int64_t)(index * 1e7 / DEVICE_FPS), steadySeconds());
+		publishMicros += output.publishMicros;
+	}
+
+	int64_t published = output.framesPublished;
+	printf("Published %lld frames, %.1f fps, %.1f us per publish\n", (long long)published,
+		published / seconds, published ? publishMicros / published : 0.0);
+	return 0;
+}
+
+static int
+runReader(const char *name, double seconds)
+{
+	SharedDepthReader reader;
+	double start = steadySeconds();
+	while (!reader.open(name)) {
+		if (steadySeconds() - start > seconds) {
+			fprintf(stderr, "No shared memory '%s'\n", name);
+			return 1;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	std::vector<float> expected;
+	std::vector<double> publishLatency, captureLatency;
+	DepthFrame frame;
+	int64_t frames = 0, mismatched = 0, bytes = 0;
+	start = steadySeconds();
+	while (steadySeconds() - start < seconds) {
+		if (!reader.readNext(frame)) {
+			std::this_thread::yield();
+			continue;
+		}
+		double now = steadySeconds();
+		publishLatency.push_back((now - reader.lastPublishTime()) * 1e6);
+		captureLatency.push_back((now - frame.time) * 1e6);
+		frames++;
+		bytes += frame.depth.size() * sizeof(float);
+
+		// Only the benchmark writer's frames can be checked
+		if (frame.width == WIDTH && frame.height == HEIGHT) {
+			generateFrame(frame.sequence, expected);
+			if (frame.depth != expected) mismatched++;
+		}
+	}
+	double elapsed = steadySeconds() - start;
+
+	printf("Read %lld frames, %.1f fps, %.1f MB/s, %lld lost, %lld not matching the generated frame\n", (long long)frames,
+		frames / elapsed, bytes / elapsed / 1e6, (long long)reader.lost, (long long)mismatched);
+	for (std::vector<double> *latency : { &publishLatency, &captureLatency }) {
+		if (latency->empty()) break;
+		std::sort(latency->begin(), latency->end());
+		printf("%s to read: median %.1f us, 99th percentile %.1f us, worst %.1f us\n",
+			latency == &publishLatency ? "Publish" : "Capture", (*latency)[latency->size() / 2],
+			(*latency)[latency->size() * 99 / 100], latency->back());
+	}
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc >= 3 && strcmp(argv[1], "write") == 0)
+		return runWriter(argv[2], argc > 3 ? atof(argv[3]) : 60.0, argc > 4 ? atof(argv[4]) : 10.0);
+	if (argc >= 3 && strcmp(argv[1], "read") == 0)
+		return runReader(argv[2], argc > 3 ? atof(argv[3]) : 10.0);
+
+	fprintf(stderr, "Usage: SharedDepthBench write <name> [fps] [seconds]\n"
+		"       SharedDepthBench read <name> [seconds]\n");
+	return 2;
+}
@@ -0,0 +1,105 @@
+#include "SharedDepthReader.h"
+#include <cstring>
+
+SharedDepthReader::SharedDepthReader()
+: m_header(nullptr), m_next(0), m_lastPublishTime(0.0)
+{
+}
+
+SharedDepthReader::~SharedDepthReader()
+{
+	close();
+}
+
+bool
+SharedDepthReader::open(const char *name)
+{
+	close();
+	if (!m_region.map(name, 0, false)) return false;
+
+	SharedDepthHeader *header = (SharedDepthHeader*)m_region.data();
+	if (m_region.size() < sizeof(SharedDepthHeader) ||
+		header->magic != SHARED_DEPTH_MAGIC ||
+		header->version != SHARED_DEPTH_VERSION ||
+		m_region.size() < sharedDepthSize(header->slotCount, header->slotBytes)) {
+		m_region.unmap();
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	m_header = header;
+	m_next = header->published.load(std::memory_order_acquire);
+	return true;
+}
+
+void
+SharedDepthReader::close()
+{
+	m_region.unmap();
+	m_header = nullptr;
+}
+
+bool
+SharedDepthReader::readLatest(DepthFrame &frame)
+{
+	if (!m_header) return false;
+
+	// Retry if the writer laps us during the copy
+	for (int attempt = 0; attempt < 4; attempt++) {
+		uint64_t published = m_header->published.load(std::memory_order_acquire);
+		if (published == 0 || published <= m_next) return false;
+		if (copy(published - 1, frame)) {
+			m_next = published;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool
+SharedDepthReader::readNext(DepthFrame &frame)
+{
+	if (!m_header) return false;
+
+	uint64_t published = m_header->published.load(std::memory_order_acquire);
+	if (published <= m_next) return false;
+
+	// Skip frames the writer has already reused the slot of
+	uint64_t oldest = published > m_header->slotCount ? published - m_header->slotCount : 0;
+	if (m_next < oldest) {
+		lost += oldest - m_next;
+		m_next = oldest;
+	}
+
+	while (m_next < published) {
+		if (copy(m_next++, frame)) return true;
+		lost++;
+	}
+	return false;
+}
+
+// Copies frame k, returns false if it was overwritten meanwhile
+bool
+SharedDepthReader::copy(uint64_t k, DepthFrame &frame)
+{
+	uint32_t i = (uint32_t)(k % m_header->slotCount);
+	SharedDepthSlot *slot = sharedDepthSlot(m_header, i);
+
+	uint64_t expected = 2 * k + 2;
+	if (slot->state.load(std::memory_order_acquire) != expected) return false;
+
+	frame.width = m_header->width;
+	frame.height = m_header->height;
+	frame.depth.resize((size_t)frame.width * frame.height);
+	memcpy(frame.depth.data(), sharedDepthData(m_header, i), frame.depth.size() * sizeof(float));
+	frame.sequence = slot->sequence;
+	frame.deviceTime = slot->deviceTime;
+	frame.time = slot->time;
+	double publishTime = slot->publishTime;
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot->state.load(std::memory_order_relaxed) != expected) return false;
+
+	m_lastPublishTime = publishTime;
+	return true;
+}
@@ -0,0 +1,52 @@
+#ifndef SharedDepthReader_h
+#define SharedDepthReader_h
+
+#include "SharedDepth.h"
+#include "DepthFrame.h"
+
+// Reads depth frames published by a SenseTOP's shared-memory output.
+// Standalone: link SharedDepth.cpp and SharedDepthReader.cpp into the
+// consuming process. Reading never blocks the writer; a frame that is
+// overwritten while it is being copied is detected and retried.
+//
+//	SharedDepthReader reader;
+//	reader.open("SenseTOP");
+//	DepthFrame frame;
+//	while (running)
+//		if (reader.readLatest(frame)) process(frame);
+class SharedDepthReader
+{
+
+public:
+	SharedDepthReader();
+	virtual ~SharedDepthReader();
+
+	bool open(const char *name);
+	void close();
+	bool isOpen() const { return m_header != nullptr; }
+
+	// Copies the newest frame into frame if it is newer than the last one
+	// read. Returns false if there is none.
+	bool readLatest(DepthFrame &frame);
+
+	// Copies the frame after the last one read, for consumers that want
+	// every frame. Returns false if it isn't published yet; lost counts the
+	// frames that were overwritten before they could be read.
+	bool readNext(DepthFrame &frame);
+
+	// When the last frame read was published, on steadySeconds()
+	double lastPublishTime() const { return m_lastPublishTime; }
+
+	int64_t lost = 0;
+
+private:
+	bool copy(uint64_t k, DepthFrame &frame);
+
+	SharedMemoryRegion m_region;
+	SharedDepthHeader *m_header;
+	uint64_t m_next;
+	double m_lastPublishTime;
+
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "SharedMemoryOutput.h"
+#include "SteadyClock.h"
+#include <cstring>
+#include <cstdio>
+
+SharedMemoryOutput::SharedMemoryOutput()
+: m_open(false), m_width(0), m_height(0), m_slotCount(0)
+{
+}
+
+SharedMemoryOutput::~SharedMemoryOutput()
+{
+	configure(false, nullptr, 0, 0, 0);
+}
+
+bool
+SharedMemoryOutput::configure(bool enabled, const char *name, int width, int height, int slotCount)
+{
+	std::string wanted = enabled && name ? name : "";
+	if (wanted == m_name && width == m_width && height == m_height && slotCount == m_slotCount)
+		return m_open;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_open = false;
+	m_region.unmap();
+	m_name = wanted;
+	m_width = width;
+	m_height = height;
+	m_slotCount = slotCount;
+	if (wanted.empty()) return false;
+
+	uint64_t slotBytes = (uint64_t)width * height * sizeof(float);
+	if (!m_region.map(wanted.c_str(), sharedDepthSize(slotCount, slotBytes), true)) {
+		if (m_region.nameTaken())
+			printf("Shared memory '%s' is already in use\n", wanted.c_str());
+		else
+			printf("Could not create shared memory '%s'\n", wanted.c_str());
+		return false;
+	}
+
+	SharedDepthHeader *header = (SharedDepthHeader*)m_region.data();
+	header->magic = 0;
+	header->version = SHARED_DEPTH_VERSION;
+	header->width = width;
+	header->height = height;
+	header->format = SharedDepthFormat::Float32;
+	header->slotCount = slotCount;
+	header->slotBytes = slotBytes;
+	header->published.store(0);
+	for (int i = 0; i < slotCount; i++)
+		sharedDepthSlot(header, i)->state.store(0);
+
+	// Readers ignore the region until the magic is in place
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = SHARED_DEPTH_MAGIC;
+
+	m_open = true;
+	printf("Publishing depth to shared memory '%s'\n", wanted.c_str());
+	return true;
+}
+
+void
+SharedMemoryOutput::publish(const float *depth, int32_t pitch, int64_t sequence, int64_t deviceTime, double time)
+{
+	if (!m_open) return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_open) return;
+
+	double start = steadySeconds();
+
+	SharedDepthHeader *header = (SharedDepthHeader*)m_region.data();
+	uint64_t k = header->published.load(std::memory_order_relaxed);
+	uint32_t i = (uint32_t)(k % header->slotCount);
+	SharedDepthSlot *slot = sharedDepthSlot(header, i);
+	uint8_t *data = sharedDepthData(header, i);
+
+	// Odd state while writing, readers that overlap discard their copy
+	slot->state.store(2 * k + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	size_t rowBytes = m_width * sizeof(float);
+	for (int y = 0; y < m_height; y++)
+		memcpy(data + y * rowBytes, (const uint8_t*)depth + y * pitch, rowBytes);
+	slot->sequence = sequence;
+	slot->deviceTime = deviceTime;
+	slot->time = time;
+	slot->publishTime = steadySeconds();
+
+	slot->state.store(2 * k + 2, std::memory_order_release);
+	header->published.store(k + 1, std::memory_order_release);
+
+	framesPublished++;
+	publishMicros = (steadySeconds() - start) * 1e6;
+}
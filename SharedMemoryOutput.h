@@ -0,0 +1,47 @@
+#ifndef SharedMemoryOutput_h
+#define SharedMemoryOutput_h
+
+#include "SharedDepth.h"
+#include <atomic>
+#include <mutex>
+
+// Publishes depth frames from the capture thread into a named shared-memory
+// ring (see SharedDepth.h), for other processes on the same machine. Frames
+// are copied straight from the camera buffer, so nothing is read back from
+// the GPU.
+class SharedMemoryOutput
+{
+
+public:
+	SharedMemoryOutput();
+	virtual ~SharedMemoryOutput();
+
+	// Cook thread. Creates, renames or removes the region as needed.
+	// Fails if another writer already has the name.
+	bool configure(bool enabled, const char *name, int width, int height, int slotCount);
+	bool isOpen() const { return m_open; }
+
+	// Cook thread. Whether the last configure() failed because the name was
+	// in use.
+	bool nameTaken() const { return m_region.nameTaken(); }
+
+	// Capture thread. pitch is the row stride of depth in bytes.
+	void publish(const float *depth, int32_t pitch, int64_t sequence, int64_t deviceTime, double time);
+
+	// Telemetry
+	std::atomic<int64_t> framesPublished{ 0 };
+	std::atomic<double> publishMicros{ 0.0 };
+
+private:
+	// Held while publishing and while the region is recreated
+	std::mutex m_mutex;
+	SharedMemoryRegion m_region;
+	std::atomic<bool> m_open;
+	std::string m_name;
+	int m_width;
+	int m_height;
+	int m_slotCount;
+
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef Simd_h
+#define Simd_h
+
+#include <cstdint>
+
+// SSE2 is always available on x64, and on x86 when the compiler targets it
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define SENSETOP_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+// Index of the lowest set bit, mask must be non-zero
+inline int
+lowestBit(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef SteadyClock_h
+#define SteadyClock_h
+
+#include <chrono>
+
+// Seconds on the host's steady clock. Every time stamp that is compared
+// with another comes from here: capture times, stream send times, fusion
+// layer times and shared-memory publish times. The steady clock is shared
+// by all processes on the machine (QueryPerformanceCounter on Windows,
+// CLOCK_MONOTONIC elsewhere), so readers in other processes can compare
+// against it too.
+inline double
+steadySeconds()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double>(now).count();
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include "SyntheticDepthSource.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+SyntheticDepthSource::SyntheticDepthSource(int width, int height, double fps)
+: m_width(width), m_height(height), m_fps(fps), m_index(0)
+{
+}
+
+bool
+SyntheticDepthSource::open()
+{
+	m_index = 0;
+	m_start = std::chrono::steady_clock::now();
+	m_depth.resize(m_width * m_height);
+	return true;
+}
+
+void
+SyntheticDepthSource::close()
+{
+}
+
+DepthSourceResult
+SyntheticDepthSource::read(DepthFrame &frame, int timeoutMs)
+{
+	// Frames are due at a fixed rate from open()
+	auto due = m_start + std::chrono::microseconds((int64_t)(m_index * 1e6 / m_fps));
+	auto now = std::chrono::steady_clock::now();
+	if (due - now > std::chrono::milliseconds(timeoutMs)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+		return DepthSourceResult::Timeout;
+	}
+	std::this_thread::sleep_until(due);
+
+	render(m_index, m_depth);
+
+	frame.sequence = m_index;
+	frame.deviceTime = (int64_t)(m_index * 1e7 / m_fps);
+	frame.width = m_width;
+	frame.height = m_height;
+	frame.depth.resize(m_depth.size());
+	for (size_t i = 0; i < m_depth.size(); i++)
+		frame.depth[i] = (float)m_depth[i];
+
+	m_index++;
+	return DepthSourceResult::Frame;
+}
+
+DepthIntrinsics
+SyntheticDepthSource::intrinsics() const
+{
+	return DepthIntrinsics::fromFieldOfView(m_width, m_height, SYNTHETIC_FOV);
+}
+
+void
+SyntheticDepthSource::render(int64_t index, std::vector<uint16_t> &depth) const
+{
+	depth.resize(m_width * m_height);
+
+	double t = index / m_fps;
+	struct Sphere { double x, y, z, r; };
+	Sphere spheres[2] = {
+		{ 0.3 * std::cos(t), 0.1 * std::sin(2.0 * t), 1.2 + 0.3 * std::sin(t), 0.15 },
+		{ -0.25 * std::cos(0.7 * t), -0.05, 1.6 + 0.2 * std::cos(0.7 * t), 0.25 },
+	};
+
+	// Rays through each pixel of the pinhole camera, scene units are metres
+	DepthIntrinsics k = intrinsics();
+	double focal = k.fx;
+	double cx = k.cx;
+	double cy = k.cy;
+
+	for (int y = 0; y < m_height; y++) {
+		double dy = (y - cy) / focal;
+		for (int x = 0; x < m_width; x++) {
+			double dx = (x - cx) / focal;
+
+			// Back wall at 2.5m, floor 0.8m below the camera
+			double z = 2.5;
+			if (dy > 0.0) z = std::min(z, 0.8 / dy);
+
+			for (const Sphere &s : spheres) {
+				// Ray (dx, dy, 1) * z against the sphere, nearest hit
+				double a = dx * dx + dy * dy + 1.0;
+				double b = -2.0 * (dx * s.x + dy * s.y + s.z);
+				double c = s.x * s.x + s.y * s.y + s.z * s.z - s.r * s.r;
+				double disc = b * b - 4.0 * a * c;
+				if (disc >= 0.0) {
+					double hit = (-b - std::sqrt(disc)) / (2.0 * a);
+					// Grazing rays at the silhouette return nothing, like a
+					// real sensor
+					if (hit > 0.0 && hit < z) z = disc < 0.02 * b * b ? 0.0 : hit;
+				}
+			}
+
+			uint32_t mm = (uint32_t)(z * 1000.0);
+			depth[y * m_width + x] = (uint16_t)std::min<uint32_t>(mm, 0xFFFF);
+		}
+	}
+}
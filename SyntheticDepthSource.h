@@ -0,0 +1,39 @@
+#ifndef SyntheticDepthSource_h
+#define SyntheticDepthSource_h
+
+#include "DepthSource.h"
+#include <chrono>
+#include <vector>
+
+// Horizontal field of view of the synthetic camera
+static const float SYNTHETIC_FOV = 60.0f;
+
+// Generates a moving test scene at a fixed rate: a sloped floor and back
+// wall with two spheres orbiting in front of them, plus the ragged holes a
+// real sensor leaves around edges. Values are 16-bit millimetres like the
+// camera's, so it exercises the same paths end to end without hardware.
+class SyntheticDepthSource : public DepthSource
+{
+
+public:
+	SyntheticDepthSource(int width, int height, double fps);
+
+	virtual bool open() override;
+	virtual void close() override;
+	virtual DepthSourceResult read(DepthFrame &frame, int timeoutMs) override;
+	virtual DepthIntrinsics intrinsics() const override;
+
+	// Renders frame number index, for tests that want a known frame
+	void render(int64_t index, std::vector<uint16_t> &depth) const;
+
+private:
+	int m_width;
+	int m_height;
+	double m_fps;
+	int64_t m_index;
+	std::chrono::steady_clock::time_point m_start;
+	std::vector<uint16_t> m_depth;
+
+};
+
+#endif
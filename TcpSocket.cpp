@@ -0,0 +1,284 @@
+#ifdef WIN32
+	// Before anything that includes windows.h, which would pull in winsock.h
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	typedef SOCKET SocketHandle;
+	typedef int SocketLength;
+	#define SHUT_BOTH SD_BOTH
+#else
+	#include <sys/types.h>
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#include <sys/time.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <arpa/inet.h>
+	#include <netdb.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+	typedef int SocketHandle;
+	typedef socklen_t SocketLength;
+	#define SHUT_BOTH SHUT_RDWR
+#endif
+
+#include "TcpSocket.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#ifndef MSG_NOSIGNAL
+	#define MSG_NOSIGNAL 0
+#endif
+
+static void
+closeHandle(SocketHandle s)
+{
+#ifdef WIN32
+	closesocket(s);
+#else
+	::close(s);
+#endif
+}
+
+static bool
+waitFor(SocketHandle s, bool write, int timeoutMs)
+{
+	fd_set set;
+	FD_ZERO(&set);
+	FD_SET(s, &set);
+	timeval tv;
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+	int n = select((int)s + 1, write ? nullptr : &set, write ? &set : nullptr, nullptr, &tv);
+	return n > 0;
+}
+
+static std::string
+addressString(const sockaddr_in &addr)
+{
+	char host[64] = "";
+	inet_ntop(AF_INET, (void*)&addr.sin_addr, host, sizeof(host));
+	return std::string(host) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+// Winsock needs initializing once per process
+bool
+TcpSocket::startup()
+{
+#ifdef WIN32
+	static bool started = false;
+	if (!started) {
+		WSADATA data;
+		started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}
+	return started;
+#else
+	return true;
+#endif
+}
+
+TcpSocket::TcpSocket()
+: m_handle(INVALID)
+{
+}
+
+TcpSocket::TcpSocket(intptr_t handle, const std::string &peer)
+: m_handle(handle), m_peer(peer)
+{
+}
+
+TcpSocket::~TcpSocket()
+{
+	close();
+}
+
+TcpSocket::TcpSocket(TcpSocket &&other)
+: m_handle(other.m_handle), m_peer(std::move(other.m_peer))
+{
+	other.m_handle = INVALID;
+}
+
+TcpSocket&
+TcpSocket::operator=(TcpSocket &&other)
+{
+	if (this != &other) {
+		close();
+		m_handle = other.m_handle;
+		m_peer = std::move(other.m_peer);
+		other.m_handle = INVALID;
+	}
+	return *this;
+}
+
+void
+TcpSocket::close()
+{
+	if (m_handle == INVALID) return;
+	closeHandle((SocketHandle)m_handle);
+	m_handle = INVALID;
+}
+
+void
+TcpSocket::shutdown()
+{
+	if (m_handle != INVALID) ::shutdown((SocketHandle)m_handle, SHUT_BOTH);
+}
+
+bool
+TcpSocket::listen(int port)
+{
+	close();
+	if (!startup()) return false;
+
+	SocketHandle s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == (SocketHandle)INVALID) return false;
+
+	int yes = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons((uint16_t)port);
+
+	if (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(s, 4) != 0) {
+		closeHandle(s);
+		return false;
+	}
+
+	m_handle = (intptr_t)s;
+	m_peer = "*:" + std::to_string(port);
+	return true;
+}
+
+TcpSocket
+TcpSocket::accept(int timeoutMs)
+{
+	if (m_handle == INVALID || !waitFor((SocketHandle)m_handle, false, timeoutMs))
+		return TcpSocket();
+
+	sockaddr_in addr;
+	SocketLength length = sizeof(addr);
+	SocketHandle s = ::accept((SocketHandle)m_handle, (sockaddr*)&addr, &length);
+	if (s == (SocketHandle)INVALID) return TcpSocket();
+	return TcpSocket((intptr_t)s, addressString(addr));
+}
+
+bool
+TcpSocket::connect(const char *host, int port, int timeoutMs)
+{
+	close();
+	if (!host || !*host || !startup()) return false;
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo *result = nullptr;
+	if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &result) != 0 || !result)
+		return false;
+
+	SocketHandle s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	bool connected = false;
+	if (s != (SocketHandle)INVALID) {
+		// Connect without blocking so an unreachable host times out quickly
+#ifdef WIN32
+		u_long nonBlocking = 1;
+		ioctlsocket(s, FIONBIO, &nonBlocking);
+#else
+		int flags = fcntl(s, F_GETFL, 0);
+		fcntl(s, F_SETFL, flags | O_NONBLOCK);
+#endif
+		if (::connect(s, result->ai_addr, (SocketLength)result->ai_addrlen) == 0) {
+			connected = true;
+		}
+		else if (waitFor(s, true, timeoutMs)) {
+			int error = 0;
+			SocketLength length = sizeof(error);
+			getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&error, &length);
+			connected = error == 0;
+		}
+#ifdef WIN32
+		nonBlocking = 0;
+		ioctlsocket(s, FIONBIO, &nonBlocking);
+#else
+		fcntl(s, F_SETFL, flags);
+#endif
+	}
+
+	if (connected) {
+		m_handle = (intptr_t)s;
+		m_peer = addressString(*(sockaddr_in*)result->ai_addr);
+	}
+	else if (s != (SocketHandle)INVALID) {
+		closeHandle(s);
+	}
+	freeaddrinfo(result);
+	return connected;
+}
+
+bool
+TcpSocket::sendAll(const void *data, size_t size)
+{
+	const char *p = (const char*)data;
+	while (size > 0) {
+		int n = send((SocketHandle)m_handle, p, (int)std::min<size_t>(size, 1 << 20), MSG_NOSIGNAL);
+		if (n <= 0) return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool
+TcpSocket::recvAll(void *data, size_t size)
+{
+	char *p = (char*)data;
+	while (size > 0) {
+		int n = recv((SocketHandle)m_handle, p, (int)std::min<size_t>(size, 1 << 20), 0);
+		if (n <= 0) return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool
+TcpSocket::waitReadable(int timeoutMs)
+{
+	return m_handle != INVALID && waitFor((SocketHandle)m_handle, false, timeoutMs);
+}
+
+void
+TcpSocket::setNoDelay()
+{
+	int yes = 1;
+	setsockopt((SocketHandle)m_handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+}
+
+static void
+setTimeoutOption(SocketHandle s, int option, int timeoutMs)
+{
+#ifdef WIN32
+	DWORD timeout = timeoutMs;
+#else
+	timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+#endif
+	setsockopt(s, SOL_SOCKET, option, (const char*)&timeout, sizeof(timeout));
+}
+
+void
+TcpSocket::setSendTimeout(int timeoutMs)
+{
+	setTimeoutOption((SocketHandle)m_handle, SO_SNDTIMEO, timeoutMs);
+}
+
+void
+TcpSocket::setReceiveTimeout(int timeoutMs)
+{
+	setTimeoutOption((SocketHandle)m_handle, SO_RCVTIMEO, timeoutMs);
+}
@@ -0,0 +1,60 @@
+#ifndef TcpSocket_h
+#define TcpSocket_h
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Minimal blocking TCP socket over Winsock or BSD sockets, for the depth
+// stream. The platform headers stay in TcpSocket.cpp, so including this
+// doesn't pull winsock2.h in after windows.h.
+class TcpSocket
+{
+
+public:
+	TcpSocket();
+	virtual ~TcpSocket();
+
+	TcpSocket(TcpSocket &&other);
+	TcpSocket& operator=(TcpSocket &&other);
+	TcpSocket(const TcpSocket&) = delete;
+	TcpSocket& operator=(const TcpSocket&) = delete;
+
+	bool isOpen() const { return m_handle != INVALID; }
+	void close();
+
+	// Unblocks a send or receive in progress on another thread
+	void shutdown();
+
+	bool listen(int port);
+	// Waits up to timeoutMs for a connection, returns a closed socket if none
+	TcpSocket accept(int timeoutMs);
+	bool connect(const char *host, int port, int timeoutMs);
+
+	// Sends or receives exactly size bytes, false if the link failed
+	bool sendAll(const void *data, size_t size);
+	bool recvAll(void *data, size_t size);
+
+	// Waits up to timeoutMs for data to read, 0 polls
+	bool waitReadable(int timeoutMs);
+
+	// Disables Nagle, so small frames and acks go out immediately
+	void setNoDelay();
+	// Bound blocking sends or receives, 0 waits forever
+	void setSendTimeout(int timeoutMs);
+	void setReceiveTimeout(int timeoutMs);
+
+	const std::string& peer() const { return m_peer; }
+
+private:
+	static const intptr_t INVALID = -1;
+	static bool startup();
+
+	explicit TcpSocket(intptr_t handle, const std::string &peer);
+
+	intptr_t m_handle;
+	std::string m_peer;
+
+};
+
+#endif
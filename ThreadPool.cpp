@@ -0,0 +1,109 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <memory>
+
+ThreadPool::ThreadPool(int numThreads)
+: m_running(true)
+{
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+	for (int i = 0; i < numThreads; i++)
+		m_workers.emplace_back(&ThreadPool::workerThread, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	for (std::thread &t : m_workers)
+		t.join();
+}
+
+void
+ThreadPool::enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_cv.notify_one();
+}
+
+void
+ThreadPool::workerThread()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		m_cv.wait(lock, [this] { return !m_running || !m_tasks.empty(); });
+		if (m_tasks.empty()) break;
+
+		std::function<void()> task = std::move(m_tasks.front());
+		m_tasks.pop_front();
+
+		lock.unlock();
+		task();
+		lock.lock();
+	}
+}
+
+void
+ThreadPool::parallelFor(int count, const std::function<void(int, int)> &fn, int grain)
+{
+	if (count <= 0) return;
+
+	// A few chunks per thread keeps the load balanced when chunks vary in cost
+	int threads = size() + 1;
+	int chunk = std::max(grain, (count + threads * 4 - 1) / (threads * 4));
+	int chunks = (count + chunk - 1) / chunk;
+	if (chunks == 1) {
+		fn(0, count);
+		return;
+	}
+
+	// Shared with the helper tasks, which may still be queued after this
+	// call has returned
+	struct Work
+	{
+		std::atomic<int> next{ 0 };
+		std::atomic<int> remaining{ 0 };
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	auto work = std::make_shared<Work>();
+	work->remaining = chunks;
+
+	auto run = [work, &fn, count, chunk, chunks]() {
+		int i;
+		while ((i = work->next++) < chunks) {
+			fn(i * chunk, std::min(count, (i + 1) * chunk));
+			if (--work->remaining == 0) {
+				std::lock_guard<std::mutex> lock(work->mutex);
+				work->done.notify_all();
+			}
+		}
+	};
+
+	int helpers = std::min(size(), chunks - 1);
+	for (int i = 0; i < helpers; i++)
+		enqueue(run);
+	run();
+
+	std::unique_lock<std::mutex> lock(work->mutex);
+	work->done.wait(lock, [&work] { return work->remaining == 0; });
+}
+
+void
+ThreadPool::parallelSlices(size_t count, const std::function<void(int, size_t, size_t)> &fn)
+{
+	// parallelFor makes every slice a chunk of its own
+	int n = slices();
+	size_t perSlice = (count + n - 1) / n;
+	parallelFor(n, [&](int begin, int end) {
+		for (int s = begin; s < end; s++)
+			fn(s, std::min(count, s * perSlice), std::min(count, (s + 1) * perSlice));
+	});
+}
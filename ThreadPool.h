@@ -0,0 +1,55 @@
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads.
+// enqueue() runs fire-and-forget tasks. parallelFor() splits a range into
+// chunks that the workers and the calling thread pick up together, and
+// returns once all of them are done; since the caller works too, it is safe
+// to call from inside a task. parallelSlices() is the same for reductions
+// into per-slice partial results.
+class ThreadPool
+{
+
+public:
+	// 0 threads uses one per core, minus the calling thread
+	explicit ThreadPool(int numThreads = 0);
+	virtual ~ThreadPool();
+
+	int size() const { return (int)m_workers.size(); }
+
+	void enqueue(std::function<void()> task);
+
+	// Calls fn(begin, end) over [0, count) in chunks of at least grain items
+	void parallelFor(int count, const std::function<void(int, int)> &fn, int grain = 1);
+
+	// Number of slices parallelSlices() cuts its range into: one per thread
+	// that can run them, the caller included
+	int slices() const { return size() + 1; }
+
+	// Calls fn(slice, begin, end) for every slice in [0, slices()), each over
+	// its share of [0, count). A slice runs on one thread, so it can write
+	// partial results indexed by slice without locking. Every slice is
+	// called, with an empty range if count is small, so each can reset its
+	// partial.
+	void parallelSlices(size_t count, const std::function<void(int, size_t, size_t)> &fn);
+
+private:
+	void workerThread();
+
+	std::vector<std::thread> m_workers;
+	std::deque<std::function<void()> > m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_running;
+
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include "TriggerVolumes.h"
+#include "Simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+static const float RADIANS = 3.14159265f / 180.0f;
+
+// Points moved to structure-of-arrays at a time, small enough to stay in L1
+// while every box runs over them
+static const int BLOCK = 256;
+
+bool
+TriggerVolume::operator==(const TriggerVolume &o) const
+{
+	return name == o.name && minPoints == o.minPoints &&
+		memcmp(center, o.center, sizeof(center)) == 0 &&
+		memcmp(size, o.size, sizeof(size)) == 0 &&
+		memcmp(rotate, o.rotate, sizeof(rotate)) == 0;
+}
+
+TriggerVolumes::TriggerVolumes()
+{
+}
+
+TriggerVolumes::~TriggerVolumes()
+{
+}
+
+void
+TriggerVolumes::configure(const std::vector<TriggerVolume> &volumes)
+{
+	std::vector<TriggerState> states(volumes.size());
+	for (size_t i = 0; i < volumes.size() && i < m_volumes.size(); i++)
+		if (volumes[i] == m_volumes[i]) states[i] = m_states[i];
+	m_states.swap(states);
+	m_volumes = volumes;
+
+	// Box to world is Rz * Ry * Rx; its transpose takes points back into
+	// the box, after the centre is subtracted
+	m_boxes.resize(m_volumes.size());
+	for (size_t i = 0; i < m_volumes.size(); i++) {
+		const TriggerVolume &v = m_volumes[i];
+		float cx = std::cos(v.rotate[0] * RADIANS), sx = std::sin(v.rotate[0] * RADIANS);
+		float cy = std::cos(v.rotate[1] * RADIANS), sy = std::sin(v.rotate[1] * RADIANS);
+		float cz = std::cos(v.rotate[2] * RADIANS), sz = std::sin(v.rotate[2] * RADIANS);
+		float r[3][3] = {
+			{ cy * cz, sx * sy * cz - cx * sz, cx * sy * cz + sx * sz },
+			{ cy * sz, sx * sy * sz + cx * cz, cx * sy * sz - sx * cz },
+			{ -sy, sx * cy, cx * cy },
+		};
+
+		Box &box = m_boxes[i];
+		for (int a = 0; a < 3; a++) {
+			for (int j = 0; j < 3; j++) box.axes[a][j] = r[j][a];
+			box.offset[a] = -(box.axes[a][0] * v.center[0] + box.axes[a][1] * v.center[1] + box.axes[a][2] * v.center[2]);
+			box.half[a] = std::abs(v.size[a]) * 0.5f;
+		}
+		for (int a = 0; a < 3; a++) {
+			float extent = 0.0f;
+			for (int j = 0; j < 3; j++) extent += std::abs(r[a][j]) * box.half[j];
+			box.min[a] = v.center[a] - extent;
+			box.max[a] = v.center[a] + extent;
+		}
+	}
+}
+
+void
+TriggerVolumes::evaluateSlice(const float *points, size_t begin, size_t end, Sums *sums) const
+{
+	const size_t boxes = m_boxes.size();
+	for (size_t b = 0; b < boxes; b++)
+		sums[b] = Sums{ 0, { 0.0, 0.0, 0.0 } };
+
+	size_t i = begin;
+#ifdef SENSETOP_SSE2
+	alignas(16) float xs[BLOCK], ys[BLOCK], zs[BLOCK], ws[BLOCK];
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	for (; i + BLOCK <= end; i += BLOCK) {
+		// Bounds of the block, points without depth included at the origin,
+		// so boxes nowhere near it can be skipped
+		__m128 lo = _mm_set1_ps(INFINITY), hi = _mm_set1_ps(-INFINITY);
+		for (int j = 0; j < BLOCK; j += 4) {
+			__m128 p0 = _mm_loadu_ps(points + (i + j) * 4);
+			__m128 p1 = _mm_loadu_ps(points + (i + j) * 4 + 4);
+			__m128 p2 = _mm_loadu_ps(points + (i + j) * 4 + 8);
+			__m128 p3 = _mm_loadu_ps(points + (i + j) * 4 + 12);
+			lo = _mm_min_ps(lo, _mm_min_ps(_mm_min_ps(p0, p1), _mm_min_ps(p2, p3)));
+			hi = _mm_max_ps(hi, _mm_max_ps(_mm_max_ps(p0, p1), _mm_max_ps(p2, p3)));
+			_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+			_mm_store_ps(xs + j, p0);
+			_mm_store_ps(ys + j, p1);
+			_mm_store_ps(zs + j, p2);
+			_mm_store_ps(ws + j, _mm_cmpgt_ps(p3, _mm_setzero_ps()));
+		}
+
+		alignas(16) float blockMin[4], blockMax[4];
+		_mm_store_ps(blockMin, lo);
+		_mm_store_ps(blockMax, hi);
+
+		for (size_t b = 0; b < boxes; b++) {
+			const Box &box = m_boxes[b];
+			if (blockMin[0] > box.max[0] || blockMax[0] < box.min[0] ||
+				blockMin[1] > box.max[1] || blockMax[1] < box.min[1] ||
+				blockMin[2] > box.max[2] || blockMax[2] < box.min[2])
+				continue;
+
+			__m128 a[3][3], offset[3], half[3];
+			for (int r = 0; r < 3; r++) {
+				for (int c = 0; c < 3; c++) a[r][c] = _mm_set1_ps(box.axes[r][c]);
+				offset[r] = _mm_set1_ps(box.offset[r]);
+				half[r] = _mm_set1_ps(box.half[r]);
+			}
+
+			__m128i count = _mm_setzero_si128();
+			__m128 sx = _mm_setzero_ps(), sy = _mm_setzero_ps(), sz = _mm_setzero_ps();
+			for (int j = 0; j < BLOCK; j += 4) {
+				__m128 x = _mm_load_ps(xs + j), y = _mm_load_ps(ys + j), z = _mm_load_ps(zs + j);
+				__m128 inside = _mm_load_ps(ws + j);
+				for (int r = 0; r < 3; r++) {
+					__m128 local = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[r][0], x), _mm_mul_ps(a[r][1], y)),
+											  _mm_add_ps(_mm_mul_ps(a[r][2], z), offset[r]));
+					inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_andnot_ps(sign, local), half[r]));
+				}
+				count = _mm_sub_epi32(count, _mm_castps_si128(inside));
+				sx = _mm_add_ps(sx, _mm_and_ps(inside, x));
+				sy = _mm_add_ps(sy, _mm_and_ps(inside, y));
+				sz = _mm_add_ps(sz, _mm_and_ps(inside, z));
+			}
+
+			// Lanes into the double sums once per block
+			alignas(16) int32_t counts[4];
+			alignas(16) float lanes[3][4];
+			_mm_store_si128((__m128i*)counts, count);
+			_mm_store_ps(lanes[0], sx);
+			_mm_store_ps(lanes[1], sy);
+			_mm_store_ps(lanes[2], sz);
+			Sums &s = sums[b];
+			s.count += counts[0] + counts[1] + counts[2] + counts[3];
+			for (int c = 0; c < 3; c++)
+				s.sum[c] += (double)lanes[c][0] + lanes[c][1] + lanes[c][2] + lanes[c][3];
+		}
+	}
+#endif
+
+	for (; i < end; i++) {
+		const float *p = points + i * 4;
+		if (p[3] <= 0.0f) continue;
+		for (size_t b = 0; b < boxes; b++) {
+			const Box &box = m_boxes[b];
+			bool inside = true;
+			for (int r = 0; r < 3 && inside; r++) {
+				float local = box.axes[r][0] * p[0] + box.axes[r][1] * p[1] + box.axes[r][2] * p[2] + box.offset[r];
+				inside = std::abs(local) <= box.half[r];
+			}
+			if (!inside) continue;
+			Sums &s = sums[b];
+			s.count++;
+			for (int c = 0; c < 3; c++) s.sum[c] += p[c];
+		}
+	}
+}
+
+void
+TriggerVolumes::evaluate(const float *points, size_t count, ThreadPool &pool)
+{
+	auto start = std::chrono::steady_clock::now();
+	if (m_boxes.empty()) return;
+
+	m_partials.resize(pool.slices());
+	for (std::vector<Sums> &partial : m_partials)
+		partial.resize(m_boxes.size());
+	pool.parallelSlices(count, [&](int slice, size_t begin, size_t end) {
+		evaluateSlice(points, begin, end, m_partials[slice].data());
+	});
+
+	for (size_t b = 0; b < m_boxes.size(); b++) {
+		Sums total = { 0, { 0.0, 0.0, 0.0 } };
+		for (const std::vector<Sums> &partial : m_partials) {
+			total.count += partial[b].count;
+			for (int c = 0; c < 3; c++) total.sum[c] += partial[b].sum[c];
+		}
+
+		TriggerState &state = m_states[b];
+		bool occupied = total.count >= std::max(1, m_volumes[b].minPoints);
+		state.entered = occupied && !state.occupied;
+		state.exited = !occupied && state.occupied;
+		state.occupied = occupied;
+		state.count = (int32_t)total.count;
+		for (int c = 0; c < 3; c++)
+			state.centroid[c] = total.count > 0 ? (float)(total.sum[c] / total.count) : 0.0f;
+	}
+
+	lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
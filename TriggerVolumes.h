@@ -0,0 +1,85 @@
+#ifndef TriggerVolumes_h
+#define TriggerVolumes_h
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+// A box in world space, from one row of the trigger DAT. Rotation is in
+// degrees, applied x first, then y, then z, like TouchDesigner's default
+// rotate order; all zero makes it axis-aligned.
+struct TriggerVolume
+{
+	std::string name;
+	float center[3] = { 0.0f, 0.0f, 0.0f };
+	float size[3] = { 1.0f, 1.0f, 1.0f };
+	float rotate[3] = { 0.0f, 0.0f, 0.0f };
+	int32_t minPoints = 50;			// points inside for the volume to count as occupied
+
+	bool operator==(const TriggerVolume &o) const;
+	bool operator!=(const TriggerVolume &o) const { return !(*this == o); }
+};
+
+// What a volume held in the last evaluated frame
+struct TriggerState
+{
+	int32_t count = 0;
+	float centroid[3] = { 0.0f, 0.0f, 0.0f };	// of the points inside, 0 if there are none
+	bool occupied = false;
+	bool entered = false;			// became occupied in this frame
+	bool exited = false;			// stopped being occupied in this frame
+};
+
+// Counts world-space points inside a list of trigger boxes.
+// Points are split into one slice per thread, like the heightmap. Each slice
+// takes its points four at a time, moves them into every box's frame with
+// SSE2 and accumulates the count and position sums of those inside, so a
+// frame is a single pass however many boxes there are. Cook thread only.
+class TriggerVolumes
+{
+
+public:
+	TriggerVolumes();
+	virtual ~TriggerVolumes();
+
+	// Only needed when the volumes change. Volumes that stay the same, at
+	// the same index, keep their state.
+	void configure(const std::vector<TriggerVolume> &volumes);
+	const std::vector<TriggerVolume>& volumes() const { return m_volumes; }
+
+	// points are xyzw, w = 0 for pixels without depth
+	void evaluate(const float *points, size_t count, ThreadPool &pool);
+	const std::vector<TriggerState>& states() const { return m_states; }
+
+	// Telemetry
+	std::atomic<double> lastMs{ 0.0 };
+
+private:
+	// World-to-box rows, offsets and half sizes, and the box's world-space
+	// bounds
+	struct Box
+	{
+		float axes[3][3];
+		float offset[3];
+		float half[3];
+		float min[3];
+		float max[3];
+	};
+
+	struct Sums
+	{
+		int64_t count;
+		double sum[3];
+	};
+
+	void evaluateSlice(const float *points, size_t begin, size_t end, Sums *sums) const;
+
+	std::vector<TriggerVolume> m_volumes;
+	std::vector<TriggerState> m_states;
+	std::vector<Box> m_boxes;
+	std::vector<std::vector<Sums> > m_partials;
+
+};
+
+#endif
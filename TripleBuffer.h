@@ -0,0 +1,57 @@
+#ifndef TripleBuffer_h
+#define TripleBuffer_h
+
+#include <atomic>
+
+// Lock-free handoff of the latest value from one producer to one consumer.
+// The producer fills back() and publishes it; the consumer picks up the most
+// recently published value with update() and reads it through front() until
+// its next update(). Neither side ever waits, and older unread values are
+// simply overwritten.
+template <typename T>
+class TripleBuffer
+{
+
+public:
+	// Producer: the slot to fill next
+	T& back() { return m_slots[m_back]; }
+
+	// Producer: makes back() the latest value and takes a free slot
+	void publish()
+	{
+		m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Consumer: moves to the latest published value, false if there is
+	// nothing newer than front()
+	bool update()
+	{
+		if (!(m_middle.load(std::memory_order_relaxed) & FRESH)) return false;
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// Consumer: checks for a newer value without taking it
+	bool hasUpdate() const { return (m_middle.load(std::memory_order_relaxed) & FRESH) != 0; }
+
+	const T& front() const { return m_slots[m_front]; }
+
+	// Consumer: front() is the consumer's own until its next update(), so
+	// it may change it in place
+	T& front() { return m_slots[m_front]; }
+
+	// Access to every slot, for preallocating them before the producer starts
+	T* slots() { return m_slots; }
+
+private:
+	static const int INDEX = 3;
+	static const int FRESH = 4;
+
+	T m_slots[3];
+	int m_back = 0;
+	int m_front = 1;
+	std::atomic<int> m_middle{ 2 };
+
+};
+
+#endif
@@ -0,0 +1,162 @@
+// Accuracy and speed of TSDF fusion and ICP tracking on the synthetic scene.
+// Not part of the plugin; build it on its own:
+//
+//	g++ -O2 -std=c++14 TsdfBench.cpp TsdfFusion.cpp TsdfVolume.cpp
+//		IcpTracker.cpp DepthPyramid.cpp ThreadPool.cpp Deprojection.cpp
+//		Matrix.cpp SyntheticDepthSource.cpp -lpthread -o TsdfBench
+//
+// Matrix.h includes TouchDesigner's headers, so use the plugin's include
+// paths. Three parts:
+//
+// - A still camera fuses one frame ten times; the render is compared with
+//   the input depth and integration and ray casting are timed.
+// - TsdfFusion with tracking on, fed the moving scene one frame at a time,
+//   reports the time per frame.
+// - The camera moves along a known path through the fused volume and ICP
+//   follows it against full and half-resolution renders, for the drift of
+//   each.
+//
+// Returns 0 if the render matches the input and tracking holds.
+
+#include "TsdfFusion.h"
+#include "SyntheticDepthSource.h"
+#include "SteadyClock.h"
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+static const int WIDTH = 640;
+static const int HEIGHT = 480;
+
+// Mean render error allowed on the still scene, mm
+static const double MAX_RENDER_ERROR = 2.0;
+
+// Drift allowed after the tracked path, mm
+static const double MAX_DRIFT = 50.0;
+
+// Known camera path: a slow turn about x while moving up and back
+static Matrix
+poseAt(int frame)
+{
+	double a = 0.01 * frame, c = std::cos(a), s = std::sin(a);
+	double rows[4][4] = {
+		{ 1.0, 0.0, 0.0, 0.002 * frame },
+		{ 0.0, c, s, 1.0 + 0.005 * frame },
+		{ 0.0, -s, c, -0.01 * frame },
+		{ 0.0, 0.0, 0.0, 1.0 },
+	};
+	return Matrix::fromRows(rows);
+}
+
+// Drift in mm after following poseAt() for frames frames, with the reference
+// rendered at the given pyramid level
+static double
+trackPath(const TsdfVolume &volume, const DepthIntrinsics &k, int level, int frames, double &msPerFrame, ThreadPool &pool)
+{
+	DepthIntrinsics referenceK = k;
+	for (int l = 0; l < level; l++)
+		referenceK = referenceK.halved();
+	int width = WIDTH >> level, height = HEIGHT >> level;
+	std::vector<float> reference(width * height * 4), render(WIDTH * HEIGHT * 4), depth(WIDTH * HEIGHT);
+
+	IcpTracker tracker(WIDTH, HEIGHT);
+	Matrix estimate = poseAt(0);
+	volume.raycast(width, height, referenceK, estimate, nullptr, reference.data(), pool);
+	tracker.setReference(reference.data() + 3, 4, level, referenceK, estimate, pool);
+
+	double drift = 0.0, ms = 0.0;
+	for (int i = 1; i <= frames; i++) {
+		// The frame the camera would see from the true pose
+		Matrix truth = poseAt(i);
+		volume.raycast(WIDTH, HEIGHT, k, truth, nullptr, render.data(), pool);
+		for (int j = 0; j < WIDTH * HEIGHT; j++)
+			depth[j] = render[j * 4 + 3];
+
+		if (!tracker.track(depth.data(), k, estimate, pool)) return -1.0;
+		ms += tracker.lastMs;
+		drift = std::sqrt(std::pow(estimate[12] - truth[12], 2) + std::pow(estimate[13] - truth[13], 2) +
+			std::pow(estimate[14] - truth[14], 2)) * 1000.0;
+
+		volume.raycast(width, height, referenceK, estimate, nullptr, reference.data(), pool);
+		tracker.setReference(reference.data() + 3, 4, level, referenceK, estimate, pool);
+	}
+	msPerFrame = ms / frames;
+	return drift;
+}
+
+int
+main()
+{
+	SyntheticDepthSource scene(WIDTH, HEIGHT, 30.0);
+	DepthIntrinsics k = scene.intrinsics();
+	ThreadPool pool;
+	std::vector<uint16_t> raw;
+	std::vector<float> depth, render(WIDTH * HEIGHT * 4);
+
+	// Still camera
+	TsdfVolume volume;
+	TsdfSettings settings;
+	settings.maxDepth = 4.0f;
+	volume.configure(settings);
+	Matrix pose = poseAt(0);
+	scene.render(0, raw);
+	depth.assign(raw.begin(), raw.end());
+	DepthPyramid pyramid;
+	pyramid.build(depth.data(), WIDTH, HEIGHT);
+	double integrateMs = 0.0, raycastMs = 0.0;
+	for (int i = 0; i < 10; i++) {
+		double start = steadySeconds();
+		volume.integrate(depth.data(), WIDTH, HEIGHT, k, pose, pool);
+		double integrated = steadySeconds();
+		volume.raycast(WIDTH, HEIGHT, k, pose, &pyramid, render.data(), pool);
+		integrateMs = (integrated - start) * 1e3;
+		raycastMs = (steadySeconds() - integrated) * 1e3;
+	}
+	double error = 0.0;
+	int compared = 0;
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		if (depth[i] > 0.0f && render[i * 4 + 3] > 0.0f) {
+			error += std::fabs(render[i * 4 + 3] - depth[i]);
+			compared++;
+		}
+	}
+	double meanError = compared ? error / compared : 1e9;
+	printf("Still camera, %zu blocks: integrate %.1f ms, ray cast %.1f ms, render within %.2f mm of the input\n",
+		volume.blockCount(), integrateMs, raycastMs, meanError);
+
+	// Fusion with tracking, one frame at a time
+	TsdfFusion fusion(WIDTH, HEIGHT);
+	settings.track = true;
+	const int frames = 40, warmup = 5;
+	double trackMs = 0.0, renderMs = 0.0, frameMs = 0.0;
+	for (int i = 0; i < frames; i++) {
+		scene.render(i, raw);
+		depth.assign(raw.begin(), raw.end());
+		pyramid.build(depth.data(), WIDTH, HEIGHT);
+		int64_t before = fusion.framesIntegrated;
+		double start = steadySeconds();
+		fusion.submit(depth.data(), pyramid, k, pose, settings, pool);
+		while (fusion.framesIntegrated == before)
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		if (i < warmup) continue;
+		trackMs += fusion.tracker().lastMs;
+		renderMs += fusion.raycastMs;
+		frameMs += (steadySeconds() - start) * 1e3;
+	}
+	int timed = frames - warmup;
+	printf("Tracked fusion on %u cores: ICP %.1f ms, render %.1f ms, %.1f ms a frame (%.1f fps), %d lost\n",
+		std::thread::hardware_concurrency(), trackMs / timed, renderMs / timed, frameMs / timed, 1000.0 / (frameMs / timed),
+		(int)fusion.tracker().lost);
+
+	// Known path
+	double fullMs = 0.0, halfMs = 0.0;
+	double fullDrift = trackPath(volume, k, 0, 10, fullMs, pool);
+	double halfDrift = trackPath(volume, k, 1, 10, halfMs, pool);
+	printf("Known path, 10 frames: drift %.1f mm at full resolution (ICP %.1f ms), %.1f mm at half (ICP %.1f ms)\n",
+		fullDrift, fullMs, halfDrift, halfMs);
+
+	bool ok = meanError <= MAX_RENDER_ERROR && fusion.tracker().lost == 0 && fullDrift >= 0.0 && fullDrift <= MAX_DRIFT &&
+		halfDrift >= 0.0 && halfDrift <= MAX_DRIFT;
+	printf("%s\n", ok ? "Passed" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+#include "TsdfFusion.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// While tracking, the volume is rendered at this level of the tracker's
+// pyramid, both to align the next frame to and, scaled up, as the output.
+// The full-resolution raycast and ICP's finest level were most of the time
+// a tracked frame took.
+static const int TRACKING_LEVEL = 1;
+
+TsdfFusion::TsdfFusion(int width, int height)
+: m_width(width), m_height(height), m_tracker(width, height), m_tracking(false), m_busy(false), m_resetPending(false),
+	m_worker(new ThreadPool(1))
+{
+	m_depth.resize(width * height);
+	m_reference.resize((width >> TRACKING_LEVEL) * (height >> TRACKING_LEVEL) * 4);
+	for (int i = 0; i < 3; i++)
+		m_renders.slots()[i].resize(width * height * 4);
+}
+
+TsdfFusion::~TsdfFusion()
+{
+	// Let a frame in progress finish
+	m_worker.reset();
+}
+
+bool
+TsdfFusion::submit(const float *depth, const DepthPyramid &pyramid, const DepthIntrinsics &k, const Matrix &cameraToWorld, const TsdfSettings &settings,
+	ThreadPool &pool)
+{
+	if (m_busy) {
+		framesSkipped++;
+		return false;
+	}
+
+	memcpy(m_depth.data(), depth, m_depth.size() * sizeof(float));
+	m_pyramid.copy(pyramid, m_depth.data());
+	m_intrinsics = k;
+	m_cameraToWorld = cameraToWorld;
+	m_settings = settings;
+
+	m_busy = true;
+	m_worker->enqueue([this, &pool] { run(pool); });
+	return true;
+}
+
+const float*
+TsdfFusion::latest()
+{
+	return m_renders.update() ? m_renders.front().data() : nullptr;
+}
+
+Matrix
+TsdfFusion::pose() const
+{
+	std::lock_guard<std::mutex> lock(m_poseMutex);
+	return m_pose;
+}
+
+void
+TsdfFusion::run(ThreadPool &pool)
+{
+	if (m_resetPending.exchange(false)) {
+		m_volume.reset();
+		m_tracker.reset();
+	}
+	if (m_settings.track != m_tracking) {
+		m_tracker.reset();
+		m_tracking = m_settings.track;
+	}
+	m_volume.configure(m_settings);
+
+	// Tracking starts from the last pose; a frame that can't be aligned is
+	// left out of the volume, and the next one tries again from there
+	Matrix pose = m_cameraToWorld;
+	bool integrate = true;
+	if (m_tracking && m_tracker.hasReference()) {
+		pose = this->pose();
+		integrate = m_tracker.track(m_depth.data(), m_intrinsics, pose, pool);
+		trackingLost = !integrate;
+	}
+	else {
+		trackingLost = false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	if (integrate)
+		m_volume.integrate(m_depth.data(), m_width, m_height, m_intrinsics, pose, pool);
+	auto integrated = std::chrono::steady_clock::now();
+	float *render = m_renders.back().data();
+	if (m_tracking) {
+		DepthIntrinsics k = m_intrinsics;
+		for (int l = 0; l < TRACKING_LEVEL; l++)
+			k = k.halved();
+		int width = m_width >> TRACKING_LEVEL, height = m_height >> TRACKING_LEVEL;
+		m_volume.raycast(width, height, k, pose, &m_pyramid, m_reference.data(), pool);
+		m_tracker.setReference(m_reference.data() + 3, 4, TRACKING_LEVEL, k, pose, pool);
+
+		// Each rendered texel covers a block of output pixels
+		const float *reference = m_reference.data();
+		int outWidth = m_width, outHeight = m_height;
+		pool.parallelFor(outHeight, [=](int begin, int end) {
+			for (int y = begin; y < end; y++) {
+				const float *row = reference + (size_t)std::min(y >> TRACKING_LEVEL, height - 1) * width * 4;
+				float *out = render + (size_t)y * outWidth * 4;
+				for (int x = 0; x < outWidth; x++)
+					memcpy(out + x * 4, row + std::min(x >> TRACKING_LEVEL, width - 1) * 4, 4 * sizeof(float));
+			}
+		}, 16);
+	}
+	else {
+		m_volume.raycast(m_width, m_height, m_intrinsics, pose, &m_pyramid, render, pool);
+	}
+	m_renders.publish();
+	auto end = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(m_poseMutex);
+		m_pose = pose;
+	}
+
+	integrateMs = std::chrono::duration<double, std::milli>(integrated - start).count();
+	raycastMs = std::chrono::duration<double, std::milli>(end - integrated).count();
+	blocks = (int32_t)m_volume.blockCount();
+	visibleBlocks = (int32_t)m_volume.visibleBlocks();
+	full = m_volume.isFull();
+	framesIntegrated++;
+	m_busy = false;
+}
@@ -0,0 +1,86 @@
+#ifndef TsdfFusion_h
+#define TsdfFusion_h
+
+#include "TsdfVolume.h"
+#include "IcpTracker.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Runs a TsdfVolume off the cook thread. submit() copies a depth frame and
+// its pose and returns; a worker integrates it and renders the volume back
+// from the same pose. Frames that arrive while the worker is busy are
+// skipped, so fusion runs at whatever rate the machine manages and never
+// holds up capture or cooking. Renders come back through a triple buffer.
+//
+// With tracking on, the given pose only anchors the first frame after a
+// reset; each later frame is aligned to the previous render with ICP, so a
+// handheld camera can scan without an external pose. To keep up with the
+// camera, the volume is then rendered at half resolution and scaled up.
+class TsdfFusion
+{
+
+public:
+	TsdfFusion(int width, int height);
+	virtual ~TsdfFusion();
+
+	// Cook thread. depth in mm, with its pyramid already built; both are
+	// copied. Returns false if the frame was skipped. The work is spread over
+	// pool, which must outlive the fusion.
+	bool submit(const float *depth, const DepthPyramid &pyramid, const DepthIntrinsics &k, const Matrix &cameraToWorld, const TsdfSettings &settings,
+		ThreadPool &pool);
+
+	// Cook thread. Empties the volume before the next frame is integrated,
+	// and restarts tracking from the given pose.
+	void reset() { m_resetPending = true; }
+
+	// Pose the last frame was integrated at
+	Matrix pose() const;
+	const IcpTracker& tracker() const { return m_tracker; }
+
+	// Cook thread. The newest render, see TsdfVolume::raycast(), or nullptr
+	// if there is nothing new since the last call.
+	const float* latest();
+	bool hasUpdate() const { return m_renders.hasUpdate(); }
+
+	// Telemetry
+	std::atomic<int64_t> framesIntegrated{ 0 };
+	std::atomic<int64_t> framesSkipped{ 0 };
+	std::atomic<double> integrateMs{ 0.0 };
+	std::atomic<double> raycastMs{ 0.0 };
+	std::atomic<int32_t> blocks{ 0 };
+	std::atomic<int32_t> visibleBlocks{ 0 };
+	std::atomic<bool> full{ false };
+	std::atomic<bool> trackingLost{ false };
+
+private:
+	void run(ThreadPool &pool);
+
+	int m_width;
+	int m_height;
+
+	// Owned by the worker while m_busy is set
+	std::vector<float> m_depth;
+	DepthPyramid m_pyramid;
+	std::vector<float> m_reference;
+	DepthIntrinsics m_intrinsics;
+	Matrix m_cameraToWorld;
+	TsdfSettings m_settings;
+	TsdfVolume m_volume;
+	IcpTracker m_tracker;
+	bool m_tracking;
+
+	mutable std::mutex m_poseMutex;
+	Matrix m_pose;
+
+	std::atomic<bool> m_busy;
+	std::atomic<bool> m_resetPending;
+	TripleBuffer<std::vector<float> > m_renders;
+
+	std::unique_ptr<ThreadPool> m_worker;
+
+};
+
+#endif
@@ -0,0 +1,397 @@
+#include "TsdfVolume.h"
+#include <algorithm>
+#include <cmath>
+
+static const uint64_t EMPTY_KEY = ~0ull;
+static const int KEY_BITS = 21;
+static const int KEY_BIAS = 1 << (KEY_BITS - 1);
+static const uint64_t KEY_MASK = (1ull << KEY_BITS) - 1;
+static const size_t INITIAL_TABLE = 1 << 16;
+
+// Closest rays start here, metres
+static const float MIN_DEPTH = 0.1f;
+
+// Pixels either side of a hole that bound the depth its ray searches
+static const int HOLE_RADIUS = 16;
+
+// std::floor for values well inside int range, without the libm call
+static inline int
+fastFloor(float x)
+{
+	int i = (int)x;
+	return i - (x < i);
+}
+
+static inline size_t
+hashKey(uint64_t key)
+{
+	key ^= key >> 29;
+	key *= 0xBF58476D1CE4E5B9ull;
+	key ^= key >> 32;
+	return (size_t)key;
+}
+
+static inline void
+transformPoint(const Matrix &m, const float p[3], float out[3])
+{
+	for (int i = 0; i < 3; i++)
+		out[i] = m[i] * p[0] + m[4 + i] * p[1] + m[8 + i] * p[2] + m[12 + i];
+}
+
+TsdfVolume::TsdfVolume()
+: m_tableMask(0), m_frame(0)
+{
+	reset();
+}
+
+TsdfVolume::~TsdfVolume()
+{
+}
+
+void
+TsdfVolume::configure(const TsdfSettings &settings)
+{
+	bool geometry = settings.voxelSize != m_settings.voxelSize || settings.truncation != m_settings.truncation;
+	m_settings = settings;
+	if (geometry) reset();
+}
+
+void
+TsdfVolume::reset()
+{
+	m_tableKeys.assign(INITIAL_TABLE, EMPTY_KEY);
+	m_tableValues.assign(INITIAL_TABLE, -1);
+	m_tableMask = INITIAL_TABLE - 1;
+
+	m_blockKeys.clear();
+	m_voxels.clear();
+	m_blockFrame.clear();
+	m_visible.clear();
+	m_frame = 0;
+}
+
+uint64_t
+TsdfVolume::blockKey(int bx, int by, int bz) const
+{
+	return ((uint64_t)((bx + KEY_BIAS) & KEY_MASK) << (2 * KEY_BITS)) |
+		((uint64_t)((by + KEY_BIAS) & KEY_MASK) << KEY_BITS) |
+		(uint64_t)((bz + KEY_BIAS) & KEY_MASK);
+}
+
+int32_t
+TsdfVolume::find(uint64_t key) const
+{
+	for (size_t i = hashKey(key) & m_tableMask; ; i = (i + 1) & m_tableMask) {
+		if (m_tableKeys[i] == key) return m_tableValues[i];
+		if (m_tableKeys[i] == EMPTY_KEY) return -1;
+	}
+}
+
+// Adds a new block, the key must not be in the table yet
+int32_t
+TsdfVolume::insert(uint64_t key)
+{
+	if ((m_blockKeys.size() + 1) * 2 > m_tableKeys.size()) grow();
+
+	int32_t index = (int32_t)m_blockKeys.size();
+	size_t i = hashKey(key) & m_tableMask;
+	while (m_tableKeys[i] != EMPTY_KEY)
+		i = (i + 1) & m_tableMask;
+	m_tableKeys[i] = key;
+	m_tableValues[i] = index;
+
+	m_blockKeys.push_back(key);
+	m_blockFrame.push_back(0);
+	m_voxels.resize(m_voxels.size() + BLOCK_VOXELS, Voxel{ 0, 0 });
+	return index;
+}
+
+// Doubles the table, kept at most half full so probe runs stay short
+void
+TsdfVolume::grow()
+{
+	size_t size = m_tableKeys.size() * 2;
+	m_tableKeys.assign(size, EMPTY_KEY);
+	m_tableValues.assign(size, -1);
+	m_tableMask = size - 1;
+
+	for (size_t b = 0; b < m_blockKeys.size(); b++) {
+		size_t i = hashKey(m_blockKeys[b]) & m_tableMask;
+		while (m_tableKeys[i] != EMPTY_KEY)
+			i = (i + 1) & m_tableMask;
+		m_tableKeys[i] = m_blockKeys[b];
+		m_tableValues[i] = (int32_t)b;
+	}
+}
+
+// The voxel containing p, or nullptr if its block was never allocated.
+// Consecutive lookups along a ray mostly land in the same block, so the
+// last block found is remembered by the caller.
+const TsdfVolume::Voxel*
+TsdfVolume::voxelAt(const float p[3], uint64_t &cacheKey, int32_t &cacheBlock) const
+{
+	// BLOCK is 8, so the block is an arithmetic shift away and the voxel
+	// within it the low bits, negative coordinates included
+	float inv = 1.0f / m_settings.voxelSize;
+	int vx = fastFloor(p[0] * inv), vy = fastFloor(p[1] * inv), vz = fastFloor(p[2] * inv);
+
+	uint64_t key = blockKey(vx >> 3, vy >> 3, vz >> 3);
+	if (key != cacheKey) {
+		cacheKey = key;
+		cacheBlock = find(key);
+	}
+	if (cacheBlock < 0) return nullptr;
+
+	return &m_voxels[(size_t)cacheBlock * BLOCK_VOXELS + ((vz & 7) * BLOCK + (vy & 7)) * BLOCK + (vx & 7)];
+}
+
+// Finds the blocks within the truncation band of every other pixel's
+// surface point, allocating the missing ones. Each chunk of rows collects
+// its keys privately and takes the lock once to merge them.
+void
+TsdfVolume::allocate(const float *depth, int width, int height, const DepthIntrinsics &k,
+					 const Matrix &cameraToWorld, ThreadPool &pool)
+{
+	const TsdfSettings &s = m_settings;
+	float blockSize = s.voxelSize * BLOCK;
+	int samples = (int)std::ceil(2.0f * s.truncation / (blockSize * 0.5f)) + 1;
+	float inv = 1.0f / blockSize;
+
+	pool.parallelFor(height / 2, [&](int begin, int end) {
+		std::vector<uint64_t> keys;
+		for (int y = begin * 2; y < end * 2; y += 2) {
+			uint64_t last = EMPTY_KEY;
+			for (int x = 0; x < width; x += 2) {
+				float d = depth[y * width + x] * 0.001f;
+				if (d <= 0.0f || d > s.maxDepth) continue;
+
+				float p[3] = { (x - k.cx) / k.fx * d, -(y - k.cy) / k.fy * d, -d };
+				float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+				for (int i = 0; i < samples; i++) {
+					float offset = -s.truncation + 2.0f * s.truncation * i / (samples - 1);
+					float scale = 1.0f + offset / length;
+					float q[3] = { p[0] * scale, p[1] * scale, p[2] * scale }, w[3];
+					transformPoint(cameraToWorld, q, w);
+					uint64_t key = blockKey(fastFloor(w[0] * inv), fastFloor(w[1] * inv), fastFloor(w[2] * inv));
+					if (key != last) keys.push_back(key);
+					last = key;
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(m_allocMutex);
+		for (uint64_t key : keys) {
+			int32_t block = find(key);
+			if (block < 0) {
+				if (isFull()) continue;
+				block = insert(key);
+			}
+			if (m_blockFrame[block] != m_frame) {
+				m_blockFrame[block] = m_frame;
+				m_visible.push_back(block);
+			}
+		}
+	}, 4);
+}
+
+void
+TsdfVolume::integrate(const float *depth, int width, int height, const DepthIntrinsics &k,
+					  const Matrix &cameraToWorld, ThreadPool &pool)
+{
+	Matrix worldToCamera;
+	if (!k.isValid() || !cameraToWorld.inverse(worldToCamera)) return;
+
+	m_frame++;
+	m_visible.clear();
+	allocate(depth, width, height, k, cameraToWorld, pool);
+
+	const TsdfSettings &s = m_settings;
+	const float invTrunc = 1.0f / s.truncation;
+	const int maxWeight = std::max(1, std::min(s.maxWeight, 65535));
+
+	// Voxel centres in camera space are the block origin plus whole steps
+	// along each world axis, which are the columns of worldToCamera
+	const Matrix &m = worldToCamera;
+	const float ax[3] = { m[0] * s.voxelSize, m[1] * s.voxelSize, m[2] * s.voxelSize };
+	const float ay[3] = { m[4] * s.voxelSize, m[5] * s.voxelSize, m[6] * s.voxelSize };
+	const float az[3] = { m[8] * s.voxelSize, m[9] * s.voxelSize, m[10] * s.voxelSize };
+
+	pool.parallelFor((int)m_visible.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			int32_t block = m_visible[i];
+			uint64_t key = m_blockKeys[block];
+			float origin[3] = {
+				((int)((key >> (2 * KEY_BITS)) & KEY_MASK) - KEY_BIAS) * BLOCK * s.voxelSize + 0.5f * s.voxelSize,
+				((int)((key >> KEY_BITS) & KEY_MASK) - KEY_BIAS) * BLOCK * s.voxelSize + 0.5f * s.voxelSize,
+				((int)(key & KEY_MASK) - KEY_BIAS) * BLOCK * s.voxelSize + 0.5f * s.voxelSize,
+			};
+			float base[3];
+			transformPoint(worldToCamera, origin, base);
+
+			Voxel *voxel = &m_voxels[(size_t)block * BLOCK_VOXELS];
+			for (int z = 0; z < BLOCK; z++) {
+				for (int y = 0; y < BLOCK; y++) {
+					float row[3];
+					for (int c = 0; c < 3; c++)
+						row[c] = base[c] + ay[c] * y + az[c] * z;
+					for (int x = 0; x < BLOCK; x++, voxel++) {
+						float px = row[0] + ax[0] * x, py = row[1] + ax[1] * x, pz = row[2] + ax[2] * x;
+						if (pz >= 0.0f) continue;
+
+						float d = -pz;
+						int u = (int)(px / d * k.fx + k.cx + 0.5f);
+						int v = (int)(-py / d * k.fy + k.cy + 0.5f);
+						if (u < 0 || u >= width || v < 0 || v >= height) continue;
+
+						float measured = depth[v * width + u] * 0.001f;
+						if (measured <= 0.0f || measured > s.maxDepth) continue;
+
+						// Positive in front of the surface; far behind it is
+						// hidden and left alone
+						float sdf = measured - d;
+						if (sdf < -s.truncation) continue;
+						float tsdf = std::min(1.0f, sdf * invTrunc);
+
+						int w = voxel->weight;
+						float old = voxel->tsdf * (1.0f / 32767.0f);
+						float value = (old * w + tsdf) / (w + 1);
+						voxel->tsdf = (int16_t)(value * 32767.0f);
+						voxel->weight = (uint16_t)std::min(w + 1, maxWeight);
+					}
+				}
+			}
+		}
+	}, 4);
+}
+
+void
+TsdfVolume::raycast(int width, int height, const DepthIntrinsics &k, const Matrix &cameraToWorld,
+					const DepthPyramid *hint, float *out, ThreadPool &pool) const
+{
+	const TsdfSettings &s = m_settings;
+	const Matrix &m = cameraToWorld;
+	const float origin[3] = { m[12], m[13], m[14] };
+	const float h = s.voxelSize;
+	const float *hintDepth = hint ? hint->depth() : nullptr;
+	int hintLevel = 0;
+	while (hint && hintLevel + 1 < hint->levels() && hint->width(hintLevel) > width)
+		hintLevel++;
+	if (hintLevel > 0) hintDepth = hint->level(hintLevel);
+	const int hintStride = hintLevel > 0 ? 2 : 1;
+
+	// Rays through holes in the hint have no start of their own, but the
+	// surface is unlikely to be far outside the depth range of the rest of
+	// the frame
+	float nearest = MIN_DEPTH, farthest = s.maxDepth;
+	DepthRange frame = hint ? hint->frameRange() : DepthRange();
+	if (frame.isValid()) {
+		nearest = std::max(MIN_DEPTH, frame.nearest * 0.001f - 2.0f * s.truncation);
+		farthest = std::min(s.maxDepth, frame.farthest * 0.001f + 2.0f * s.truncation);
+	}
+
+	pool.parallelFor(height, [&](int begin, int end) {
+		uint64_t cacheKey = EMPTY_KEY;
+		int32_t cacheBlock = -1;
+
+		for (int y = begin; y < end; y++) {
+			for (int x = 0; x < width; x++) {
+				float *texel = out + ((size_t)y * width + x) * 4;
+				texel[0] = texel[1] = texel[2] = texel[3] = 0.0f;
+
+				// With the camera-space direction's z at -1, the ray
+				// parameter is the depth along the view axis
+				float c[3] = { (x - k.cx) / k.fx, -(y - k.cy) / k.fy, -1.0f };
+				float dir[3];
+				for (int i = 0; i < 3; i++)
+					dir[i] = m[i] * c[0] + m[4 + i] * c[1] + m[8 + i] * c[2];
+				float length = std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+				float voxelStep = h / length;
+				float blockStep = h * BLOCK * 0.5f / length;
+				float bandStep = s.truncation * 0.8f / length;
+
+				float t = nearest;
+				float end = farthest;
+				float d = hintDepth ? hintDepth[((size_t)y * width + x) * hintStride] * 0.001f : 0.0f;
+				if (d > 0.0f) {
+					t = std::max(MIN_DEPTH, d - 2.0f * s.truncation / length);
+				}
+				else if (hint) {
+					// Small holes are bracketed by the depth around them
+					int x0 = x << hintLevel, y0 = y << hintLevel, size = 1 << hintLevel;
+					DepthRange around = hint->bound(x0 - HOLE_RADIUS, y0 - HOLE_RADIUS,
+						x0 + size + HOLE_RADIUS, y0 + size + HOLE_RADIUS);
+					if (around.isValid()) {
+						t = std::max(nearest, around.nearest * 0.001f - 2.0f * s.truncation / length);
+						end = std::min(farthest, around.farthest * 0.001f + 2.0f * s.truncation / length);
+					}
+				}
+
+				bool havePrevious = false;
+				float previousF = 0.0f, previousT = 0.0f, hit = -1.0f;
+				while (t < end) {
+					float p[3] = { origin[0] + dir[0] * t, origin[1] + dir[1] * t, origin[2] + dir[2] * t };
+					const Voxel *v = voxelAt(p, cacheKey, cacheBlock);
+					if (!v || v->weight == 0) {
+						havePrevious = false;
+						t += v ? voxelStep : blockStep;
+						continue;
+					}
+
+					float f = v->tsdf * (1.0f / 32767.0f);
+					if (havePrevious && previousF > 0.0f && f <= 0.0f) {
+						hit = previousT + (t - previousT) * previousF / (previousF - f);
+						break;
+					}
+					havePrevious = true;
+					previousF = f;
+					previousT = t;
+					t += std::max(voxelStep, f * bandStep);
+				}
+				if (hit >= 0.0f) texel[3] = hit * 1000.0f;
+			}
+		}
+	}, 4);
+
+	// Normals from the rendered depth of the neighbouring pixels, which is
+	// much cheaper than sampling the field's gradient. Each pixel only
+	// writes its own xyz and only reads depth, so rows can run in parallel.
+	pool.parallelFor(height - 2, [&](int begin, int end) {
+		for (int y = begin + 1; y < end + 1; y++) {
+			for (int x = 1; x < width - 1; x++) {
+				const float *centre = out + ((size_t)y * width + x) * 4;
+				float d[4] = { centre[-4 + 3], centre[4 + 3], centre[-width * 4 + 3], centre[width * 4 + 3] };
+				if (centre[3] <= 0.0f || d[0] <= 0.0f || d[1] <= 0.0f || d[2] <= 0.0f || d[3] <= 0.0f) continue;
+
+				// Camera-space points left, right, above and below
+				float p[4][3];
+				int px[4] = { x - 1, x + 1, x, x };
+				int py[4] = { y, y, y - 1, y + 1 };
+				for (int i = 0; i < 4; i++) {
+					float z = d[i] * 0.001f;
+					p[i][0] = (px[i] - k.cx) / k.fx * z;
+					p[i][1] = -(py[i] - k.cy) / k.fy * z;
+					p[i][2] = -z;
+				}
+				float dx[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+				float dy[3] = { p[2][0] - p[3][0], p[2][1] - p[3][1], p[2][2] - p[3][2] };
+				float n[3] = {
+					dx[1] * dy[2] - dx[2] * dy[1],
+					dx[2] * dy[0] - dx[0] * dy[2],
+					dx[0] * dy[1] - dx[1] * dy[0],
+				};
+
+				// Into the world, facing the camera
+				float w[3];
+				for (int i = 0; i < 3; i++)
+					w[i] = m[i] * n[0] + m[4 + i] * n[1] + m[8 + i] * n[2];
+				float norm = std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+				if (norm <= 0.0f) continue;
+
+				float *texel = out + ((size_t)y * width + x) * 4;
+				texel[0] = w[0] / norm;
+				texel[1] = w[1] / norm;
+				texel[2] = w[2] / norm;
+			}
+		}
+	}, 16);
+}
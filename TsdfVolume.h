@@ -0,0 +1,109 @@
+#ifndef TsdfVolume_h
+#define TsdfVolume_h
+
+#include "Matrix.h"
+#include "Deprojection.h"
+#include "ThreadPool.h"
+#include "DepthPyramid.h"
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct TsdfSettings
+{
+	float voxelSize = 0.01f;		// metres
+	float truncation = 0.04f;		// metres either side of the surface
+	int32_t maxWeight = 64;			// frames averaged at most, higher is steadier but slower to update
+	float maxDepth = 3.0f;			// depth beyond this is not integrated, metres
+	bool track = false;				// follow the camera with ICP instead of the given pose
+
+	bool operator==(const TsdfSettings &o) const
+	{
+		return voxelSize == o.voxelSize && truncation == o.truncation && maxWeight == o.maxWeight &&
+			maxDepth == o.maxDepth && track == o.track;
+	}
+	bool operator!=(const TsdfSettings &o) const { return !(*this == o); }
+};
+
+// Truncated signed distance field over a sparse set of 8x8x8 voxel blocks,
+// found through a hash of their world coordinates, so memory follows the
+// observed surfaces rather than the size of the space.
+//
+// integrate() allocates the blocks around the frame's surface, then updates
+// those blocks' voxels spread over a thread pool. raycast() renders the
+// zero crossing back into a camera. Neither may run at the same time as the
+// other; the pool is only used for the work inside each call.
+class TsdfVolume
+{
+
+public:
+	// Fixed, voxelAt() relies on it being 8
+	static const int BLOCK = 8;
+	static const int BLOCK_VOXELS = BLOCK * BLOCK * BLOCK;
+
+	// Memory cap, 2 KB each
+	static const int MAX_BLOCKS = 65536;
+
+	TsdfVolume();
+	virtual ~TsdfVolume();
+
+	// Clears the volume if the voxel size or truncation changed
+	void configure(const TsdfSettings &settings);
+	const TsdfSettings& settings() const { return m_settings; }
+	void reset();
+
+	// depth in mm, width * height
+	void integrate(const float *depth, int width, int height, const DepthIntrinsics &k,
+				   const Matrix &cameraToWorld, ThreadPool &pool);
+
+	// Renders width * height pixels of 4 floats: world-space normal in xyz,
+	// depth along the view axis in mm in w, all 0 where the ray hits nothing.
+	// hint, if given, is the pyramid of the depth that was just integrated
+	// from the same view; rays start marching just in front of it, and rays
+	// through its holes only search the depth range around them. A render
+	// the size of one of the hint's coarser levels starts each ray at the
+	// nearest depth under its texel.
+	void raycast(int width, int height, const DepthIntrinsics &k, const Matrix &cameraToWorld,
+				 const DepthPyramid *hint, float *out, ThreadPool &pool) const;
+
+	size_t blockCount() const { return m_blockKeys.size(); }
+	size_t visibleBlocks() const { return m_visible.size(); }
+	bool isFull() const { return m_blockKeys.size() >= MAX_BLOCKS; }
+
+private:
+	struct Voxel
+	{
+		int16_t tsdf;			// -32767..32767 for -1..1 truncation bands
+		uint16_t weight;
+	};
+
+	// Open-addressing hash from block key to block index
+	int32_t find(uint64_t key) const;
+	int32_t insert(uint64_t key);
+	void grow();
+
+	uint64_t blockKey(int bx, int by, int bz) const;
+	const Voxel* voxelAt(const float p[3], uint64_t &cacheKey, int32_t &cacheBlock) const;
+
+	void allocate(const float *depth, int width, int height, const DepthIntrinsics &k,
+				  const Matrix &cameraToWorld, ThreadPool &pool);
+
+	TsdfSettings m_settings;
+
+	std::vector<uint64_t> m_tableKeys;
+	std::vector<int32_t> m_tableValues;
+	size_t m_tableMask;
+
+	// Per block: its key, its voxels, and the last frame that saw it
+	std::vector<uint64_t> m_blockKeys;
+	std::vector<Voxel> m_voxels;
+	std::vector<uint32_t> m_blockFrame;
+	uint32_t m_frame;
+
+	// Blocks near this frame's surface, and the lock for adding to them
+	std::vector<int32_t> m_visible;
+	std::mutex m_allocMutex;
+
+};
+
+#endif
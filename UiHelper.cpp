@@ -1,21 +1,85 @@
 #include "UiHelper.h"
 #include <assert.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 
-UiHelper::UiHelper():isInit(false), firstUpdate(false)
+UiHelper::UiHelper():isInit(false), firstUpdate(false), presetSwitched(false),
+	reloadPresets(false), cookOnNewFrame(false), delivery(FrameDelivery::Latest),
+	queueSize(4), matchDelay(0.0), fillHoles(false), holeRadius(16), autoRange(false), rangeSmoothing(0.9f), outputMode(OutputMode::Depth),
+	transformSource("none"), floorTilt(45.0), useFloor(false), triggersChanged(false), triggerHash(0), traceContours(false), sampleCount(1024), trackTargets(false), extraLatency(0.0), record(false), encoderThreads(2), replay(false),
+	replaySeconds(30.0), replayMemoryMB(512), sharedMemory(false), stream(false), streamPort(7450)
 {
 	pageName[0] = "Device";
+	pageName[1] = "Output";
+	pageName[2] = "Record";
+	pageName[3] = "Publish";
+
+	rangePercentiles[0] = 2.0f;
+	rangePercentiles[1] = 98.0f;
+	foreground[0] = 200.0f;
+	foreground[1] = 1500.0f;
 }
 
 UiHelper::~UiHelper() {}
 
 void
-UiHelper::init(OP_ParameterManager* manager, PXCCapture::Device *in_device)
+UiHelper::init(OP_ParameterManager* manager)
 {
-	// Set capture device
-	m_device = in_device;
-
 	// Custom parameters
 	{
+		// Depth source
+		{
+			OP_StringParameter	sp;
+			sp.name = "Source";
+			sp.label = "Source";
+			sp.page = pageName[0];
+			sp.defaultValue = "Camera";
+			const char* names[] = { "Camera", "Network", "Synthetic" };
+			const char* labels[] = { "Camera", "Network Stream", "Synthetic" };
+			OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Host to receive a network stream from
+		{
+			OP_StringParameter	sp;
+			sp.name = "Sourcehost";
+			sp.label = "Source host";
+			sp.page = pageName[0];
+			sp.defaultValue = "localhost";
+			OP_ParAppendResult res = manager->appendString(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Port of the network stream
+		{
+			OP_NumericParameter	np;
+			np.name = "Sourceport";
+			np.label = "Source port";
+			np.page = pageName[0];
+			np.defaultValues[0] = 7450;
+			np.minSliders[0] = 1024;
+			np.maxSliders[0] = 65535;
+			np.minValues[0] = 1;
+			np.maxValues[0] = 65535;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Spacer4
+		{
+			OP_StringParameter	sp;
+			sp.name = "Spacer4";
+			sp.label = " ";
+			sp.page = pageName[0];
+			OP_ParAppendResult res = manager->appendString(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
 		// Accuracy
 		{
 			OP_NumericParameter	np;
@@ -25,6 +89,10 @@ UiHelper::init(OP_ParameterManager* manager, PXCCapture::Device *in_device)
 			np.defaultValues[0] = 1;
 			np.minSliders[0] = 1;
 			np.maxSliders[0] = 3;
+			np.minValues[0] = 1;
+			np.maxValues[0] = 3;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
 			OP_ParAppendResult res = manager->appendInt(np);
 			assert(res == OP_ParAppendResult::Success);
 		}
@@ -38,6 +106,10 @@ UiHelper::init(OP_ParameterManager* manager, PXCCapture::Device *in_device)
 			np.defaultValues[0] = 10;
 			np.minSliders[0] = 0;
 			np.maxSliders[0] = 16;
+			np.minValues[0] = 0;
+			np.maxValues[0] = 16;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
 			OP_ParAppendResult res = manager->appendInt(np);
 			assert(res == OP_ParAppendResult::Success);
 		}
@@ -51,6 +123,10 @@ UiHelper::init(OP_ParameterManager* manager, PXCCapture::Device *in_device)
 			np.defaultValues[0] = 4;
 			np.minSliders[0] = 0;
 			np.maxSliders[0] = 7;
+			np.minValues[0] = 0;
+			np.maxValues[0] = 7;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
 			OP_ParAppendResult res = manager->appendInt(np);
 			assert(res == OP_ParAppendResult::Success);
 		}
@@ -64,6 +140,10 @@ UiHelper::init(OP_ParameterManager* manager, PXCCapture::Device *in_device)
 			np.defaultValues[0] = 10;
 			np.minSliders[0] = 0;
 			np.maxSliders[0] = 100;
+			np.minValues[0] = 0;
+			np.maxValues[0] = 100;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
 			OP_ParAppendResult res = manager->appendInt(np);
 			assert(res == OP_ParAppendResult::Success);
 		}
@@ -100,6 +180,746 @@ UiHelper::init(OP_ParameterManager* manager, PXCCapture::Device *in_device)
 			assert(res == OP_ParAppendResult::Success);
 		}
 
+		// Spacer2
+		{
+			OP_StringParameter	sp;
+			sp.name = "Spacer2";
+			sp.label = " ";
+			sp.page = pageName[0];
+			OP_ParAppendResult res = manager->appendString(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Preset file
+		{
+			OP_StringParameter	sp;
+			sp.name = "Presetfile";
+			sp.label = "Preset file";
+			sp.page = pageName[0];
+			OP_ParAppendResult res = manager->appendFile(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Active preset, empty uses the values above
+		{
+			OP_StringParameter	sp;
+			sp.name = "Preset";
+			sp.label = "Preset";
+			sp.page = pageName[0];
+			sp.defaultValue = "";
+			OP_ParAppendResult res = manager->appendString(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Reload preset file
+		{
+			OP_NumericParameter	np;
+			np.name = "Reloadpresets";
+			np.label = "Reload presets";
+			np.page = pageName[0];
+			OP_ParAppendResult res = manager->appendPulse(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Cook mode
+		{
+			OP_StringParameter	sp;
+			sp.name = "Cookmode";
+			sp.label = "Cook mode";
+			sp.page = pageName[1];
+			sp.defaultValue = "Everyframe";
+			const char* names[] = { "Everyframe", "Newframe" };
+			const char* labels[] = { "Every Frame", "On New Frame" };
+			OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Frame delivery policy
+		{
+			OP_StringParameter	sp;
+			sp.name = "Delivery";
+			sp.label = "Frame delivery";
+			sp.page = pageName[1];
+			sp.defaultValue = "Latest";
+			const char* names[] = { "Latest", "Fifo", "Timestamp" };
+			const char* labels[] = { "Latest Only", "FIFO Queue", "Timestamp Matched" };
+			OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// FIFO queue size
+		{
+			OP_NumericParameter	np;
+			np.name = "Queuesize";
+			np.label = "Queue size";
+			np.page = pageName[1];
+			np.defaultValues[0] = 4;
+			np.minSliders[0] = 1;
+			np.maxSliders[0] = 16;
+			np.minValues[0] = 1;
+			np.maxValues[0] = 16;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Delay subtracted from the cook time when matching timestamps
+		{
+			OP_NumericParameter	np;
+			np.name = "Matchdelay";
+			np.label = "Match delay (s)";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0.0;
+			np.minSliders[0] = 0.0;
+			np.maxSliders[0] = 0.2;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Push-pull hole filling on the capture thread
+		{
+			OP_NumericParameter	np;
+			np.name = "Fillholes";
+			np.label = "Fill holes";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Largest hole filled, in pixels from the nearest depth
+		{
+			OP_NumericParameter	np;
+			np.name = "Holeradius";
+			np.label = "Max hole radius";
+			np.page = pageName[1];
+			np.defaultValues[0] = 16;
+			np.minSliders[0] = 1;
+			np.maxSliders[0] = 64;
+			np.minValues[0] = 1;
+			np.maxValues[0] = 256;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Depth output mapped to 0-1 between percentiles of its histogram
+		{
+			OP_NumericParameter	np;
+			np.name = "Autorange";
+			np.label = "Auto range";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Percentiles of the depth that map to 0 and 1
+		{
+			OP_NumericParameter	np;
+			np.name = "Rangepercentiles";
+			np.label = "Range percentiles";
+			np.page = pageName[1];
+			np.defaultValues[0] = 2.0;
+			np.defaultValues[1] = 98.0;
+			for (int i = 0; i < 2; i++) {
+				np.minSliders[i] = 0.0;
+				np.maxSliders[i] = 100.0;
+				np.minValues[i] = 0.0;
+				np.maxValues[i] = 100.0;
+				np.clampMins[i] = true;
+				np.clampMaxes[i] = true;
+			}
+			OP_ParAppendResult res = manager->appendFloat(np, 2);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Share of the previous range kept each frame
+		{
+			OP_NumericParameter	np;
+			np.name = "Rangesmoothing";
+			np.label = "Range smoothing";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0.9;
+			np.minSliders[0] = 0.0;
+			np.maxSliders[0] = 0.99;
+			np.minValues[0] = 0.0;
+			np.maxValues[0] = 0.999;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Output mode
+		{
+			OP_StringParameter	sp;
+			sp.name = "Outputmode";
+			sp.label = "Output";
+			sp.page = pageName[1];
+			sp.defaultValue = "Depth";
+			const char* names[] = { "Depth", "Worldxyz", "Heightmap", "Tsdf", "Depthpyramid", "Samples" };
+			const char* labels[] = { "Depth", "World XYZ", "Top-down Heightmap", "TSDF Fusion", "Depth Min/Max Pyramid", "Foreground Samples" };
+			OP_ParAppendResult res = manager->appendMenu(sp, 6, names, labels);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Object COMP placing the camera in the world
+		{
+			OP_StringParameter	sp;
+			sp.name = "Cameraobject";
+			sp.label = "Camera object";
+			sp.page = pageName[1];
+			OP_ParAppendResult res = manager->appendObject(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Calibration file, used when no camera object is set
+		{
+			OP_StringParameter	sp;
+			sp.name = "Calibrationfile";
+			sp.label = "Calibration file";
+			sp.page = pageName[1];
+			OP_ParAppendResult res = manager->appendFile(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Find the floor in the next frame
+		{
+			OP_NumericParameter	np;
+			np.name = "Calibratefloor";
+			np.label = "Calibrate floor";
+			np.page = pageName[1];
+			OP_ParAppendResult res = manager->appendPulse(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Largest angle between the floor and the expected up direction
+		{
+			OP_NumericParameter	np;
+			np.name = "Floortilt";
+			np.label = "Floor max tilt";
+			np.page = pageName[1];
+			np.defaultValues[0] = 45.0;
+			np.minSliders[0] = 5.0;
+			np.maxSliders[0] = 90.0;
+			np.minValues[0] = 1.0;
+			np.maxValues[0] = 90.0;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Use the floor as the world
+		{
+			OP_NumericParameter	np;
+			np.name = "Usefloor";
+			np.label = "Use floor calibration";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Heightmap grid, in cells
+		{
+			OP_NumericParameter	np;
+			np.name = "Heightmapres";
+			np.label = "Heightmap resolution";
+			np.page = pageName[1];
+			for (int i = 0; i < 2; i++) {
+				np.defaultValues[i] = 256;
+				np.minSliders[i] = 16;
+				np.maxSliders[i] = 1024;
+				np.minValues[i] = 1;
+				np.maxValues[i] = 4096;
+				np.clampMins[i] = true;
+				np.clampMaxes[i] = true;
+			}
+			OP_ParAppendResult res = manager->appendInt(np, 2);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Floor area covered by the heightmap, world x and z in metres
+		{
+			OP_NumericParameter	np;
+			np.name = "Heightmapmin";
+			np.label = "Heightmap min XZ";
+			np.page = pageName[1];
+			np.defaultValues[0] = -3.0;
+			np.defaultValues[1] = -6.0;
+			OP_ParAppendResult res = manager->appendXY(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+		{
+			OP_NumericParameter	np;
+			np.name = "Heightmapmax";
+			np.label = "Heightmap max XZ";
+			np.page = pageName[1];
+			np.defaultValues[0] = 3.0;
+			np.defaultValues[1] = 0.0;
+			OP_ParAppendResult res = manager->appendXY(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Heights that count, above the floor
+		{
+			OP_NumericParameter	np;
+			np.name = "Heightrange";
+			np.label = "Height range";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0.05;
+			np.defaultValues[1] = 3.0;
+			for (int i = 0; i < 2; i++) {
+				np.minSliders[i] = 0.0;
+				np.maxSliders[i] = 4.0;
+				np.minValues[i] = 0.0;
+				np.clampMins[i] = true;
+			}
+			OP_ParAppendResult res = manager->appendFloat(np, 2);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// What each heightmap cell holds
+		{
+			OP_StringParameter	sp;
+			sp.name = "Heightmapvalue";
+			sp.label = "Heightmap value";
+			sp.page = pageName[1];
+			sp.defaultValue = "Maxheight";
+			const char* names[] = { "Maxheight", "Count" };
+			const char* labels[] = { "Max Height", "Point Count" };
+			OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Other cameras to fuse into the heightmap
+		{
+			OP_StringParameter	sp;
+			sp.name = "Fusionfile";
+			sp.label = "Fusion cameras file";
+			sp.page = pageName[1];
+			OP_ParAppendResult res = manager->appendFile(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// TSDF voxel size, in mm
+		{
+			OP_NumericParameter	np;
+			np.name = "Tsdfvoxel";
+			np.label = "TSDF voxel size (mm)";
+			np.page = pageName[1];
+			np.defaultValues[0] = 10.0;
+			np.minSliders[0] = 2.0;
+			np.maxSliders[0] = 50.0;
+			np.minValues[0] = 1.0;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Distance either side of the surface that is averaged, in mm
+		{
+			OP_NumericParameter	np;
+			np.name = "Tsdftruncation";
+			np.label = "TSDF truncation (mm)";
+			np.page = pageName[1];
+			np.defaultValues[0] = 40.0;
+			np.minSliders[0] = 5.0;
+			np.maxSliders[0] = 200.0;
+			np.minValues[0] = 1.0;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Frames averaged at most per voxel
+		{
+			OP_NumericParameter	np;
+			np.name = "Tsdfmaxweight";
+			np.label = "TSDF max weight";
+			np.page = pageName[1];
+			np.defaultValues[0] = 64;
+			np.minSliders[0] = 1;
+			np.maxSliders[0] = 256;
+			np.minValues[0] = 1;
+			np.maxValues[0] = 65535;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Depth beyond this is not fused, in metres
+		{
+			OP_NumericParameter	np;
+			np.name = "Tsdfmaxdepth";
+			np.label = "TSDF max depth";
+			np.page = pageName[1];
+			np.defaultValues[0] = 3.0;
+			np.minSliders[0] = 0.5;
+			np.maxSliders[0] = 8.0;
+			np.minValues[0] = 0.2;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Follow the camera with ICP
+		{
+			OP_NumericParameter	np;
+			np.name = "Tsdftrack";
+			np.label = "Track camera";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Empty the volume
+		{
+			OP_NumericParameter	np;
+			np.name = "Tsdfreset";
+			np.label = "Reset TSDF";
+			np.page = pageName[1];
+			OP_ParAppendResult res = manager->appendPulse(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Table of world-space boxes to count points in
+		{
+			OP_StringParameter	sp;
+			sp.name = "Triggerdat";
+			sp.label = "Trigger DAT";
+			sp.page = pageName[1];
+			OP_ParAppendResult res = manager->appendDAT(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Outlines of the foreground in the Info DAT
+		{
+			OP_NumericParameter	np;
+			np.name = "Contours";
+			np.label = "Contours";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Depths that count as foreground, in mm
+		{
+			OP_NumericParameter	np;
+			np.name = "Foreground";
+			np.label = "Foreground range (mm)";
+			np.page = pageName[1];
+			np.defaultValues[0] = 200.0;
+			np.defaultValues[1] = 1500.0;
+			for (int i = 0; i < 2; i++) {
+				np.minSliders[i] = 0.0;
+				np.maxSliders[i] = 4000.0;
+				np.minValues[i] = 0.0;
+				np.clampMins[i] = true;
+			}
+			OP_ParAppendResult res = manager->appendFloat(np, 2);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Largest distance an outline may move when simplified, in pixels
+		{
+			OP_NumericParameter	np;
+			np.name = "Contourtolerance";
+			np.label = "Contour tolerance";
+			np.page = pageName[1];
+			np.defaultValues[0] = 1.5;
+			np.minSliders[0] = 0.0;
+			np.maxSliders[0] = 10.0;
+			np.minValues[0] = 0.0;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Smallest outline kept, in pixels
+		{
+			OP_NumericParameter	np;
+			np.name = "Contourminarea";
+			np.label = "Contour min area";
+			np.page = pageName[1];
+			np.defaultValues[0] = 200.0;
+			np.minSliders[0] = 0.0;
+			np.maxSliders[0] = 5000.0;
+			np.minValues[0] = 0.0;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Most outlines kept, largest first
+		{
+			OP_NumericParameter	np;
+			np.name = "Contourmax";
+			np.label = "Max contours";
+			np.page = pageName[1];
+			np.defaultValues[0] = 16;
+			np.minSliders[0] = 1;
+			np.maxSliders[0] = 64;
+			np.minValues[0] = 1;
+			np.maxValues[0] = 1024;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Points in the Samples output, which is this many pixels wide
+		{
+			OP_NumericParameter	np;
+			np.name = "Samplecount";
+			np.label = "Sample count";
+			np.page = pageName[1];
+			np.defaultValues[0] = 1024;
+			np.minSliders[0] = 1;
+			np.maxSliders[0] = 16384;
+			np.minValues[0] = 1;
+			np.maxValues[0] = 16384;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Foreground blobs tracked as targets in the Info CHOP
+		{
+			OP_NumericParameter	np;
+			np.name = "Tracktargets";
+			np.label = "Track targets";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Slots in the Info CHOP, each held by one target while it lasts
+		{
+			OP_NumericParameter	np;
+			np.name = "Maxtargets";
+			np.label = "Max targets";
+			np.page = pageName[1];
+			np.defaultValues[0] = 8;
+			np.minSliders[0] = 1;
+			np.maxSliders[0] = 64;
+			np.minValues[0] = 1;
+			np.maxValues[0] = 256;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Smallest blob tracked, in pixels
+		{
+			OP_NumericParameter	np;
+			np.name = "Blobminsize";
+			np.label = "Blob min size";
+			np.page = pageName[1];
+			np.defaultValues[0] = 400;
+			np.minSliders[0] = 16;
+			np.maxSliders[0] = 5000;
+			np.minValues[0] = 1;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Farthest a target moves between frames and is still matched, m
+		{
+			OP_NumericParameter	np;
+			np.name = "Trackgate";
+			np.label = "Track gate (m)";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0.5;
+			np.minSliders[0] = 0.05;
+			np.maxSliders[0] = 2.0;
+			np.minValues[0] = 0.01;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Latency after the cook, such as a projector's, to predict across
+		{
+			OP_NumericParameter	np;
+			np.name = "Extralatency";
+			np.label = "Extra latency (ms)";
+			np.page = pageName[1];
+			np.defaultValues[0] = 0.0;
+			np.minSliders[0] = 0.0;
+			np.maxSliders[0] = 200.0;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Record
+		{
+			OP_NumericParameter	np;
+			np.name = "Record";
+			np.label = "Record";
+			np.page = pageName[2];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Recording file
+		{
+			OP_StringParameter	sp;
+			sp.name = "Recordfile";
+			sp.label = "Record file";
+			sp.page = pageName[2];
+			OP_ParAppendResult res = manager->appendFile(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Encoder threads
+		{
+			OP_NumericParameter	np;
+			np.name = "Encoderthreads";
+			np.label = "Encoder threads";
+			np.page = pageName[2];
+			np.defaultValues[0] = 2;
+			np.minSliders[0] = 1;
+			np.maxSliders[0] = 8;
+			np.minValues[0] = 1;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Spacer3
+		{
+			OP_StringParameter	sp;
+			sp.name = "Spacer3";
+			sp.label = " ";
+			sp.page = pageName[2];
+			OP_ParAppendResult res = manager->appendString(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Instant replay buffer
+		{
+			OP_NumericParameter	np;
+			np.name = "Replay";
+			np.label = "Replay buffer";
+			np.page = pageName[2];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Replay duration
+		{
+			OP_NumericParameter	np;
+			np.name = "Replayseconds";
+			np.label = "Replay seconds";
+			np.page = pageName[2];
+			np.defaultValues[0] = 30.0;
+			np.minSliders[0] = 1.0;
+			np.maxSliders[0] = 120.0;
+			np.minValues[0] = 0.1;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendFloat(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Replay memory cap
+		{
+			OP_NumericParameter	np;
+			np.name = "Replaymemory";
+			np.label = "Replay memory (MB)";
+			np.page = pageName[2];
+			np.defaultValues[0] = 512;
+			np.minSliders[0] = 16;
+			np.maxSliders[0] = 4096;
+			np.minValues[0] = 1;
+			np.clampMins[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Folder replays are dumped to
+		{
+			OP_StringParameter	sp;
+			sp.name = "Replayfolder";
+			sp.label = "Replay folder";
+			sp.page = pageName[2];
+			OP_ParAppendResult res = manager->appendFolder(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Dump replay buffer
+		{
+			OP_NumericParameter	np;
+			np.name = "Dumpreplay";
+			np.label = "Dump replay";
+			np.page = pageName[2];
+			OP_ParAppendResult res = manager->appendPulse(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Shared memory output
+		{
+			OP_NumericParameter	np;
+			np.name = "Sharedmem";
+			np.label = "Shared memory";
+			np.page = pageName[3];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Shared memory name
+		{
+			OP_StringParameter	sp;
+			sp.name = "Sharedmemname";
+			sp.label = "Shared memory name";
+			sp.page = pageName[3];
+			sp.defaultValue = "SenseTOP";
+			OP_ParAppendResult res = manager->appendString(sp);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Depth stream server
+		{
+			OP_NumericParameter	np;
+			np.name = "Stream";
+			np.label = "Stream";
+			np.page = pageName[3];
+			np.defaultValues[0] = 0;
+			OP_ParAppendResult res = manager->appendToggle(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
+		// Port the stream is served on
+		{
+			OP_NumericParameter	np;
+			np.name = "Streamport";
+			np.label = "Stream port";
+			np.page = pageName[3];
+			np.defaultValues[0] = 7450;
+			np.minSliders[0] = 1024;
+			np.maxSliders[0] = 65535;
+			np.minValues[0] = 1;
+			np.maxValues[0] = 65535;
+			np.clampMins[0] = true;
+			np.clampMaxes[0] = true;
+			OP_ParAppendResult res = manager->appendInt(np);
+			assert(res == OP_ParAppendResult::Success);
+		}
+
 	}
 
 	printf("Set up custom TOP params\n");
@@ -108,44 +928,359 @@ UiHelper::init(OP_ParameterManager* manager, PXCCapture::Device *in_device)
 }
 
 
-// Update device settings from user input
-void
+// Loads named presets from a text file with one preset per line:
+//   name accuracy laserpower filteroption motiontradeoff
+// Blank lines and lines starting with # are ignored.
+bool
+UiHelper::loadPresets(const char* path)
+{
+	presets.clear();
+	presetPath = path ? path : "";
+
+	std::ifstream file(presetPath);
+	if (!file) return false;
+
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string name;
+		if (!(fields >> name) || name[0] == '#') continue;
+
+		DeviceSettings preset;
+		if (fields >> preset.accuracy >> preset.laserPower >> preset.filterOption >> preset.motionTradeoff)
+			presets[name] = preset;
+		else
+			printf("Skipping malformed preset '%s'\n", name.c_str());
+	}
+
+	printf("Loaded %d presets from %s\n", (int)presets.size(), presetPath.c_str());
+	return true;
+}
+
+// One camera per line: "network host port calibration" or "synthetic
+// calibration". Calibration files are relative to the fusion file.
+bool
+UiHelper::loadFusionCameras(const char* path)
+{
+	fusionCameras.clear();
+	fusionPath = path ? path : "";
+
+	std::ifstream file(fusionPath);
+	if (!file) return false;
+
+	std::string folder = fusionPath.substr(0, fusionPath.find_last_of("/\\") + 1);
+
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string type;
+		if (!(fields >> type) || type[0] == '#') continue;
+
+		FusionCameraSettings camera;
+		bool ok;
+		if (type == "network") {
+			camera.source.type = DepthSourceType::Network;
+			ok = (bool)(fields >> camera.source.host >> camera.source.port >> camera.calibrationPath);
+		}
+		else if (type == "synthetic") {
+			camera.source.type = DepthSourceType::Synthetic;
+			ok = (bool)(fields >> camera.calibrationPath);
+		}
+		else {
+			ok = false;
+		}
+
+		if (!ok) {
+			printf("Skipping malformed fusion camera '%s'\n", line.c_str());
+			continue;
+		}
+		bool absolute = camera.calibrationPath[0] == '/' || camera.calibrationPath[0] == '\\' ||
+			camera.calibrationPath.find(':') != std::string::npos;
+		if (!absolute) camera.calibrationPath = folder + camera.calibrationPath;
+		fusionCameras.push_back(camera);
+	}
+
+	printf("Loaded %d fusion cameras from %s\n", (int)fusionCameras.size(), fusionPath.c_str());
+	return true;
+}
+
+// A table with a header row and one box per row after it. Columns are found
+// by name: name, tx ty tz (centre, m), sx sy sz (size, m), rx ry rz
+// (rotation, degrees) and minpoints; any that are missing keep their default.
+// The table is only parsed again when it changes, which returns true. DAT
+// inputs have no cook count, so a change is spotted by hashing the cells
+// (FNV-1a), which allocates nothing.
+bool
+UiHelper::loadTriggers(const OP_DATInput* dat)
+{
+	uint64_t hash = 0;
+	if (dat && dat->isTable && dat->numRows >= 2) {
+		hash = 14695981039346656037ull;
+		auto mix = [&hash](uint32_t value) {
+			hash ^= value;
+			hash *= 1099511628211ull;
+		};
+		mix(dat->opId);
+		mix((uint32_t)dat->numRows);
+		mix((uint32_t)dat->numCols);
+		for (int32_t r = 0; r < dat->numRows; r++) {
+			for (int32_t c = 0; c < dat->numCols; c++) {
+				for (const char* cell = dat->getCell(r, c); cell && *cell; cell++)
+					mix((uint8_t)*cell);
+				mix(0x100);
+			}
+		}
+	}
+	if (hash == triggerHash) return false;
+	triggerHash = hash;
+
+	triggers.clear();
+	if (hash == 0) return true;
+
+	static const char* columns[] = { "name", "tx", "ty", "tz", "sx", "sy", "sz", "rx", "ry", "rz", "minpoints" };
+	const int count = sizeof(columns) / sizeof(columns[0]);
+	int index[count];
+	for (int i = 0; i < count; i++) {
+		index[i] = -1;
+		for (int c = 0; c < dat->numCols; c++) {
+			const char* header = dat->getCell(0, c);
+			if (header && strcmp(header, columns[i]) == 0) index[i] = c;
+		}
+	}
+
+	for (int r = 1; r < dat->numRows; r++) {
+		TriggerVolume volume;
+		float* fields[] = { volume.center, volume.center + 1, volume.center + 2, volume.size, volume.size + 1, volume.size + 2,
+			volume.rotate, volume.rotate + 1, volume.rotate + 2 };
+		if (index[0] >= 0) {
+			const char* name = dat->getCell(r, index[0]);
+			volume.name = name ? name : "";
+		}
+		for (int i = 1; i < 10; i++) {
+			const char* cell = index[i] >= 0 ? dat->getCell(r, index[i]) : nullptr;
+			if (cell && *cell) *fields[i - 1] = (float)atof(cell);
+		}
+		const char* cell = index[10] >= 0 ? dat->getCell(r, index[10]) : nullptr;
+		if (cell && *cell) volume.minPoints = atoi(cell);
+		triggers.push_back(volume);
+	}
+	return true;
+}
+
+// Read device settings from user input. Returns true if any of them changed
+// since the last call, or another preset was selected; the device itself is
+// written by DeviceControl. presetSwitched is set when another preset was
+// selected, even one with the current values, which should be applied as a
+// single batch at a frame boundary.
+bool
 UiHelper::update(OP_Inputs* inputs)
 {
 	// First time disable spacers
+	bool changed = false;
 	if (!firstUpdate) {
 		inputs->enablePar("Spacer1", false);
+		inputs->enablePar("Spacer2", false);
+		inputs->enablePar("Spacer3", false);
+		inputs->enablePar("Spacer4", false);
 		firstUpdate = true;
+		changed = true;
 	}
 
-	m_accuracy = inputs->getParInt("Accuracy");
-	if (m_device->QueryIVCAMAccuracy() != m_accuracy) {
-		m_device->SetIVCAMAccuracy((PXCCapture::Device::IVCAMAccuracy)m_accuracy);
+	const char* path = inputs->getParFilePath("Presetfile");
+	if (reloadPresets || presetPath != (path ? path : "")) {
+		loadPresets(path);
+		reloadPresets = false;
 	}
 
-	m_power = inputs->getParInt("Laserpower");
-	if (m_device->QueryIVCAMLaserPower() != m_power) {
-		m_device->SetIVCAMLaserPower(m_power);
+	DeviceSettings current;
+	current.accuracy = inputs->getParInt("Accuracy");
+	current.laserPower = inputs->getParInt("Laserpower");
+	current.filterOption = inputs->getParInt("Filteroption");
+	current.motionTradeoff = inputs->getParInt("Motiontradeoff");
+	current.autoExposure = inputs->getParInt("Colorautoexp");
+	current.autoWhiteBalance = inputs->getParInt("Colorautowb");
+
+	// A selected preset overrides the depth settings as a group
+	const char* presetName = inputs->getParString("Preset");
+	auto preset = presets.find(presetName ? presetName : "");
+	bool usePreset = preset != presets.end();
+	if (usePreset) {
+		current.accuracy = preset->second.accuracy;
+		current.laserPower = preset->second.laserPower;
+		current.filterOption = preset->second.filterOption;
+		current.motionTradeoff = preset->second.motionTradeoff;
 	}
 
-	m_filterOption = inputs->getParInt("Filteroption");
-	if (m_device->QueryIVCAMFilterOption() != m_filterOption) {
-		m_device->SetIVCAMFilterOption(m_filterOption);
+	std::string selected = usePreset ? preset->first : "";
+	if (selected != activePreset) {
+		activePreset = selected;
+		inputs->enablePar("Accuracy", !usePreset);
+		inputs->enablePar("Laserpower", !usePreset);
+		inputs->enablePar("Filteroption", !usePreset);
+		inputs->enablePar("Motiontradeoff", !usePreset);
+		presetSwitched = true;
+	}
+	else {
+		presetSwitched = false;
 	}
 
-	m_motion = inputs->getParInt("Motiontradeoff");
-	if (m_device->QueryIVCAMMotionRangeTradeOff() != m_motion) {
-		m_device->SetIVCAMMotionRangeTradeOff(m_motion);
+	if (current != settings) {
+		settings = current;
+		changed = true;
 	}
 
-	m_autoexp = inputs->getParInt("Colorautoexp");
-	if (m_device->QueryColorAutoExposure() != m_autoexp) {
-		m_device->SetColorAutoExposure(m_autoexp);
+	return changed || presetSwitched;
+}
+
+// Read the Output and Record pages
+void
+UiHelper::updateOutput(OP_Inputs* inputs)
+{
+	cookOnNewFrame = inputs->getParInt("Cookmode") == 1;
+	delivery = (FrameDelivery)inputs->getParInt("Delivery");
+	queueSize = inputs->getParInt("Queuesize");
+	matchDelay = inputs->getParDouble("Matchdelay");
+
+	inputs->enablePar("Queuesize", delivery == FrameDelivery::Fifo);
+	inputs->enablePar("Matchdelay", delivery == FrameDelivery::Timestamp);
+
+	fillHoles = inputs->getParInt("Fillholes") != 0;
+	holeRadius = inputs->getParInt("Holeradius");
+	inputs->enablePar("Holeradius", fillHoles);
+
+	double low, high;
+	autoRange = inputs->getParInt("Autorange") != 0;
+	inputs->getParDouble2("Rangepercentiles", low, high);
+	rangePercentiles[0] = (float)low;
+	rangePercentiles[1] = (float)high;
+	rangeSmoothing = (float)inputs->getParDouble("Rangesmoothing");
+
+	// Triggers and targets are in world space whatever the output is
+	triggersChanged = loadTriggers(inputs->getParDAT("Triggerdat"));
+
+	outputMode = (OutputMode)inputs->getParInt("Outputmode");
+	bool world = (outputMode != OutputMode::Depth && outputMode != OutputMode::DepthPyramid) || !triggers.empty() ||
+		inputs->getParInt("Tracktargets") != 0;
+	inputs->enablePar("Cameraobject", world);
+	inputs->enablePar("Calibrationfile", world);
+
+	floorTilt = inputs->getParDouble("Floortilt");
+	useFloor = inputs->getParInt("Usefloor") != 0;
+	inputs->enablePar("Usefloor", world);
+	inputs->enablePar("Autorange", outputMode == OutputMode::Depth);
+	inputs->enablePar("Rangepercentiles", autoRange && outputMode == OutputMode::Depth);
+	inputs->enablePar("Rangesmoothing", autoRange && outputMode == OutputMode::Depth);
+
+	bool top = outputMode == OutputMode::Heightmap;
+	double minX, minZ, maxX, maxZ, minY, maxY;
+	inputs->getParInt2("Heightmapres", heightmap.width, heightmap.height);
+	inputs->getParDouble2("Heightmapmin", minX, minZ);
+	inputs->getParDouble2("Heightmapmax", maxX, maxZ);
+	inputs->getParDouble2("Heightrange", minY, maxY);
+	heightmap.minX = (float)minX;
+	heightmap.minZ = (float)minZ;
+	heightmap.maxX = (float)maxX;
+	heightmap.maxZ = (float)maxZ;
+	heightmap.minY = (float)minY;
+	heightmap.maxY = (float)maxY;
+	heightmap.value = (HeightmapValue)inputs->getParInt("Heightmapvalue");
+	inputs->enablePar("Heightmapres", top);
+	inputs->enablePar("Heightmapmin", top);
+	inputs->enablePar("Heightmapmax", top);
+	inputs->enablePar("Heightrange", top);
+	inputs->enablePar("Heightmapvalue", top);
+	inputs->enablePar("Fusionfile", top);
+
+	bool fusing = outputMode == OutputMode::Tsdf;
+	tsdf.voxelSize = (float)(inputs->getParDouble("Tsdfvoxel") * 0.001);
+	tsdf.truncation = (float)(inputs->getParDouble("Tsdftruncation") * 0.001);
+	tsdf.maxWeight = inputs->getParInt("Tsdfmaxweight");
+	tsdf.maxDepth = (float)inputs->getParDouble("Tsdfmaxdepth");
+	tsdf.track = inputs->getParInt("Tsdftrack") != 0;
+	inputs->enablePar("Tsdfvoxel", fusing);
+	inputs->enablePar("Tsdftruncation", fusing);
+	inputs->enablePar("Tsdfmaxweight", fusing);
+	inputs->enablePar("Tsdfmaxdepth", fusing);
+	inputs->enablePar("Tsdftrack", fusing);
+	inputs->enablePar("Tsdfreset", fusing);
+
+	double nearDepth, farDepth;
+	inputs->getParDouble2("Foreground", nearDepth, farDepth);
+	foreground[0] = (float)nearDepth;
+	foreground[1] = (float)farDepth;
+	bool sampling = outputMode == OutputMode::Samples;
+	sampleCount = inputs->getParInt("Samplecount");
+	inputs->enablePar("Samplecount", sampling);
+
+	trackTargets = inputs->getParInt("Tracktargets") != 0;
+	tracker.nearDepth = foreground[0];
+	tracker.farDepth = foreground[1];
+	tracker.maxTargets = inputs->getParInt("Maxtargets");
+	tracker.minPixels = inputs->getParInt("Blobminsize");
+	tracker.gate = (float)inputs->getParDouble("Trackgate");
+	extraLatency = inputs->getParDouble("Extralatency");
+	inputs->enablePar("Maxtargets", trackTargets);
+	inputs->enablePar("Blobminsize", trackTargets);
+	inputs->enablePar("Trackgate", trackTargets);
+	inputs->enablePar("Extralatency", trackTargets);
+
+	traceContours = inputs->getParInt("Contours") != 0;
+	contours.nearDepth = foreground[0];
+	contours.farDepth = foreground[1];
+	contours.tolerance = (float)inputs->getParDouble("Contourtolerance");
+	contours.minArea = (float)inputs->getParDouble("Contourminarea");
+	contours.maxContours = inputs->getParInt("Contourmax");
+	inputs->enablePar("Foreground", traceContours || sampling || trackTargets);
+	inputs->enablePar("Contourtolerance", traceContours);
+	inputs->enablePar("Contourminarea", traceContours);
+	inputs->enablePar("Contourmax", traceContours);
+
+	const char* fusion = inputs->getParFilePath("Fusionfile");
+	if (fusionPath != (fusion ? fusion : "")) loadFusionCameras(fusion);
+
+	const char* path = inputs->getParFilePath("Calibrationfile");
+	if (calibrationPath != (path ? path : "")) {
+		calibrationPath = path ? path : "";
+		calibration.load(path);
 	}
 
-	m_autoWB = inputs->getParInt("Colorautowb");
-	if (m_device->QueryColorAutoWhiteBalance() != m_autoWB) {
-		m_device->SetColorAutoWhiteBalance(m_autoWB);
+	const OP_ObjectInput* object = inputs->getParObject("Cameraobject");
+	if (object) {
+		cameraToWorld = Matrix::fromRows(object->worldTransform);
+		transformSource = "object";
+	}
+	else {
+		cameraToWorld = calibration.cameraToWorld;
+		transformSource = calibrationPath.empty() ? "none" : "file";
 	}
 
-}
\ No newline at end of file
+	record = inputs->getParInt("Record") != 0;
+	path = inputs->getParFilePath("Recordfile");
+	recordPath = path ? path : "";
+	encoderThreads = inputs->getParInt("Encoderthreads");
+
+	// The file and thread count only apply when recording starts
+	inputs->enablePar("Recordfile", !record);
+	inputs->enablePar("Encoderthreads", !record);
+
+	replay = inputs->getParInt("Replay") != 0;
+	replaySeconds = inputs->getParDouble("Replayseconds");
+	replayMemoryMB = inputs->getParInt("Replaymemory");
+	path = inputs->getParFilePath("Replayfolder");
+	replayFolder = path ? path : "";
+
+	sharedMemory = inputs->getParInt("Sharedmem") != 0;
+	const char* name = inputs->getParString("Sharedmemname");
+	sharedMemoryName = name ? name : "";
+	inputs->enablePar("Sharedmemname", !sharedMemory);
+
+	stream = inputs->getParInt("Stream") != 0;
+	streamPort = inputs->getParInt("Streamport");
+
+	source.type = (DepthSourceType)inputs->getParInt("Source");
+	const char* host = inputs->getParString("Sourcehost");
+	source.host = host ? host : "";
+	source.port = inputs->getParInt("Sourceport");
+	inputs->enablePar("Sourcehost", source.type == DepthSourceType::Network);
+	inputs->enablePar("Sourceport", source.type == DepthSourceType::Network);
+}
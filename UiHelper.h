@@ -2,8 +2,70 @@
 #define UiHelper_h
 
 #include "TOP_CPlusPlusBase.h"
-#include "pxcsensemanager.h"
+#include "DeviceControl.h"
+#include "CameraCalibration.h"
+#include "Heightmap.h"
+#include "TsdfVolume.h"
+#include "TriggerVolumes.h"
+#include "ContourTracer.h"
+#include "BlobTracker.h"
 #include <iostream>
+#include <string>
+#include <map>
+#include <vector>
+
+// How frames queued by the capture thread are delivered to the cook
+enum class FrameDelivery : int32_t
+{
+	Latest = 0,		// newest frame, older ones are dropped
+	Fifo,			// one frame per cook, in order
+	Timestamp,		// frame captured closest to the cook time
+};
+
+// What the TOP outputs
+enum class OutputMode : int32_t
+{
+	Depth = 0,		// depth in mm, red channel
+	WorldXYZ,		// world-space position in rgb, alpha 1 where there is depth
+	Heightmap,		// top-down grid of world-space points in red, cell age in green
+	Tsdf,			// fused surface rendered from the camera: world normal in rgb, depth in alpha
+	DepthPyramid,	// min/max depth pyramid atlas: nearest in red, farthest in green
+	Samples,		// N x 1 world points picked from the foreground, alpha 1 where there is one
+};
+
+// Where the capture thread reads depth from
+enum class DepthSourceType : int32_t
+{
+	Camera = 0,		// RealSense camera
+	Network,		// another SenseTOP's depth stream
+	Synthetic,		// generated test scene
+};
+
+struct SourceSettings
+{
+	DepthSourceType type = DepthSourceType::Camera;
+	std::string host;
+	int32_t port = 0;
+
+	bool operator==(const SourceSettings &o) const
+	{
+		return type == o.type && host == o.host && port == o.port;
+	}
+	bool operator!=(const SourceSettings &o) const { return !(*this == o); }
+};
+
+// Another camera fused into the heightmap, from the fusion file
+struct FusionCameraSettings
+{
+	SourceSettings source;
+	std::string calibrationPath;
+
+	bool operator==(const FusionCameraSettings &o) const
+	{
+		return source == o.source && calibrationPath == o.calibrationPath;
+	}
+	bool operator!=(const FusionCameraSettings &o) const { return !(*this == o); }
+};
 
 class UiHelper
 {
@@ -15,20 +77,97 @@ public:
 	bool isInit;
 	bool firstUpdate;
 
-	void init(OP_ParameterManager* manager, PXCCapture::Device *in_device);
-	void update(OP_Inputs* inputs);
+	void init(OP_ParameterManager* manager);
+	bool update(OP_Inputs* inputs);
+	bool loadPresets(const char* path);
+	bool loadFusionCameras(const char* path);
+	bool loadTriggers(const OP_DATInput* dat);
+	void updateOutput(OP_Inputs* inputs);
+
+	const char* pageName[4];
+
+	// Last values read from the Device page
+	DeviceSettings settings;
+
+	// Named presets from the preset file, and the one currently selected
+	std::map<std::string, DeviceSettings> presets;
+	std::string presetPath;
+	std::string activePreset;
+	bool presetSwitched;
+	bool reloadPresets;
+
+	// Source, on the Device page
+	SourceSettings source;
+
+	// Output page
+	bool cookOnNewFrame;
+	FrameDelivery delivery;
+	int32_t queueSize;
+	double matchDelay;
+	bool fillHoles;
+	int32_t holeRadius;
+	bool autoRange;
+	float rangePercentiles[2];
+	float rangeSmoothing;
+	OutputMode outputMode;
+
+	// Camera-to-world transform, from the Camera object if one is set, else
+	// from the calibration file
+	Matrix cameraToWorld;
+	const char* transformSource;
+	CameraCalibration calibration;
+	std::string calibrationPath;
+
+	// Floor calibration, which replaces the transform above when used
+	double floorTilt;
+	bool useFloor;
+
+	// Top-down heightmap grid and what it holds
+	HeightmapSettings heightmap;
+
+	// Other cameras fused into the heightmap
+	std::vector<FusionCameraSettings> fusionCameras;
+	std::string fusionPath;
+
+	// TSDF fusion volume
+	TsdfSettings tsdf;
+
+	// Trigger boxes, from the trigger DAT, set when they changed in the
+	// last updateOutput(). triggerHash identifies the table they came from.
+	std::vector<TriggerVolume> triggers;
+	bool triggersChanged;
+	uint64_t triggerHash;
+
+	// Depths that count as foreground, in mm
+	float foreground[2];
+
+	// Foreground outlines for the Info DAT
+	bool traceContours;
+	ContourSettings contours;
+
+	// Points picked from the foreground for the Samples output
+	int32_t sampleCount;
 
-	const char* pageName[1];
+	// Foreground blobs tracked as targets, and latency added to the
+	// measured one when predicting them, ms
+	bool trackTargets;
+	TrackerSettings tracker;
+	double extraLatency;
 
-	pxcI32 m_accuracy;
-	pxcI32 m_power;
-	pxcI32 m_filterOption;
-	pxcI32 m_motion;
-	pxcBool m_autoexp;
-	pxcBool m_autoWB;
+	// Record page
+	bool record;
+	std::string recordPath;
+	int32_t encoderThreads;
+	bool replay;
+	double replaySeconds;
+	int32_t replayMemoryMB;
+	std::string replayFolder;
 
-private:
-	PXCCapture::Device *m_device;
+	// Publish page
+	bool sharedMemory;
+	std::string sharedMemoryName;
+	bool stream;
+	int32_t streamPort;
 
 };
 